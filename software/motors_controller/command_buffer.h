@@ -0,0 +1,22 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+// Types used by several sketch files
+// (declared in a header because the arduino builder declares functions before the types defined in .ino files)
+
+#pragma once
+
+// Commands are parsed before being buffered, so the buffer never allocates String
+enum class command_type_t : char {
+    SET_SAMPLING = 0,  // args : period_ms, samples_count
+    SET_OUTPUT_LEVEL,  // args : output_level
+    SET_OUTPUT,        // args : motor_pins, max_time_ms, threshold
+    NOTIFY_STOP,       // args : request_id, binary (1 if the notification is a binary frame, 0 if it's a text line)
+};
+
+const int COMMAND_ARGS_COUNT = 3;
+
+struct command_t {
+    command_type_t type;
+    int args[COMMAND_ARGS_COUNT];
+};
@@ -8,7 +8,7 @@
 // commands are executed sequentially by loop function
 
 const int MAX_COMMANDS_COUNT = 5;
-String commands[MAX_COMMANDS_COUNT];
+command_t commands[MAX_COMMANDS_COUNT];
 int command_count = 0;
 int current_command_index = -1; // -1 means "no running command"
 
@@ -18,7 +18,7 @@ void clearCommandBuffer()
     current_command_index = -1;
 }
 
-void appendCommand(String command)
+void appendCommand(const command_t &command)
 {
     if (command_count == MAX_COMMANDS_COUNT) {
         Serial.println("command buffer is full");
@@ -34,12 +34,9 @@ bool isCommandAvailable()
     return (current_command_index + 1 < command_count);
 }
 
-// return next command in the buffer or empty string is no more command
-String getNextCommand()
+// return next command in the buffer (isCommandAvailable must be checked before)
+const command_t &getNextCommand()
 {
-    if (!isCommandAvailable()) {
-        return "";
-    }
     current_command_index++;
     return commands[current_command_index];
 }
@@ -49,7 +46,12 @@ void printCommandBuffer()
     for (int i = 0; i < command_count; i++) {
         Serial.print("  commands[");
         Serial.print(i);
-        Serial.print("]:");
-        Serial.println(commands[i]);
+        Serial.print("]: type=");
+        Serial.print((int)commands[i].type);
+        for (int j = 0; j < COMMAND_ARGS_COUNT; j++) {
+            Serial.print(j == 0 ? " args=" : ",");
+            Serial.print(commands[i].args[j]);
+        }
+        Serial.println();
     }
 }
@@ -3,7 +3,9 @@
 
 // ================= Command parser =================
 
-// Parse input command strings, append commands to buffer and start
+// Parse input command strings or binary frames, append commands to buffer and start
+// Text commands are kept for compatibility and manual tests, the supervisor sends binary frames
+// (see motors_protocol.h) which are decoded without any String allocation
 
 // Parse the arguments part of a command string, return the nth argument as int
 int parseCommandArgument(String command, int value_index, int default_value)
@@ -30,10 +32,13 @@ void parseAndRunCommands(String commands)
     }
 
     // First check for immediate single command
-    if (commands.startsWith("c")) { // Stop and clear all commands immediately
+    if (commands.startsWith("c")) { // Stop and clear all commands immediately, notify if an id is given
         stopAndClearCommands();
+        sendStopNotification(parseCommandArgument(commands, 0, -1), false);
     } else if (commands.equals("s")) { // Return state immediately
-        sendRunningState();
+        sendRunningState(-1, false);
+    } else if (commands.startsWith("s:")) { // Return state immediately, with the request id
+        sendRunningState(parseCommandArgument(commands, 0, -1), false);
     } else if (commands.startsWith("p")) { // Print all commands immediately
         printCommandBuffer();
     } else if (commands.startsWith("m:")) { // Print measure buffer
@@ -47,8 +52,15 @@ void parseAndRunCommands(String commands)
         int pos = 0;
         do {
             int next_sep_pos = commands.indexOf(sep, pos);
-            String command = (next_sep_pos == -1) ? commands.substring(pos) : commands.substring(pos, next_sep_pos);
-            if (command.length() > 0) {
+            String text = (next_sep_pos == -1) ? commands.substring(pos) : commands.substring(pos, next_sep_pos);
+            if (text.length() > 0) {
+                command_t command;
+                if (!parseCommand(text, command)) {
+                    Serial.print("unknown command: STOP ");
+                    Serial.println(text);
+                    stopAndClearCommands();
+                    return;
+                }
                 appendCommand(command);
             }
             pos = next_sep_pos + 1;
@@ -61,18 +73,72 @@ void parseAndRunCommands(String commands)
     }
 }
 
+// Parse a text command to be buffered, return false if it's unknown
+bool parseCommand(String text, command_t &command)
+{
+    if (text.startsWith("ms:")) { // Measure sampling
+        command.type = command_type_t::SET_SAMPLING;
+        command.args[0] = parseCommandArgument(text, 0, 10);
+        command.args[1] = parseCommandArgument(text, 1, 10);
+    } else if (text.startsWith("l:")) { // Output Level
+        command.type = command_type_t::SET_OUTPUT_LEVEL;
+        command.args[0] = parseCommandArgument(text, 0, -1);
+    } else if (text.startsWith("o:")) { // Output
+        command.type = command_type_t::SET_OUTPUT;
+        command.args[0] = parseCommandArgument(text, 0, -1);
+        command.args[1] = parseCommandArgument(text, 1, 200);
+        command.args[2] = parseCommandArgument(text, 2, 1024);
+    } else if (text.startsWith("n:")) { // Notify when all commands are done
+        command.type = command_type_t::NOTIFY_STOP;
+        command.args[0] = parseCommandArgument(text, 0, -1);
+        command.args[1] = 0;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Execute a binary frame received from the supervisor
+// (a request id 0 means no reply is expected)
+void runFrame(const motors_frame_t &frame)
+{
+    int request_id = (frame.request_id == 0) ? -1 : frame.request_id;
+    Serial.print("run frame: opcode=");
+    Serial.print((int)frame.opcode);
+    Serial.print(" request_id=");
+    Serial.println(request_id);
+
+    if (frame.opcode == motors_opcode_t::STOP) {
+        stopAndClearCommands();
+        sendStopNotification(request_id, true);
+    } else if (frame.opcode == motors_opcode_t::STATE) {
+        sendRunningState(request_id, true);
+    } else if (frame.opcode == motors_opcode_t::MOVE) {
+        // All steps are executed in sequence, then the stop is notified
+        stopAndClearCommands();
+        for (int i = 0; i < frame.step_count; i++) {
+            int max_time_ms = frame.max_times_ms[i];
+            int threshold = frame.threshold;
+            appendCommand({command_type_t::SET_OUTPUT, {frame.motor_pins[i], max_time_ms, threshold}});
+        }
+        appendCommand({command_type_t::NOTIFY_STOP, {request_id, 1, 0}});
+        startNextCommand();
+    } else {
+        Serial.println("unexpected frame: STOP");
+        stopAndClearCommands();
+    }
+}
+
 // Start command immediately
-void parseAndStartCommand(String command)
+void startCommand(const command_t &command)
 {
-    Serial.print("start command: ");
-    Serial.println(command);
+    Serial.print("start command: type=");
+    Serial.println((int)command.type);
 
-    if (command.startsWith("ms:")) { // Measure sampling
-        int period_ms = parseCommandArgument(command, 0, 10);
-        int samples_count = parseCommandArgument(command, 1, 10);
-        setSampling(period_ms, samples_count);
-    } else if (command.startsWith("l:")) { // Output Level
-        int output_level = parseCommandArgument(command, 0, -1);
+    if (command.type == command_type_t::SET_SAMPLING) {
+        setSampling(command.args[0], command.args[1]);
+    } else if (command.type == command_type_t::SET_OUTPUT_LEVEL) {
+        int output_level = command.args[0];
         Serial.print("  output_level: ");
         Serial.println(output_level);
         if (output_level < 0 || output_level > 255) {
@@ -80,24 +146,23 @@ void parseAndStartCommand(String command)
             return;
         }
         analogWrite(PWM_PIN, output_level);
-    } else if (command.startsWith("o:")) { // Output
-        int motor_pins = parseCommandArgument(command, 0, -1);
+    } else if (command.type == command_type_t::SET_OUTPUT) {
+        int motor_pins = command.args[0];
         Serial.print("  motor_pins: ");
         Serial.println(motor_pins);
         if (motor_pins == -1)
             return;
 
-        int max_time_ms = parseCommandArgument(command, 1, 200);
+        int max_time_ms = command.args[1];
         Serial.print("  max_time_ms: ");
         Serial.println(max_time_ms);
 
-        int threshold = parseCommandArgument(command, 2, 1024);
+        int threshold = command.args[2];
         Serial.print("  threshold: ");
         Serial.println(threshold);
 
         startOutputCommand(motor_pins, max_time_ms, threshold);
-    } else {
-        Serial.println("unknown command: STOP");
-        stopAndClearCommands();
+    } else if (command.type == command_type_t::NOTIFY_STOP) {
+        setStopNotification(command.args[0], command.args[1] != 0);
     }
 }
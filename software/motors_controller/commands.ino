@@ -12,11 +12,17 @@ int threshold;
 bool output_command_running = false;
 bool running = false;
 
+// Id of the stop notification to send when all buffered commands are done (-1 if none)
+int stop_notification_id = -1;
+bool stop_notification_binary = false;
+
 void stopAndClearCommands()
 {
     clearCommandBuffer();
     output_command_running = false;
     running = false;
+    stop_notification_id = -1;
+    stop_notification_binary = false;
     writeMotors(0);
     digitalWrite(LED_BUILTIN, LOW);
 }
@@ -26,10 +32,29 @@ void startNextCommand()
     if (isCommandAvailable()) {
         digitalWrite(LED_BUILTIN, HIGH);
         running = true;
-        String command = getNextCommand();
-        parseAndStartCommand(command);
+        startCommand(getNextCommand());
     } else {
+        int notification_id = stop_notification_id;
+        bool notification_binary = stop_notification_binary;
         stopAndClearCommands();
+        sendStopNotification(notification_id, notification_binary);
+    }
+}
+
+// The notification will be sent when all buffered commands are done
+void setStopNotification(int request_id, bool binary)
+{
+    stop_notification_id = request_id;
+    stop_notification_binary = binary;
+}
+
+// Notify the master that motors stopped, in the same form as a state reply
+void sendStopNotification(int request_id, bool binary)
+{
+    if (request_id >= 0) {
+        Serial.print("  stop notification: ");
+        Serial.println(request_id);
+        sendRunningState(request_id, binary);
     }
 }
 
@@ -50,11 +75,27 @@ bool isRunning()
     return running;
 }
 
-void sendRunningState()
+// Reply a binary frame if 'binary' is true,
+// otherwise reply '<request_id>:<running>' line if request_id is given, or only '<running>' character
+void sendRunningState(int request_id, bool binary)
 {
     Serial.print("  running state: ");
     Serial.println(running ? '1' : '0');
-    MasterSerial.print(running ? '1' : '0');
+    if (binary) {
+        motors_frame_t reply = {};
+        reply.opcode = motors_opcode_t::REPLY;
+        reply.request_id = (request_id < 0) ? 0 : request_id;
+        reply.running = running ? 1 : 0;
+        uint8_t frame[MOTORS_PROTOCOL_MAX_FRAME_SIZE];
+        int size = motors_protocol_encode(reply, frame, MOTORS_PROTOCOL_MAX_FRAME_SIZE);
+        MasterSerial.write(frame, size);
+    } else if (request_id >= 0) {
+        MasterSerial.print(request_id);
+        MasterSerial.print(':');
+        MasterSerial.println(running ? '1' : '0');
+    } else {
+        MasterSerial.print(running ? '1' : '0');
+    }
 }
 
 void startOutputCommand(int motor_pins, int cmd_max_time_ms, int cmd_threshold)
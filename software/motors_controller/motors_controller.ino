@@ -3,6 +3,9 @@
 
 #include <SoftwareSerial.h>
 
+#include "command_buffer.h"
+#include "motors_protocol.h"
+
 const int MOTOR_PINS_COUNT = 8;
 
 // Motor pins ordered by motors command bit (loweest bit at index 0)
@@ -29,6 +32,9 @@ int SOFT_TX_PIN = 8;
 
 SoftwareSerial MasterSerial(SOFT_RX_PIN, SOFT_TX_PIN);
 
+// Binary frames received from the master
+motors_frame_decoder_t master_decoder = {};
+
 void setup()
 {
     MasterSerial.begin(19200);
@@ -48,20 +54,46 @@ void setup()
 
 void loop()
 {
-    String commands = "";
     if (Serial.available() > 0) {
-        commands = Serial.readStringUntil('\n');
+        runTextCommands(Serial.readStringUntil('\n'));
     } else if (MasterSerial.available() > 0) {
-        commands = MasterSerial.readStringUntil('\n');
+        // Binary frames start with SYNC byte, anything else is a text command line
+        if (MasterSerial.peek() == MOTORS_PROTOCOL_SYNC || motors_protocol_is_decoding(master_decoder)) {
+            receiveFrameBytes();
+        } else {
+            runTextCommands(MasterSerial.readStringUntil('\n'));
+        }
     }
+
+    // Start/update/terminate commands depending on command buffer and current command state
+    run();
+}
+
+void runTextCommands(String commands)
+{
     if (commands.length() > 0) {
         Serial.print("parse commands: ");
         Serial.println(commands);
         parseAndRunCommands(commands);
     }
+}
 
-    // Start/update/terminate commands depending on command buffer and current command state
-    run();
+// Decode all the received bytes of the current frame
+// (the loop can be slowed down by running commands, so bytes are not read one per loop)
+void receiveFrameBytes()
+{
+    while (MasterSerial.available() > 0) {
+        motors_frame_t frame;
+        motors_decode_result_t result = motors_protocol_decode(master_decoder, MasterSerial.read(), frame);
+        if (result == motors_decode_result_t::FRAME) {
+            runFrame(frame);
+            return;
+        }
+        if (result == motors_decode_result_t::INVALID) {
+            Serial.println("invalid frame ignored");
+            return;
+        }
+    }
 }
 
 void printRam()
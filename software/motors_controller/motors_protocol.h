@@ -0,0 +1,175 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+// ================= Binary protocol =================
+
+// Binary frames exchanged between the supervisor (ESP32) and the motors controller (arduino)
+// This file is shared by both sides and tested on host (see supervisor_controller/components/motors/tests_on_host)
+// so it must stay compatible with the arduino compiler : no dynamic allocation, no standard library
+//
+// Frame layout :
+//   SYNC | VERSION | opcode | request_id | payload (fixed size, depends on opcode) | CRC8
+// Multi-byte fields are little-endian, the CRC8 covers all bytes between SYNC and CRC8
+//
+// Text commands never start with SYNC byte, so both can be received on the same serial link
+
+#pragma once
+
+#include <stdint.h>
+
+static const uint8_t MOTORS_PROTOCOL_SYNC = 0xA5;
+static const uint8_t MOTORS_PROTOCOL_VERSION = 3;
+
+// Max number of steps of a MOVE frame
+static const int MOTORS_PROTOCOL_MAX_STEPS = 4;
+
+enum class motors_opcode_t : uint8_t {
+    STOP = 1,  // stop and clear all commands, then reply
+    MOVE = 2,  // replace all commands by a sequence of steps, reply when motors stop (after the last step)
+    STATE = 3, // reply immediately
+    REPLY = 4, // (from motors controller) reply to the request with the same id
+};
+
+// Decoded frame, only the fields of its opcode are meaningful
+struct motors_frame_t {
+    motors_opcode_t opcode;
+    uint8_t request_id; // 0 if no reply is expected
+    // MOVE :
+    uint8_t step_count;                              // 1 to MOTORS_PROTOCOL_MAX_STEPS
+    uint8_t motor_pins[MOTORS_PROTOCOL_MAX_STEPS];   // bit mask of the motors pins to set, for each step
+    uint16_t max_times_ms[MOTORS_PROTOCOL_MAX_STEPS]; // max time of each step (at most 32767)
+    uint16_t threshold;                              // measured current (0 to 1023) where a step must be stopped
+    // REPLY :
+    uint8_t running; // 1 if motors are running, 0 otherwise
+};
+
+static const int MOTORS_PROTOCOL_HEADER_SIZE = 4;
+static const int MOTORS_PROTOCOL_MAX_PAYLOAD_SIZE = 1 + 3 * MOTORS_PROTOCOL_MAX_STEPS + 2;
+static const int MOTORS_PROTOCOL_MAX_FRAME_SIZE = MOTORS_PROTOCOL_HEADER_SIZE + MOTORS_PROTOCOL_MAX_PAYLOAD_SIZE + 1;
+
+// Return the payload size of the opcode, or -1 if the opcode is unknown
+inline int motors_protocol_get_payload_size(uint8_t opcode)
+{
+    switch (static_cast<motors_opcode_t>(opcode)) {
+    case motors_opcode_t::STOP:
+    case motors_opcode_t::STATE:
+        return 0;
+    case motors_opcode_t::MOVE:
+        return MOTORS_PROTOCOL_MAX_PAYLOAD_SIZE;
+    case motors_opcode_t::REPLY:
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+// CRC-8, polynomial 0x07, initial value 0
+inline uint8_t motors_protocol_crc8(const uint8_t *data, int len)
+{
+    uint8_t crc = 0;
+    for (int i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Write the frame in 'buffer', return its size or 0 if the buffer is too small or the opcode unknown
+inline int motors_protocol_encode(const motors_frame_t &frame, uint8_t *buffer, int buffer_size)
+{
+    int payload_size = motors_protocol_get_payload_size(static_cast<uint8_t>(frame.opcode));
+    int size = MOTORS_PROTOCOL_HEADER_SIZE + payload_size + 1;
+    if (payload_size < 0 || size > buffer_size) {
+        return 0;
+    }
+    buffer[0] = MOTORS_PROTOCOL_SYNC;
+    buffer[1] = MOTORS_PROTOCOL_VERSION;
+    buffer[2] = static_cast<uint8_t>(frame.opcode);
+    buffer[3] = frame.request_id;
+    uint8_t *payload = buffer + MOTORS_PROTOCOL_HEADER_SIZE;
+    if (frame.opcode == motors_opcode_t::MOVE) {
+        // (unused steps are sent too, so the payload size is fixed)
+        payload[0] = frame.step_count;
+        uint8_t *times = payload + 1 + MOTORS_PROTOCOL_MAX_STEPS;
+        for (int i = 0; i < MOTORS_PROTOCOL_MAX_STEPS; i++) {
+            payload[1 + i] = frame.motor_pins[i];
+            times[2 * i] = (uint8_t)(frame.max_times_ms[i] & 0xFF);
+            times[2 * i + 1] = (uint8_t)(frame.max_times_ms[i] >> 8);
+        }
+        uint8_t *threshold = times + 2 * MOTORS_PROTOCOL_MAX_STEPS;
+        threshold[0] = (uint8_t)(frame.threshold & 0xFF);
+        threshold[1] = (uint8_t)(frame.threshold >> 8);
+    } else if (frame.opcode == motors_opcode_t::REPLY) {
+        payload[0] = frame.running;
+    }
+    buffer[size - 1] = motors_protocol_crc8(buffer + 1, size - 2);
+    return size;
+}
+
+enum class motors_decode_result_t : uint8_t {
+    INCOMPLETE = 0, // waiting for more bytes
+    FRAME,          // a valid frame is decoded
+    INVALID,        // the bytes received since SYNC are not a valid frame, they are dropped
+};
+
+// Incremental decoder, bytes can be received in any number of chunks
+// Bytes received outside of a frame (before SYNC) are ignored
+struct motors_frame_decoder_t {
+    uint8_t buffer[MOTORS_PROTOCOL_MAX_FRAME_SIZE];
+    int len; // 0 if waiting for SYNC
+};
+
+inline bool motors_protocol_is_decoding(const motors_frame_decoder_t &decoder) { return decoder.len > 0; }
+
+inline motors_decode_result_t
+motors_protocol_decode(motors_frame_decoder_t &decoder, uint8_t byte, motors_frame_t &frame)
+{
+    if (decoder.len == 0 && byte != MOTORS_PROTOCOL_SYNC) {
+        return motors_decode_result_t::INCOMPLETE;
+    }
+    decoder.buffer[decoder.len++] = byte;
+
+    if (decoder.len == 2 && byte != MOTORS_PROTOCOL_VERSION) {
+        decoder.len = 0;
+        return motors_decode_result_t::INVALID;
+    }
+    if (decoder.len <= 3) {
+        if (decoder.len == 3 && motors_protocol_get_payload_size(byte) < 0) {
+            decoder.len = 0;
+            return motors_decode_result_t::INVALID;
+        }
+        return motors_decode_result_t::INCOMPLETE;
+    }
+
+    int size = MOTORS_PROTOCOL_HEADER_SIZE + motors_protocol_get_payload_size(decoder.buffer[2]) + 1;
+    if (decoder.len < size) {
+        return motors_decode_result_t::INCOMPLETE;
+    }
+    decoder.len = 0;
+    if (motors_protocol_crc8(decoder.buffer + 1, size - 2) != decoder.buffer[size - 1]) {
+        return motors_decode_result_t::INVALID;
+    }
+
+    const uint8_t *payload = decoder.buffer + MOTORS_PROTOCOL_HEADER_SIZE;
+    frame = motors_frame_t{};
+    frame.opcode = static_cast<motors_opcode_t>(decoder.buffer[2]);
+    frame.request_id = decoder.buffer[3];
+    if (frame.opcode == motors_opcode_t::MOVE) {
+        frame.step_count = payload[0];
+        if (frame.step_count < 1 || frame.step_count > MOTORS_PROTOCOL_MAX_STEPS) {
+            return motors_decode_result_t::INVALID;
+        }
+        const uint8_t *times = payload + 1 + MOTORS_PROTOCOL_MAX_STEPS;
+        for (int i = 0; i < MOTORS_PROTOCOL_MAX_STEPS; i++) {
+            frame.motor_pins[i] = payload[1 + i];
+            frame.max_times_ms[i] = (uint16_t)(times[2 * i] | (times[2 * i + 1] << 8));
+        }
+        const uint8_t *threshold = times + 2 * MOTORS_PROTOCOL_MAX_STEPS;
+        frame.threshold = (uint16_t)(threshold[0] | (threshold[1] << 8));
+    } else if (frame.opcode == motors_opcode_t::REPLY) {
+        frame.running = payload[0];
+    }
+    return motors_decode_result_t::FRAME;
+}
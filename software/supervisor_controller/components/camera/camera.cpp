@@ -8,8 +8,12 @@
 #include "freertos/task.h"
 
 #include "esp_camera.h"
+#include "esp_timer.h"
 
 #include "image_conversion.hpp"
+#include "metrics.hpp"
+
+#include <atomic>
 
 using namespace cimg_library;
 
@@ -39,6 +43,59 @@ static const char *TAG = "camera";
 
 #define XCLK_FREQ_HZ 15000000
 
+// Frame buffers : one held by the consumer, one waiting in the queue, one being captured by the driver
+#define CAMERA_FB_COUNT 3
+
+// The capture task keeps only the newest frame in this queue, older ones are given back to the driver
+static const int FRAME_QUEUE_LENGTH = 1;
+static QueueHandle_t frame_queue = NULL;
+
+// The capture task only moves frame pointers, but it logs capture errors
+static const int CAPTURE_TASK_STACK_SIZE = 3 * 1024;
+
+static const int CAPTURE_TIMEOUT_MS = 2000;
+static const int CAPTURE_RETRY_DELAY_MS = 100;
+
+// Period between the two last captured frames, measured by the capture task
+// (the initial value is a conservative guess, used until two frames have been captured)
+static const int64_t INITIAL_FRAME_PERIOD_US = 200 * 1000;
+static std::atomic<int64_t> frame_period_us = INITIAL_FRAME_PERIOD_US;
+
+int64_t camera_get_time_us() { return esp_timer_get_time(); }
+
+static int64_t get_timestamp_us(const camera_fb_t *fb)
+{
+    return (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+// Continuously capture frames and keep only the newest one in frame_queue
+static void camera_capture_task(void *arg)
+{
+    int64_t previous_timestamp_us = 0;
+    while (true) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (fb == NULL) {
+            ESP_LOGE(TAG, "esp_camera_fb_get failed");
+            vTaskDelay(pdMS_TO_TICKS(CAPTURE_RETRY_DELAY_MS));
+            continue;
+        }
+
+        int64_t timestamp_us = get_timestamp_us(fb);
+        if (previous_timestamp_us != 0) {
+            frame_period_us = timestamp_us - previous_timestamp_us;
+        }
+        previous_timestamp_us = timestamp_us;
+
+        // Give back the older frame if it has not been consumed yet
+        // (this task is the only producer so the queue cannot be full after that)
+        camera_fb_t *older_fb;
+        if (xQueueReceive(frame_queue, &older_fb, 0) == pdTRUE) {
+            esp_camera_fb_return(older_fb);
+        }
+        xQueueSend(frame_queue, &fb, 0);
+    }
+}
+
 void camera_init()
 {
     camera_config_t config;
@@ -64,9 +121,9 @@ void camera_init()
     config.pixel_format = CAMERA_PIXEL_FORMAT;
     config.frame_size = FRAMESIZE_SVGA;
     config.jpeg_quality = 12;
-    config.fb_count = 1;
+    config.fb_count = CAMERA_FB_COUNT;
     config.fb_location = CAMERA_FB_IN_PSRAM;
-    config.grab_mode = CAMERA_GRAB_LATEST; // (no effect when fb_count==1)
+    config.grab_mode = CAMERA_GRAB_LATEST;
 
     // camera init
     esp_err_t err = esp_camera_init(&config);
@@ -119,36 +176,52 @@ void camera_init()
     s->set_raw_gma(s, false);    // no effect
     s->set_special_effect(s, 0); // not used
     s->set_wb_mode(s, 0);        // not used
+
+    frame_queue = xQueueCreate(FRAME_QUEUE_LENGTH, sizeof(camera_fb_t *));
+    xTaskCreate(camera_capture_task, "camera_capture", CAPTURE_TASK_STACK_SIZE, NULL, 5, NULL);
 }
 
-bool camera_capture(bool drop_current_image, CImg<unsigned char> &grayscale_cimg)
+bool camera_capture(int64_t min_timestamp_us, camera_frame_t &frame)
 {
-    assert(grayscale_cimg.width() == CAMERA_WIDTH);
-    assert(grayscale_cimg.height() == CAMERA_HEIGHT);
-    assert(grayscale_cimg.depth() == 1);
-    assert(grayscale_cimg.spectrum() == 1);
-
-    if (drop_current_image) {
-        // 'esp_camera_fb_get' returns the image which is currently captured
-        // Drop the currently grabed image to guarantee that a new image is
-        // taken after the call to this function
-        camera_fb_t *frame = esp_camera_fb_get();
-        if (frame == NULL) {
-            ESP_LOGE(TAG, "esp_camera_fb_get failed");
-            return false;
-        }
-        esp_camera_fb_return(frame);
-    }
+    // Give back the previous frame first, the driver may need it to capture the new one
+    frame.release();
 
-    camera_fb_t *frame = esp_camera_fb_get();
-    if (frame == NULL) {
-        ESP_LOGE(TAG, "esp_camera_fb_get failed");
+    if (frame_queue == NULL) {
+        ESP_LOGE(TAG, "camera not initialized");
         return false;
     }
 
-    grayscale_frame_to_grayscale_cimg(frame, grayscale_cimg);
+    metrics_scoped_timer_t timer(metrics_stage_t::CAPTURE);
 
-    esp_camera_fb_return(frame);
+    // Frame timestamp is taken at the VSYNC starting its readout, so the frame has been exposed before it :
+    // a frame is entirely exposed after 'min_timestamp_us' only if it starts one frame period later
+    int64_t min_frame_timestamp_us = min_timestamp_us == 0 ? 0 : min_timestamp_us + frame_period_us;
 
-    return true;
+    int64_t timeout_us = camera_get_time_us() + CAPTURE_TIMEOUT_MS * 1000;
+    while (true) {
+        camera_fb_t *fb;
+        if (xQueueReceive(frame_queue, &fb, pdMS_TO_TICKS(CAPTURE_TIMEOUT_MS)) != pdTRUE) {
+            ESP_LOGE(TAG, "no frame captured");
+            return false;
+        }
+
+        int64_t timestamp_us = get_timestamp_us(fb);
+        if (timestamp_us >= min_frame_timestamp_us) {
+            assert(fb->format == PIXFORMAT_GRAYSCALE);
+            assert(fb->width == CAMERA_WIDTH);
+            assert(fb->height == CAMERA_HEIGHT);
+
+            // Grayscale frame buffer has the same pixel ordering as a grayscale CImg :
+            // it's directly shared, it will be given back to the driver when the frame is released
+            frame.assign(fb->buf, fb->width, fb->height, timestamp_us, [fb]() { esp_camera_fb_return(fb); });
+            return true;
+        }
+
+        // Frame captured too early : give it back and wait for the next one
+        esp_camera_fb_return(fb);
+        if (camera_get_time_us() > timeout_us) {
+            ESP_LOGE(TAG, "no frame captured after %lld us", min_timestamp_us);
+            return false;
+        }
+    }
 }
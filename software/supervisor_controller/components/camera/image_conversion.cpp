@@ -3,7 +3,176 @@
 
 #include "image_conversion.hpp"
 
-#include "esp_log.h"
+#include "esp_log.h" // replaced by stub/esp_log.h for tests on host
+
+#include <assert.h>
+#include <string.h>
+
+// All conversions are done row by row with direct pointer access :
+// - CImg is planar (one plane per color channel), so a row of a given channel is contiguous in memory
+// - camera frames are interleaved, a row is contiguous in memory
+//
+// Row kernels process 4 pixels at once with SWAR (SIMD Within A Register) on 32 bits words,
+// then the remaining pixels with a scalar loop.
+// SWAR bodies rely on little-endian byte ordering (true for ESP32 and common hosts),
+// only the scalar loops are used otherwise.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define IMAGE_CONVERSION_USE_SWAR 1
+#else
+#define IMAGE_CONVERSION_USE_SWAR 0
+#endif
+
+// Luma weights in 8 bits fixed point (sum of weights must be 256 so white stays white)
+// BT.709 (used for quirc grayscale)
+static const uint32_t LUMA_709_R = 54;  // 0.2126
+static const uint32_t LUMA_709_G = 183; // 0.7152
+static const uint32_t LUMA_709_B = 19;  // 0.0722
+
+// (memcpy is the portable way to do unaligned word access, it's optimized by compiler)
+static inline uint32_t load_u32(const void *src)
+{
+    uint32_t v;
+    memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+static inline void store_u32(void *dst, uint32_t v) { memcpy(dst, &v, sizeof(v)); }
+
+// Pack the two 8 bits values stored in the low bytes of the 16 bits lanes into the two low bytes
+static inline uint32_t pack_lanes(uint32_t lanes) { return (lanes & 0xFF) | ((lanes >> 8) & 0xFF00); }
+
+// Spread the two low bytes of the given word into the low bytes of the two 16 bits lanes
+static inline uint32_t spread_lanes(uint32_t bytes) { return (bytes & 0xFF) | ((bytes & 0xFF00) << 8); }
+
+// rgb565 format is deduced from esp-who/components/esp-dl/include/image/dl_image.hpp
+// (these functions work on a single pixel, or on two pixels in the two 16 bits lanes of a word)
+static inline uint32_t rgb565_red(uint32_t rgb565) { return rgb565 & 0x00F800F8; }
+static inline uint32_t rgb565_green(uint32_t rgb565)
+{
+    return ((rgb565 & 0x00070007) << 5) | ((rgb565 & 0xE000E000) >> 11);
+}
+static inline uint32_t rgb565_blue(uint32_t rgb565) { return (rgb565 & 0x1F001F00) >> 5; }
+static inline uint32_t to_rgb565(uint32_t r, uint32_t g, uint32_t b)
+{
+    return (r & 0x00F800F8) | ((g & 0x00E000E0) >> 5) | ((g & 0x001C001C) << 11) | ((b & 0x00F800F8) << 5);
+}
+
+// Compute luma in each 8 bits lane (4 pixels at once)
+// Lanes are split into odd and even bytes so each product has 16 bits available (255 * 256 < 65536)
+static inline uint32_t luma_4_pixels(uint32_t r, uint32_t g, uint32_t b, uint32_t wr, uint32_t wg, uint32_t wb)
+{
+    uint32_t even = (r & 0x00FF00FF) * wr + (g & 0x00FF00FF) * wg + (b & 0x00FF00FF) * wb;
+    uint32_t odd = ((r >> 8) & 0x00FF00FF) * wr + ((g >> 8) & 0x00FF00FF) * wg + ((b >> 8) & 0x00FF00FF) * wb;
+    return ((even >> 8) & 0x00FF00FF) | (odd & 0xFF00FF00);
+}
+
+static void rgb565_row_to_rgb888_planes(const uint16_t *input, uint8_t *r, uint8_t *g, uint8_t *b, int width)
+{
+    int x = 0;
+#if IMAGE_CONVERSION_USE_SWAR
+    for (; x + 4 <= width; x += 4) {
+        uint32_t p01 = load_u32(input + x);
+        uint32_t p23 = load_u32(input + x + 2);
+        store_u32(r + x, pack_lanes(rgb565_red(p01)) | (pack_lanes(rgb565_red(p23)) << 16));
+        store_u32(g + x, pack_lanes(rgb565_green(p01)) | (pack_lanes(rgb565_green(p23)) << 16));
+        store_u32(b + x, pack_lanes(rgb565_blue(p01)) | (pack_lanes(rgb565_blue(p23)) << 16));
+    }
+#endif
+    for (; x < width; x++) {
+        uint32_t p = input[x];
+        r[x] = (uint8_t)rgb565_red(p);
+        g[x] = (uint8_t)rgb565_green(p);
+        b[x] = (uint8_t)rgb565_blue(p);
+    }
+}
+
+// Note : also write the gray value back in the 3 input planes
+static void rgb888_planes_to_grayscale(uint8_t *r, uint8_t *g, uint8_t *b, uint8_t *output, int width)
+{
+    int x = 0;
+#if IMAGE_CONVERSION_USE_SWAR
+    for (; x + 4 <= width; x += 4) {
+        uint32_t gray =
+            luma_4_pixels(load_u32(r + x), load_u32(g + x), load_u32(b + x), LUMA_709_R, LUMA_709_G, LUMA_709_B);
+        store_u32(output + x, gray);
+        store_u32(r + x, gray);
+        store_u32(g + x, gray);
+        store_u32(b + x, gray);
+    }
+#endif
+    for (; x < width; x++) {
+        uint8_t gray = (uint8_t)((r[x] * LUMA_709_R + g[x] * LUMA_709_G + b[x] * LUMA_709_B) >> 8);
+        output[x] = gray;
+        r[x] = gray;
+        g[x] = gray;
+        b[x] = gray;
+    }
+}
+
+static void
+rgb888_planes_to_rgb565_row(const uint8_t *r, const uint8_t *g, const uint8_t *b, uint16_t *output, int width)
+{
+    int x = 0;
+#if IMAGE_CONVERSION_USE_SWAR
+    for (; x + 4 <= width; x += 4) {
+        uint32_t r4 = load_u32(r + x);
+        uint32_t g4 = load_u32(g + x);
+        uint32_t b4 = load_u32(b + x);
+        store_u32(output + x, to_rgb565(spread_lanes(r4), spread_lanes(g4), spread_lanes(b4)));
+        store_u32(output + x + 2, to_rgb565(spread_lanes(r4 >> 16), spread_lanes(g4 >> 16), spread_lanes(b4 >> 16)));
+    }
+#endif
+    for (; x < width; x++) {
+        output[x] = (uint16_t)to_rgb565(r[x], g[x], b[x]);
+    }
+}
+
+// Sum the two pairs of adjacent bytes of a word into its two 16 bits lanes
+static inline uint32_t sum_byte_pairs(uint32_t bytes) { return (bytes & 0x00FF00FF) + ((bytes >> 8) & 0x00FF00FF); }
+
+// Average each 2x2 block of the two given rows
+static void grayscale_rows_downscale_2(const uint8_t *row0, const uint8_t *row1, uint8_t *output, int output_width)
+{
+    int x = 0;
+#if IMAGE_CONVERSION_USE_SWAR
+    for (; x + 4 <= output_width; x += 4) {
+        // Each lane sums 4 pixels (at most 1020), so it can't overflow on next lane
+        uint32_t sums01 = sum_byte_pairs(load_u32(row0 + 2 * x)) + sum_byte_pairs(load_u32(row1 + 2 * x));
+        uint32_t sums23 = sum_byte_pairs(load_u32(row0 + 2 * x + 4)) + sum_byte_pairs(load_u32(row1 + 2 * x + 4));
+        uint32_t avg01 = (sums01 + 0x00020002) >> 2;
+        uint32_t avg23 = (sums23 + 0x00020002) >> 2;
+        store_u32(output + x, pack_lanes(avg01 & 0x00FF00FF) | (pack_lanes(avg23 & 0x00FF00FF) << 16));
+    }
+#endif
+    for (; x < output_width; x++) {
+        output[x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+    }
+}
+
+// Average each 4x4 block of the four rows starting at 'row' ('stride' bytes between rows)
+static void grayscale_rows_downscale_4(const uint8_t *row, int stride, uint8_t *output, int output_width)
+{
+    int x = 0;
+#if IMAGE_CONVERSION_USE_SWAR
+    for (; x < output_width; x++) {
+        // Each lane sums 8 pixels (at most 2040)
+        uint32_t sums = 0;
+        for (int dy = 0; dy < 4; dy++) {
+            sums += sum_byte_pairs(load_u32(row + dy * stride + 4 * x));
+        }
+        output[x] = ((sums & 0xFFFF) + (sums >> 16) + 8) >> 4;
+    }
+#endif
+    for (; x < output_width; x++) {
+        int sum = 0;
+        for (int dy = 0; dy < 4; dy++) {
+            for (int dx = 0; dx < 4; dx++) {
+                sum += row[dy * stride + 4 * x + dx];
+            }
+        }
+        output[x] = (sum + 8) >> 4;
+    }
+}
 
 // output_buffer must be allocated by the caller
 camera_fb_t grayscale_cimg_to_grayscale_frame(CImg<unsigned char> &input, uint8_t *output_buffer)
@@ -20,91 +189,129 @@ camera_fb_t grayscale_cimg_to_grayscale_frame(CImg<unsigned char> &input, uint8_
                            .tv_sec = 0,
                            .tv_usec = 0,
                        }};
-    int i = 0;
-    for (int y = 0; y < input.height(); y++) {
-        for (int x = 0; x < input.width(); x++) {
-            uint8_t gray = *input.data(x, y, 0);
-            output.buf[i++] = gray;
-        }
-    }
+    // Grayscale CImg and grayscale frame have the same pixel ordering
+    memcpy(output.buf, input.data(), output.len);
     return output;
 }
 
+camera_fb_t grayscale_cimg_as_grayscale_frame(CImg<unsigned char> &input)
+{
+    assert(input.depth() == 1);
+    assert(input.spectrum() == 1);
+    return camera_fb_t{.buf = input.data(),
+                       .len = (size_t)(input.width() * input.height()),
+                       .width = (size_t)input.width(),
+                       .height = (size_t)input.height(),
+                       .format = PIXFORMAT_GRAYSCALE,
+                       .timestamp = {
+                           .tv_sec = 0,
+                           .tv_usec = 0,
+                       }};
+}
+
 void rgb565_frame_to_rgb888_cimg(camera_fb_t *input, CImg<unsigned char> &output)
 {
     assert(input->format == PIXFORMAT_RGB565);
-    assert(output.width() == input->width);
-    assert(output.height() == input->height);
+    assert((size_t)output.width() == input->width);
+    assert((size_t)output.height() == input->height);
     assert(output.depth() == 1);
     assert(output.spectrum() == 3);
-    int i = 0;
-    for (int y = 0; y < input->height; y++) {
-        for (int x = 0; x < input->width; x++) {
-            // format is deduced from esp-who/components/esp-dl/include/image/dl_image.hpp
-            uint16_t rgb565 = ((uint16_t *)input->buf)[i++];
-            uint8_t b = (uint8_t)((rgb565 & 0x1F00) >> 5);
-            uint8_t g = (uint8_t)(((rgb565 & 0x7) << 5) | ((rgb565 & 0xE000) >> 11));
-            uint8_t r = (uint8_t)(rgb565 & 0xF8);
-            *output.data(x, y, 0, 0) = r;
-            *output.data(x, y, 0, 1) = g;
-            *output.data(x, y, 0, 2) = b;
-        }
+    const uint16_t *input_pixels = (const uint16_t *)input->buf;
+    for (int y = 0; y < output.height(); y++) {
+        rgb565_row_to_rgb888_planes(input_pixels + y * output.width(),
+                                    output.data(0, y, 0, 0),
+                                    output.data(0, y, 0, 1),
+                                    output.data(0, y, 0, 2),
+                                    output.width());
     }
 }
 
 void grayscale_frame_to_grayscale_cimg(camera_fb_t *input, CImg<unsigned char> &output)
 {
     assert(input->format == PIXFORMAT_GRAYSCALE);
-    assert(output.width() == input->width);
-    assert(output.height() == input->height);
+    assert((size_t)output.width() == input->width);
+    assert((size_t)output.height() == input->height);
     assert(output.depth() == 1);
     assert(output.spectrum() == 1);
-    // TODO? memcpy (seems to be the same pixel ordering)
-    int i = 0;
-    for (int y = 0; y < input->height; y++) {
-        for (int x = 0; x < input->width; x++) {
-            *output.data(x, y, 0) = input->buf[i++];
-        }
-    }
+    // Grayscale CImg and grayscale frame have the same pixel ordering
+    memcpy(output.data(), input->buf, input->width * input->height);
 }
 
 void rgb888_cimg_to_grayscale_quirc(CImg<unsigned char> &input, uint8_t *output)
 {
-    int i = 0;
+    assert(input.depth() == 1);
+    assert(input.spectrum() == 3);
     for (int y = 0; y < input.height(); y++) {
-        for (int x = 0; x < input.width(); x++) {
-            float r = (float)(*input.data(x, y, 0, 0));
-            float g = (float)(*input.data(x, y, 0, 1));
-            float b = (float)(*input.data(x, y, 0, 2));
-            uint8_t gray = (uint8_t)((0.2126 * r) + (0.7152 * g) + (0.0722 * b));
-            output[i++] = gray;
-
-            // Temp : change input to grayscale
-            *input.data(x, y, 0, 0) = gray;
-            *input.data(x, y, 0, 1) = gray;
-            *input.data(x, y, 0, 2) = gray;
-        }
+        // Temp : change input to grayscale
+        rgb888_planes_to_grayscale(input.data(0, y, 0, 0),
+                                   input.data(0, y, 0, 1),
+                                   input.data(0, y, 0, 2),
+                                   output + y * input.width(),
+                                   input.width());
     }
 }
 
-// TODO : idem grayscale_cimg_to_grayscale_frame
 void rgb888_cimg_to_rgb565_frame(CImg<unsigned char> &input, camera_fb_t *output)
 {
+    assert(input.depth() == 1);
+    assert(input.spectrum() == 3);
     output->len = 2 * input.width() * input.height();
     output->width = input.width();
     output->height = input.height();
-    output->format = PIXFORMAT_GRAYSCALE;
+    output->format = PIXFORMAT_RGB565;
     output->timestamp.tv_sec = 0;
     output->timestamp.tv_usec = 0;
 
-    int i = 0;
+    uint16_t *output_pixels = (uint16_t *)output->buf;
     for (int y = 0; y < input.height(); y++) {
-        for (int x = 0; x < input.width(); x++) {
-            uint8_t r = *input.data(x, y, 0, 0);
-            uint16_t g = (uint16_t)(*input.data(x, y, 0, 1));
-            uint16_t b = (uint16_t)(*input.data(x, y, 0, 2));
-            uint16_t rgb565 = (r & 0xf8) | ((g & 0xe0) >> 5) | ((g & 0x1c) << 11) | ((b & 0xf8) << 5);
-            ((uint16_t *)output->buf)[i++] = rgb565;
+        rgb888_planes_to_rgb565_row(input.data(0, y, 0, 0),
+                                    input.data(0, y, 0, 1),
+                                    input.data(0, y, 0, 2),
+                                    output_pixels + y * input.width(),
+                                    input.width());
+    }
+}
+
+camera_fb_t grayscale_frame_downscale(const camera_fb_t *input, int factor, uint8_t *output_buffer)
+{
+    assert(input->format == PIXFORMAT_GRAYSCALE);
+    assert(factor == 2 || factor == 4);
+    assert(output_buffer != NULL);
+    int output_width = input->width / factor;
+    int output_height = input->height / factor;
+    for (int y = 0; y < output_height; y++) {
+        const uint8_t *row = input->buf + y * factor * input->width;
+        uint8_t *output_row = output_buffer + y * output_width;
+        if (factor == 2) {
+            grayscale_rows_downscale_2(row, row + input->width, output_row, output_width);
+        } else {
+            grayscale_rows_downscale_4(row, input->width, output_row, output_width);
         }
     }
+    return camera_fb_t{.buf = output_buffer,
+                       .len = (size_t)(output_width * output_height),
+                       .width = (size_t)output_width,
+                       .height = (size_t)output_height,
+                       .format = PIXFORMAT_GRAYSCALE,
+                       .timestamp = input->timestamp};
+}
+
+camera_fb_t grayscale_frame_crop(const camera_fb_t *input, const rectangle_t &area, uint8_t *output_buffer)
+{
+    assert(input->format == PIXFORMAT_GRAYSCALE);
+    assert(area.left_px >= 0 && area.right_px < (int)input->width);
+    assert(area.top_px >= 0 && area.bottom_px < (int)input->height);
+    assert(output_buffer != NULL);
+    int area_width = area.right_px - area.left_px + 1;
+    int area_height = area.bottom_px - area.top_px + 1;
+    for (int y = 0; y < area_height; y++) {
+        const uint8_t *input_row = input->buf + (area.top_px + y) * input->width + area.left_px;
+        memcpy(output_buffer + y * area_width, input_row, area_width);
+    }
+    return camera_fb_t{.buf = output_buffer,
+                       .len = (size_t)(area_width * area_height),
+                       .width = (size_t)area_width,
+                       .height = (size_t)area_height,
+                       .format = PIXFORMAT_GRAYSCALE,
+                       .timestamp = input->timestamp};
 }
@@ -2,16 +2,66 @@
 
 #include "image.hpp"
 
+#include <functional>
+#include <stdint.h>
+
 // Define constant image size and format so camera user components can pre-allocate memory
 // before camera initialization
 #define CAMERA_WIDTH 800
 #define CAMERA_HEIGHT 600
 
+// Image captured by the camera
+// 'image' is a shared CImg : it points directly to the camera frame buffer memory (no copy)
+// 'timestamp_us' is the capture time of the image (same clock as camera_get_time_us)
+// The frame buffer is given back to the camera driver when 'release' is called
+// or when this object is destroyed, 'image' must not be used after that
+class camera_frame_t {
+  public:
+    CImg<unsigned char> image;
+    int64_t timestamp_us = 0;
+
+    camera_frame_t() = default;
+    camera_frame_t(const camera_frame_t &) = delete;
+    camera_frame_t &operator=(const camera_frame_t &) = delete;
+    ~camera_frame_t() { release(); }
+
+    // Share the given grayscale buffer, 'return_buffer' will be called when the frame is released
+    void assign(unsigned char *buffer, int width, int height, int64_t timestamp_us, std::function<void()> return_buffer)
+    {
+        release();
+        image.assign(buffer, width, height, 1, 1, true);
+        this->timestamp_us = timestamp_us;
+        this->return_buffer = return_buffer;
+    }
+
+    void release()
+    {
+        image.assign();
+        timestamp_us = 0;
+        if (return_buffer) {
+            return_buffer();
+            return_buffer = nullptr;
+        }
+    }
+
+  private:
+    std::function<void()> return_buffer;
+};
+
+// Initialize the camera and start the capture task :
+// images are continuously captured in the background and only the newest one is kept,
+// so the sensor readout of the next image overlaps the processing of the current one
 void camera_init();
 
-// Take an image, fill the given image,
-// which must have been allocated by the caller to size CAMERA_WIDTH,CAMERA_HEIGHT
-// if drop_current_image : the currently grabed image will be dropped
-// before capturing a new image
+// return the current time, in the clock used for frame timestamps
+int64_t camera_get_time_us();
+
+// Give the newest captured image through the given frame, without copying the camera frame buffer
+// Images whose exposure may have started before 'min_timestamp_us' are dropped, waiting for a newer image if needed
+// (the frame timestamp is taken at the start of its readout, so it must be at least one frame period later)
+// (use 0 to get the newest image whatever its capture time)
+// The frame previously held by 'frame' (if any) is released first
+// The caller must release the frame as soon as possible because the camera driver
+// cannot capture new images in a frame buffer which is not released
 // return true if capture is successful
-bool camera_capture(bool drop_current_image, CImg<unsigned char> &grayscale_cimg);
+bool camera_capture(int64_t min_timestamp_us, camera_frame_t &frame);
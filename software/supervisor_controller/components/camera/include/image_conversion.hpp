@@ -10,6 +10,10 @@
 // output_buffer must be allocated by the caller
 camera_fb_t grayscale_cimg_to_grayscale_frame(CImg<unsigned char> &input, uint8_t *output_buffer);
 
+// Return a frame sharing input image memory (no copy)
+// the returned frame must not be used after input image is destroyed
+camera_fb_t grayscale_cimg_as_grayscale_frame(CImg<unsigned char> &input);
+
 void rgb565_frame_to_rgb888_cimg(camera_fb_t *input, CImg<unsigned char> &output);
 
 void grayscale_frame_to_grayscale_cimg(camera_fb_t *input, CImg<unsigned char> &output);
@@ -17,3 +21,12 @@ void grayscale_frame_to_grayscale_cimg(camera_fb_t *input, CImg<unsigned char> &
 void rgb888_cimg_to_grayscale_quirc(CImg<unsigned char> &input, uint8_t *output);
 
 void rgb888_cimg_to_rgb565_frame(CImg<unsigned char> &input, camera_fb_t *output);
+
+// Downscale a grayscale frame by 'factor' (2 or 4), each output pixel is the average of a factor x factor block
+// (last columns and rows are dropped if the size is not a multiple of factor)
+// output_buffer must be allocated by the caller with (width / factor) * (height / factor) bytes
+camera_fb_t grayscale_frame_downscale(const camera_fb_t *input, int factor, uint8_t *output_buffer);
+
+// Copy the given area (right_px and bottom_px included) of a grayscale frame
+// output_buffer must be allocated by the caller with (area width * area height) bytes
+camera_fb_t grayscale_frame_crop(const camera_fb_t *input, const rectangle_t &area, uint8_t *output_buffer);
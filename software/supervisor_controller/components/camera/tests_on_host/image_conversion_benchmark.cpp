@@ -0,0 +1,188 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+// Host benchmark of image conversion functions
+// Usage : image_conversion_benchmark [iterations]
+// - print the throughput of each conversion in MPix/s
+// - check each conversion result against a straightforward per-pixel conversion
+//   (return a non-zero code if any result differs)
+
+#include "image_conversion.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+static const int CAMERA_WIDTH = 800;
+static const int CAMERA_HEIGHT = 600;
+
+// Odd size to check the scalar tail of row kernels
+static const int ODD_WIDTH = 803;
+static const int ODD_HEIGHT = 3;
+
+static int errors = 0;
+
+static void check(bool condition, const char *conversion, int x, int y)
+{
+    if (!condition) {
+        printf("  \x1B[31mERROR: %s differs at (%i,%i)\033[0m\n", conversion, x, y);
+        errors++;
+    }
+}
+
+static void benchmark(const char *conversion, int iterations, int pixel_count, std::function<void()> convert)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        convert();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double mpix_per_s = (double)iterations * pixel_count / elapsed.count() / 1e6;
+    printf("%-34s %10.1f MPix/s\n", conversion, mpix_per_s);
+}
+
+static uint8_t reference_rgb565_red(uint16_t p) { return (uint8_t)(p & 0xF8); }
+static uint8_t reference_rgb565_green(uint16_t p) { return (uint8_t)(((p & 0x7) << 5) | ((p & 0xE000) >> 11)); }
+static uint8_t reference_rgb565_blue(uint16_t p) { return (uint8_t)((p & 0x1F00) >> 5); }
+
+static void run(int width, int height, int iterations)
+{
+    int pixel_count = width * height;
+    printf("Image %ix%i, %i iteration(s)\n", width, height, iterations);
+
+    std::vector<uint16_t> rgb565(pixel_count);
+    for (auto &p : rgb565) {
+        p = (uint16_t)rand();
+    }
+    camera_fb_t rgb565_frame{.buf = (uint8_t *)rgb565.data(),
+                             .len = (size_t)(2 * pixel_count),
+                             .width = (size_t)width,
+                             .height = (size_t)height,
+                             .format = PIXFORMAT_RGB565,
+                             .timestamp = {
+                                 .tv_sec = 0,
+                                 .tv_usec = 0,
+                             }};
+
+    // rgb565 frame -> rgb888 cimg
+    CImg<unsigned char> rgb888(width, height, 1, 3);
+    benchmark("rgb565_frame_to_rgb888_cimg", iterations, pixel_count, [&]() {
+        rgb565_frame_to_rgb888_cimg(&rgb565_frame, rgb888);
+    });
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint16_t p = rgb565[x + y * width];
+            check(rgb888(x, y, 0, 0) == reference_rgb565_red(p) && rgb888(x, y, 0, 1) == reference_rgb565_green(p)
+                      && rgb888(x, y, 0, 2) == reference_rgb565_blue(p),
+                  "rgb565_frame_to_rgb888_cimg",
+                  x,
+                  y);
+        }
+    }
+
+    // rgb888 cimg -> rgb565 frame
+    // (must be done before rgb888_cimg_to_grayscale_quirc which modifies the input image)
+    std::vector<uint16_t> rgb565_output(pixel_count);
+    camera_fb_t rgb565_output_frame{};
+    rgb565_output_frame.buf = (uint8_t *)rgb565_output.data();
+    benchmark("rgb888_cimg_to_rgb565_frame", iterations, pixel_count, [&]() {
+        rgb888_cimg_to_rgb565_frame(rgb888, &rgb565_output_frame);
+    });
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            // rgb565 -> rgb888 -> rgb565 must give the original value
+            check(rgb565_output[x + y * width] == rgb565[x + y * width], "rgb888_cimg_to_rgb565_frame", x, y);
+        }
+    }
+
+    // rgb888 cimg -> quirc grayscale
+    CImg<unsigned char> rgb888_copy(rgb888);
+    std::vector<uint8_t> quirc_gray(pixel_count);
+    benchmark("rgb888_cimg_to_grayscale_quirc", iterations, pixel_count, [&]() {
+        rgb888_copy = rgb888;
+        rgb888_cimg_to_grayscale_quirc(rgb888_copy, quirc_gray.data());
+    });
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int gray = (54 * rgb888(x, y, 0, 0) + 183 * rgb888(x, y, 0, 1) + 19 * rgb888(x, y, 0, 2)) >> 8;
+            check(quirc_gray[x + y * width] == gray && rgb888_copy(x, y, 0, 0) == gray
+                      && rgb888_copy(x, y, 0, 1) == gray && rgb888_copy(x, y, 0, 2) == gray,
+                  "rgb888_cimg_to_grayscale_quirc",
+                  x,
+                  y);
+        }
+    }
+
+    // grayscale cimg <-> grayscale frame
+    CImg<unsigned char> gray_img(quirc_gray.data(), width, height);
+    std::vector<uint8_t> gray_buffer(pixel_count);
+    camera_fb_t gray_frame{};
+    benchmark("grayscale_cimg_to_grayscale_frame", iterations, pixel_count, [&]() {
+        gray_frame = grayscale_cimg_to_grayscale_frame(gray_img, gray_buffer.data());
+    });
+    CImg<unsigned char> gray_img_output(width, height);
+    benchmark("grayscale_frame_to_grayscale_cimg", iterations, pixel_count, [&]() {
+        grayscale_frame_to_grayscale_cimg(&gray_frame, gray_img_output);
+    });
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            check(gray_buffer[x + y * width] == gray_img(x, y), "grayscale_cimg_to_grayscale_frame", x, y);
+            check(gray_img_output(x, y) == gray_img(x, y), "grayscale_frame_to_grayscale_cimg", x, y);
+        }
+    }
+
+    // grayscale frame -> downscaled grayscale frames (box filter)
+    for (int factor = 2; factor <= 4; factor *= 2) {
+        std::vector<uint8_t> downscaled(pixel_count);
+        camera_fb_t downscaled_frame{};
+        const char *conversion = factor == 2 ? "grayscale_frame_downscale (2x)" : "grayscale_frame_downscale (4x)";
+        benchmark(conversion, iterations, pixel_count, [&]() {
+            downscaled_frame = grayscale_frame_downscale(&gray_frame, factor, downscaled.data());
+        });
+        check(downscaled_frame.width == (size_t)(width / factor)
+                  && downscaled_frame.height == (size_t)(height / factor),
+              conversion,
+              -1,
+              -1);
+        for (int y = 0; y < height / factor; y++) {
+            for (int x = 0; x < width / factor; x++) {
+                int sum = 0;
+                for (int dy = 0; dy < factor; dy++) {
+                    for (int dx = 0; dx < factor; dx++) {
+                        sum += gray_img(x * factor + dx, y * factor + dy);
+                    }
+                }
+                int average = (sum + factor * factor / 2) / (factor * factor);
+                check(downscaled[x + y * (width / factor)] == average, conversion, x, y);
+            }
+        }
+    }
+
+    // grayscale frame -> cropped grayscale frame
+    rectangle_t crop_area{width / 4, height / 3, width / 2, height - 1};
+    int crop_width = crop_area.right_px - crop_area.left_px + 1;
+    std::vector<uint8_t> cropped(pixel_count);
+    benchmark("grayscale_frame_crop", iterations, pixel_count, [&]() {
+        grayscale_frame_crop(&gray_frame, crop_area, cropped.data());
+    });
+    for (int y = crop_area.top_px; y <= crop_area.bottom_px; y++) {
+        for (int x = crop_area.left_px; x <= crop_area.right_px; x++) {
+            check(cropped[(x - crop_area.left_px) + (y - crop_area.top_px) * crop_width] == gray_img(x, y),
+                  "grayscale_frame_crop",
+                  x,
+                  y);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 100;
+    srand(0);
+    run(CAMERA_WIDTH, CAMERA_HEIGHT, iterations);
+    run(ODD_WIDTH, ODD_HEIGHT, iterations);
+    printf("%i error(s)\n", errors);
+    return errors == 0 ? 0 : 1;
+}
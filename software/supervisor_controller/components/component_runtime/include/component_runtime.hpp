@@ -0,0 +1,90 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include "event_loop.hpp"
+#include "transition_inbox.hpp"
+#include "transition_queue.hpp"
+
+#include "esp_log.h"
+
+#include <atomic>
+#include <type_traits>
+
+// Runtime of the components wrapping a state machine (supervisor, sun_tracker, motors)
+// It provides thread safety to the state machine layer by :
+// - calling the state machine update from a dedicated task only (see event_loop)
+// - receiving transitions from any task in a lock-free inbox, waking up the task at each post
+//   (a single slot or a bounded queue, depending on the merge policy)
+// - publishing the current state atomically, so it can be read from any task
+template <typename State, typename Transition, typename Payload, merge_policy_t MERGE_POLICY>
+class component_runtime_t {
+  public:
+    // Update the state machine from 'state' with the given transition,
+    // 'next_delay_ms' is set to the delay before the next update (or EVENT_LOOP_WAIT_FOREVER_MS)
+    // It's always called from the component task
+    typedef State (*update_function)(State state, Transition transition, Payload payload, int &next_delay_ms);
+
+    component_runtime_t(const char *tag, State initial_state) : tag(tag), initial_state(initial_state)
+    {
+        state = initial_state;
+    }
+
+    // Create the component task, the first update is done from the initial state
+    void start(update_function update)
+    {
+        assert(state == initial_state);
+        this->update = update;
+        event_loop_start(loop, tag, run_update, this);
+    }
+
+    // Ask a transition, it's treated by the next update (see merge_policy_t if several are asked before)
+    // It can be called from any task (but not from an ISR)
+    void post(Transition transition, Payload payload = Payload())
+    {
+        Transition ignored = inbox.post(transition, payload);
+        if constexpr (MERGE_POLICY == merge_policy_t::QUEUE) {
+            if (ignored != static_cast<Transition>(0)) {
+                ESP_LOGE(tag, "Transition '%s' ignored because the transition queue is full", str(transition));
+            }
+        } else if (ignored != static_cast<Transition>(0)) {
+            ESP_LOGW(tag,
+                     "Old transition '%s' ignored because new transition '%s' is asked before the old transition "
+                     "processing",
+                     str(ignored),
+                     str(transition));
+        }
+        event_loop_wake(loop);
+    }
+
+    State get_state() const { return state; }
+
+  private:
+    typedef typename std::conditional<MERGE_POLICY == merge_policy_t::QUEUE,
+                                      transition_queue_t<Transition, Payload>,
+                                      transition_inbox_t<Transition, Payload, MERGE_POLICY>>::type inbox_t;
+
+    // Update once, even without transition (for the states polling something),
+    // then once per pending transition, in order, so none of them waits for the next wake up
+    static int run_update(void *arg)
+    {
+        auto runtime = (component_runtime_t *)arg;
+        Payload payload;
+        Transition transition = runtime->inbox.take(payload);
+        int next_delay_ms;
+        do {
+            next_delay_ms = EVENT_LOOP_WAIT_FOREVER_MS;
+            runtime->state = runtime->update(runtime->state, transition, payload, next_delay_ms);
+            transition = runtime->inbox.take(payload);
+        } while (transition != static_cast<Transition>(0));
+        return next_delay_ms;
+    }
+
+    const char *tag;
+    const State initial_state;
+    std::atomic<State> state;
+    inbox_t inbox;
+    update_function update = NULL;
+    event_loop_t loop = {};
+};
@@ -0,0 +1,71 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+#include <stdint.h>
+
+// How a transition is merged with the pending ones (not treated yet) in the inbox
+enum class merge_policy_t : char {
+    REPLACE,    // the new transition and its payload replace the pending ones
+    BITWISE_OR, // transitions are flags accumulated until the next update, the payload is replaced
+    QUEUE,      // transitions are queued with their payload and treated in order (see transition_queue_t)
+};
+
+// Payload of the components whose transitions don't need one
+enum class no_payload_t : char { NONE = 0 };
+
+// Single-slot inbox holding the transition asked to a component, until its next update
+// Any task can post, the component task takes the pending transition at each update
+// It's lock-free : the transition and its payload are packed in a single atomic word
+// (so both transition and payload must be enums with values in [0, 0xFFFF], NONE being 0)
+template <typename Transition, typename Payload, merge_policy_t MERGE_POLICY> class transition_inbox_t {
+    static_assert(MERGE_POLICY != merge_policy_t::QUEUE, "use transition_queue_t");
+
+  public:
+    // Return the replaced pending transition (NONE if there was none, or if it has been merged)
+    Transition post(Transition transition, Payload payload)
+    {
+        uint32_t new_word = pack(transition, payload);
+        uint32_t old_word = word.load(std::memory_order_relaxed);
+        uint32_t merged_word;
+        do {
+            merged_word = new_word;
+            if (MERGE_POLICY == merge_policy_t::BITWISE_OR) {
+                merged_word |= old_word & TRANSITION_MASK;
+            }
+        } while (!word.compare_exchange_weak(old_word, merged_word, std::memory_order_release));
+
+        if (MERGE_POLICY == merge_policy_t::REPLACE) {
+            return unpack_transition(old_word);
+        }
+        return static_cast<Transition>(0);
+    }
+
+    // Take the pending transition and its payload, the inbox is empty afterwards
+    Transition take(Payload &payload)
+    {
+        uint32_t old_word = word.exchange(0, std::memory_order_acquire);
+        payload = static_cast<Payload>(old_word >> PAYLOAD_SHIFT);
+        return unpack_transition(old_word);
+    }
+
+  private:
+    static const uint32_t TRANSITION_MASK = 0xFFFF;
+    static const int PAYLOAD_SHIFT = 16;
+
+    static uint32_t pack(Transition transition, Payload payload)
+    {
+        int transition_value = static_cast<int>(transition);
+        int payload_value = static_cast<int>(payload);
+        assert(transition_value >= 0 && transition_value <= (int)TRANSITION_MASK);
+        assert(payload_value >= 0 && payload_value <= (int)TRANSITION_MASK);
+        return (uint32_t)transition_value | ((uint32_t)payload_value << PAYLOAD_SHIFT);
+    }
+
+    static Transition unpack_transition(uint32_t packed) { return static_cast<Transition>(packed & TRANSITION_MASK); }
+
+    std::atomic<uint32_t> word{0};
+};
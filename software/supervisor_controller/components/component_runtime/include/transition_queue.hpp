@@ -0,0 +1,82 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Default capacity of a transition queue, transitions are treated as soon as they are posted,
+// so only a burst of transitions asked while the component is updating needs to be queued
+static const int TRANSITION_QUEUE_CAPACITY = 8;
+
+// Fixed-capacity queue holding the transitions asked to a component, with their payload, until its next update
+// Any task can post, the component task takes the transitions in the posting order
+// It's lock-free and never allocates : each cell has a sequence number telling if it's free for the writer
+// of a given position, or filled for the reader (multiple producers / single consumer bounded queue)
+template <typename Transition, typename Payload, int CAPACITY = TRANSITION_QUEUE_CAPACITY> class transition_queue_t {
+    // (positions are wrapping counters, so they must stay consistent modulo the capacity)
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+  public:
+    transition_queue_t()
+    {
+        for (int i = 0; i < CAPACITY; i++) {
+            cells[i].seq = i;
+        }
+    }
+
+    // Return the given transition if it has been dropped because the queue is full, NONE otherwise
+    Transition post(Transition transition, Payload payload)
+    {
+        uint32_t pos = write_pos.load(std::memory_order_relaxed);
+        cell_t *cell;
+        while (true) {
+            cell = &cells[pos % CAPACITY];
+            int32_t diff = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                // The cell is free for this position, reserve it
+                if (write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // The cell still holds the transition posted one round before, not taken yet
+                return transition;
+            } else {
+                // Another writer reserved this position
+                pos = write_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->transition = transition;
+        cell->payload = payload;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return static_cast<Transition>(0);
+    }
+
+    // Take the oldest transition and its payload, return NONE if the queue is empty
+    Transition take(Payload &payload)
+    {
+        cell_t &cell = cells[read_pos % CAPACITY];
+        if (cell.seq.load(std::memory_order_acquire) != read_pos + 1) {
+            payload = Payload();
+            return static_cast<Transition>(0);
+        }
+        Transition transition = cell.transition;
+        payload = cell.payload;
+        // Free the cell for the writer of the next round
+        cell.seq.store(read_pos + CAPACITY, std::memory_order_release);
+        read_pos++;
+        return transition;
+    }
+
+  private:
+    struct cell_t {
+        std::atomic<uint32_t> seq;
+        Transition transition;
+        Payload payload;
+    };
+
+    cell_t cells[CAPACITY];
+    std::atomic<uint32_t> write_pos{0};
+    uint32_t read_pos = 0; // only used by the consumer task
+};
@@ -0,0 +1,149 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+
+#include "transition_inbox.hpp"
+#include "transition_queue.hpp"
+
+#include <thread>
+#include <vector>
+
+enum class test_transition_t : char { NONE = 0, FIRST, SECOND };
+
+enum test_flag_t { NO_FLAG = 0, FLAG_A = 1, FLAG_B = 2, FLAG_C = 4 };
+
+enum class test_payload_t : char { NONE = 0, LEFT, RIGHT };
+
+TEST(empty_inbox_gives_none, []() {
+    transition_inbox_t<test_transition_t, test_payload_t, merge_policy_t::REPLACE> inbox;
+    test_payload_t payload = test_payload_t::LEFT;
+    EXPECT(inbox.take(payload) == test_transition_t::NONE);
+    EXPECT(payload == test_payload_t::NONE);
+});
+
+TEST(transition_is_taken_once_with_its_payload, []() {
+    transition_inbox_t<test_transition_t, test_payload_t, merge_policy_t::REPLACE> inbox;
+    EXPECT(inbox.post(test_transition_t::FIRST, test_payload_t::RIGHT) == test_transition_t::NONE);
+
+    test_payload_t payload;
+    EXPECT(inbox.take(payload) == test_transition_t::FIRST);
+    EXPECT(payload == test_payload_t::RIGHT);
+    EXPECT(inbox.take(payload) == test_transition_t::NONE);
+});
+
+TEST(replace_policy_returns_replaced_transition, []() {
+    transition_inbox_t<test_transition_t, test_payload_t, merge_policy_t::REPLACE> inbox;
+    inbox.post(test_transition_t::FIRST, test_payload_t::LEFT);
+    EXPECT(inbox.post(test_transition_t::SECOND, test_payload_t::RIGHT) == test_transition_t::FIRST);
+
+    test_payload_t payload;
+    EXPECT(inbox.take(payload) == test_transition_t::SECOND);
+    EXPECT(payload == test_payload_t::RIGHT);
+});
+
+TEST(bitwise_or_policy_accumulates_transitions, []() {
+    transition_inbox_t<test_flag_t, no_payload_t, merge_policy_t::BITWISE_OR> inbox;
+    EXPECT(inbox.post(FLAG_A, no_payload_t::NONE) == NO_FLAG);
+    EXPECT(inbox.post(FLAG_C, no_payload_t::NONE) == NO_FLAG);
+
+    no_payload_t payload;
+    EXPECT(inbox.take(payload) == (FLAG_A | FLAG_C));
+    EXPECT(inbox.take(payload) == NO_FLAG);
+});
+
+TEST(concurrent_posts_are_not_lost, []() {
+    transition_inbox_t<test_flag_t, no_payload_t, merge_policy_t::BITWISE_OR> inbox;
+    const int POST_COUNT = 10000;
+    int taken_flags = NO_FLAG;
+    std::vector<std::thread> writers;
+    for (test_flag_t flag : {FLAG_A, FLAG_B, FLAG_C}) {
+        writers.emplace_back([&inbox, flag]() {
+            for (int i = 0; i < POST_COUNT; i++) {
+                inbox.post(flag, no_payload_t::NONE);
+            }
+        });
+    }
+    for (int i = 0; i < POST_COUNT; i++) {
+        no_payload_t payload;
+        taken_flags |= inbox.take(payload);
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    no_payload_t payload;
+    taken_flags |= inbox.take(payload);
+    EXPECT(taken_flags == (FLAG_A | FLAG_B | FLAG_C));
+});
+
+TEST(queue_gives_transitions_in_order_with_their_payload, []() {
+    transition_queue_t<test_transition_t, test_payload_t> queue;
+    EXPECT(queue.post(test_transition_t::FIRST, test_payload_t::LEFT) == test_transition_t::NONE);
+    EXPECT(queue.post(test_transition_t::SECOND, test_payload_t::RIGHT) == test_transition_t::NONE);
+    EXPECT(queue.post(test_transition_t::FIRST, test_payload_t::RIGHT) == test_transition_t::NONE);
+
+    test_payload_t payload;
+    EXPECT(queue.take(payload) == test_transition_t::FIRST);
+    EXPECT(payload == test_payload_t::LEFT);
+    EXPECT(queue.take(payload) == test_transition_t::SECOND);
+    EXPECT(payload == test_payload_t::RIGHT);
+    EXPECT(queue.take(payload) == test_transition_t::FIRST);
+    EXPECT(payload == test_payload_t::RIGHT);
+    EXPECT(queue.take(payload) == test_transition_t::NONE);
+    EXPECT(payload == test_payload_t::NONE);
+});
+
+TEST(full_queue_ignores_new_transitions, []() {
+    transition_queue_t<test_transition_t, test_payload_t, 4> queue;
+    for (int i = 0; i < 4; i++) {
+        EXPECT(queue.post(test_transition_t::FIRST, test_payload_t::LEFT) == test_transition_t::NONE);
+    }
+    EXPECT(queue.post(test_transition_t::SECOND, test_payload_t::RIGHT) == test_transition_t::SECOND);
+
+    // A taken transition frees a cell, also after the positions wrapped around the capacity
+    test_payload_t payload;
+    for (int i = 0; i < 10; i++) {
+        EXPECT(queue.take(payload) == test_transition_t::FIRST);
+        EXPECT(queue.post(test_transition_t::FIRST, test_payload_t::LEFT) == test_transition_t::NONE);
+    }
+});
+
+TEST(queue_keeps_order_of_concurrent_writers, []() {
+    // Each writer posts its own transition with an increasing payload
+    enum class counter_t : int {};
+    transition_queue_t<test_transition_t, counter_t, 16> queue;
+    const int POST_COUNT = 10000;
+    std::vector<std::thread> writers;
+    for (test_transition_t transition : {test_transition_t::FIRST, test_transition_t::SECOND}) {
+        writers.emplace_back([&queue, transition]() {
+            for (int i = 1; i <= POST_COUNT; i++) {
+                while (queue.post(transition, static_cast<counter_t>(i)) != test_transition_t::NONE) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    int last_counters[3] = {0, 0, 0};
+    int taken_count = 0;
+    bool in_order = true;
+    while (taken_count < 2 * POST_COUNT) {
+        counter_t counter;
+        test_transition_t transition = queue.take(counter);
+        if (transition == test_transition_t::NONE) {
+            std::this_thread::yield();
+            continue;
+        }
+        int &last_counter = last_counters[static_cast<int>(transition)];
+        in_order &= static_cast<int>(counter) == last_counter + 1;
+        last_counter = static_cast<int>(counter);
+        taken_count++;
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    EXPECT(in_order);
+    EXPECT(last_counters[1] == POST_COUNT);
+    EXPECT(last_counters[2] == POST_COUNT);
+});
+
+CREATE_MAIN_ENTRY_POINT();
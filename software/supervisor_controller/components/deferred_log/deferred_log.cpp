@@ -0,0 +1,90 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "deferred_log.hpp"
+
+#include "seqlock_ring.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+// The ring is lock-free, so recording never waits (see seqlock_ring.hpp)
+static seqlock_ring_t<deferred_log_record_t, DEFERRED_LOG_RING_SIZE> ring;
+
+void deferred_log_push(const deferred_log_record_t &record)
+{
+    ring.push([&](deferred_log_record_t &slot_record) { slot_record = record; });
+}
+
+bool deferred_log_read(unsigned int &cursor, deferred_log_record_t &record, unsigned int &dropped_count)
+{
+    return ring.read(cursor, record, dropped_count);
+}
+
+// Arguments are stored without their types, the type is deduced from the conversion specifier
+// (length modifiers are ignored : all arguments have been stored from values of at most pointer size)
+int deferred_log_format(const deferred_log_record_t &record, char *output, int output_size)
+{
+    char *p = output;
+    char *end = output + output_size - 1; // (keep space for terminating NULL char)
+    int arg_index = 0;
+    for (const char *f = record.format; *f != '\0' && p < end; f++) {
+        if (*f != '%') {
+            *p++ = *f;
+            continue;
+        }
+
+        // Copy the conversion specification without its length modifiers
+        char spec[16] = "%";
+        int spec_len = 1;
+        f++;
+        while (*f != '\0' && strchr("-+ #0123456789.hlzjt", *f) != NULL) {
+            if (strchr("hlzjt", *f) == NULL && spec_len < (int)sizeof(spec) - 2) {
+                spec[spec_len++] = *f;
+            }
+            f++;
+        }
+        if (*f == '\0') {
+            break;
+        }
+        spec[spec_len++] = *f;
+        spec[spec_len] = '\0';
+
+        if (*f == '%') {
+            *p++ = '%';
+            continue;
+        }
+        if (arg_index >= record.arg_count) {
+            break; // (malformed format)
+        }
+        uintptr_t arg = record.args[arg_index++];
+        int available_len = end - p + 1;
+        int len;
+        switch (*f) {
+        case 'd':
+        case 'i':
+        case 'c':
+            len = snprintf(p, available_len, spec, (int)(intptr_t)arg);
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            len = snprintf(p, available_len, spec, (unsigned int)arg);
+            break;
+        case 's':
+            len = snprintf(p, available_len, spec, (const char *)arg);
+            break;
+        case 'p':
+            len = snprintf(p, available_len, spec, (void *)arg);
+            break;
+        default:
+            len = snprintf(p, available_len, "<%s?>", spec);
+            break;
+        }
+        p += std::min(len, available_len - 1);
+    }
+    *p = '\0';
+    return p - output;
+}
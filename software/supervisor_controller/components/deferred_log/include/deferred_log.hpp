@@ -0,0 +1,69 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include "esp_timer.h" // replaced by stub/esp_timer.h for tests on host
+
+#include <stdint.h>
+#include <type_traits>
+
+// Deferred logs are not formatted when they are recorded :
+// only the format pointer, a timestamp and the raw arguments are stored in a ring,
+// they are formatted later, only if they are read (see 'deferred_log_format').
+// So they can stay enabled on hot paths, in production.
+//
+// Restrictions :
+// - format and tag must be string literals, string arguments must be static strings (like 'str' function results)
+//   because only their address is stored
+// - arguments are integers, enums or static strings (no floating point)
+// - at most DEFERRED_LOG_MAX_ARGS arguments
+#define DEFERRED_LOGD(tag, format, ...) deferred_log('D', tag, format, ##__VA_ARGS__)
+#define DEFERRED_LOGV(tag, format, ...) deferred_log('V', tag, format, ##__VA_ARGS__)
+
+static const int DEFERRED_LOG_MAX_ARGS = 6;
+
+// Number of records kept in the ring, older records are overwritten
+static const int DEFERRED_LOG_RING_SIZE = 128;
+
+struct deferred_log_record_t {
+    int64_t time_us; // record time (esp_timer clock)
+    const char *tag;
+    const char *format;
+    char level; // 'D' or 'V'
+    unsigned char arg_count;
+    uintptr_t args[DEFERRED_LOG_MAX_ARGS];
+};
+
+// Add a record in the ring, it's lock-free : it's never blocked by readers nor by other writers
+void deferred_log_push(const deferred_log_record_t &record);
+
+template <typename T> inline uintptr_t deferred_log_arg(T value)
+{
+    static_assert(std::is_integral_v<T> || std::is_enum_v<T> || std::is_same_v<T, const char *>
+                      || std::is_same_v<T, char *>,
+                  "deferred log arguments must be integers, enums or static strings");
+    static_assert(sizeof(T) <= sizeof(uintptr_t), "deferred log arguments must fit in a pointer (no 64 bits integer)");
+    return (uintptr_t)value;
+}
+
+template <typename... Args> inline void deferred_log(char level, const char *tag, const char *format, Args... args)
+{
+    static_assert(sizeof...(Args) <= DEFERRED_LOG_MAX_ARGS, "too many deferred log arguments");
+    deferred_log_record_t record = {.time_us = esp_timer_get_time(),
+                                    .tag = tag,
+                                    .format = format,
+                                    .level = level,
+                                    .arg_count = sizeof...(Args),
+                                    .args = {deferred_log_arg(args)...}};
+    deferred_log_push(record);
+}
+
+// Read the record following 'cursor' (the sequence number of the last read record, 0 to read all the records
+// still in the ring), return false if there is no more record
+// 'dropped_count' is set to the number of records overwritten since 'cursor'
+bool deferred_log_read(unsigned int &cursor, deferred_log_record_t &record, unsigned int &dropped_count);
+
+// Format the message of a record in 'output' (truncated if 'output_size' is not enough)
+// return the written length
+int deferred_log_format(const deferred_log_record_t &record, char *output, int output_size);
@@ -0,0 +1,84 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+
+#include "deferred_log.hpp"
+
+#include <string.h>
+
+static const char *TAG = "test";
+
+enum class color_t : char { RED = 0, GREEN };
+
+static const char *format_next(unsigned int &cursor)
+{
+    static char message[128];
+    deferred_log_record_t record;
+    unsigned int dropped_count;
+    EXPECT(deferred_log_read(cursor, record, dropped_count));
+    deferred_log_format(record, message, sizeof(message));
+    return message;
+}
+
+TEST(read_nothing_without_record, []() {
+    unsigned int cursor = 0;
+    deferred_log_record_t record;
+    unsigned int dropped_count;
+    EXPECT(!deferred_log_read(cursor, record, dropped_count));
+    EXPECT(dropped_count == 0);
+});
+
+TEST(record_is_formatted_when_read, []() {
+    DEFERRED_LOGD(TAG, "capstone.center:  %i, %i", 12, -3);
+    DEFERRED_LOGV(TAG, "direction: %s (%u%%)", "UP", 100u);
+
+    unsigned int cursor = 0;
+    deferred_log_record_t record;
+    unsigned int dropped_count;
+    EXPECT(deferred_log_read(cursor, record, dropped_count));
+    EXPECT(record.level == 'D');
+    EXPECT(!strcmp(record.tag, TAG));
+    EXPECT(record.arg_count == 2);
+
+    cursor = 0;
+    EXPECT(!strcmp(format_next(cursor), "capstone.center:  12, -3"));
+    EXPECT(!strcmp(format_next(cursor), "direction: UP (100%)"));
+    EXPECT(!deferred_log_read(cursor, record, dropped_count));
+});
+
+TEST(format_specification_is_kept, []() {
+    DEFERRED_LOGD(TAG, "[%4i|%-3d|%03u|%x|%ld|%c]", 42, 7, 5u, 255, 123L, 'z');
+    DEFERRED_LOGD(TAG, "color %i", color_t::GREEN);
+
+    unsigned int cursor = 0;
+    EXPECT(!strcmp(format_next(cursor), "[  42|7  |005|ff|123|z]"));
+    EXPECT(!strcmp(format_next(cursor), "color 1"));
+});
+
+TEST(format_is_truncated, []() {
+    DEFERRED_LOGD(TAG, "value: %i", 123456);
+
+    unsigned int cursor = 0;
+    deferred_log_record_t record;
+    unsigned int dropped_count;
+    EXPECT(deferred_log_read(cursor, record, dropped_count));
+    char message[10];
+    EXPECT(deferred_log_format(record, message, sizeof(message)) == 9);
+    EXPECT(!strcmp(message, "value: 12"));
+});
+
+TEST(oldest_records_are_dropped, []() {
+    for (int i = 1; i <= DEFERRED_LOG_RING_SIZE + 5; i++) {
+        DEFERRED_LOGV(TAG, "%i", i);
+    }
+
+    unsigned int cursor = 0;
+    deferred_log_record_t record;
+    unsigned int dropped_count;
+    EXPECT(deferred_log_read(cursor, record, dropped_count));
+    EXPECT(dropped_count == 5);
+    EXPECT(record.args[0] == 6);
+});
+
+CREATE_MAIN_ENTRY_POINT();
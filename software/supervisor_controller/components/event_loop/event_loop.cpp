@@ -0,0 +1,40 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "event_loop.hpp"
+
+#include <assert.h>
+
+// Wake ups are FreeRTOS task notifications :
+// - they are latched, so a wake up during an update triggers the next update immediately
+// - they are cheaper than semaphores or queues (no kernel object to create)
+static void event_loop_task(void *arg)
+{
+    event_loop_t *loop = (event_loop_t *)arg;
+    // (set before the first update because the task can run before 'xTaskCreate' returns its handle)
+    loop->task.store(xTaskGetCurrentTaskHandle());
+    while (true) {
+        int delay_ms = loop->update(loop->arg);
+        TickType_t delay = delay_ms == EVENT_LOOP_WAIT_FOREVER_MS ? portMAX_DELAY : pdMS_TO_TICKS(delay_ms);
+        ulTaskNotifyTake(pdTRUE, delay);
+    }
+}
+
+void event_loop_start(event_loop_t &loop, const char *name, event_loop_update_function update, void *arg)
+{
+    assert(loop.task.load() == NULL);
+    loop.update = update;
+    loop.arg = arg;
+    TaskHandle_t task;
+    xTaskCreate(event_loop_task, name, 4 * 1024, &loop, 5, &task);
+    loop.task.store(task);
+}
+
+void event_loop_wake(event_loop_t &loop)
+{
+    // (a transition can be set before the task has been started, it will be treated by the first update)
+    TaskHandle_t task = loop.task.load();
+    if (task != NULL) {
+        xTaskNotifyGive(task);
+    }
+}
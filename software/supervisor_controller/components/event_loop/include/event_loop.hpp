@@ -0,0 +1,31 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <atomic>
+
+// Returned by an update function to wait until the next wake up, without timeout
+static const int EVENT_LOOP_WAIT_FOREVER_MS = -1;
+
+// Update function of a component task :
+// it's called once at startup, then each time the task is woken up (see event_loop_wake),
+// or when the returned delay has elapsed (EVENT_LOOP_WAIT_FOREVER_MS if only a wake up is expected)
+typedef int (*event_loop_update_function)(void *arg);
+
+struct event_loop_t {
+    // Set by the task itself and by 'event_loop_start', read by 'event_loop_wake' from other tasks
+    std::atomic<TaskHandle_t> task;
+    event_loop_update_function update;
+    void *arg; // given to the update function
+};
+
+// Create the component task running the update function
+void event_loop_start(event_loop_t &loop, const char *name, event_loop_update_function update, void *arg = NULL);
+
+// Wake up the component task, it can be called from any task (but not from an ISR)
+// Several wake ups before the next update lead to a single update
+void event_loop_wake(event_loop_t &loop);
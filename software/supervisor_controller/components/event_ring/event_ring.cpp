@@ -0,0 +1,75 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "event_ring.hpp"
+
+#include "seqlock_ring.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+// The ring is lock-free, so writers (including every log call) never wait (see seqlock_ring.hpp)
+// (the seq of the stored events is set by the reader)
+static const int EVENT_POLL_MS = 20; // readers are not notified, they check for new events at this period
+
+static seqlock_ring_t<event_t, EVENT_RING_SIZE> ring;
+
+void event_ring_push(event_type_t type, const char *data, int len)
+{
+    len = std::clamp(len, 0, EVENT_DATA_SIZE - 1);
+    ring.push([&](event_t &event) {
+        event.type = type;
+        memcpy(event.data, data, len);
+        event.data[len] = '\0';
+    });
+}
+
+void event_ring_vpush(event_type_t type, const char *format, va_list args)
+{
+    ring.push([&](event_t &event) {
+        event.type = type;
+        int len = std::clamp(vsnprintf(event.data, EVENT_DATA_SIZE, format, args), 0, EVENT_DATA_SIZE - 1);
+        event.data[len] = '\0';
+        if (len > 0 && event.data[len - 1] == '\n') {
+            event.data[len - 1] = '\0';
+        }
+    });
+}
+
+unsigned int event_ring_get_last_seq() { return ring.get_last_seq(); }
+
+// return true if the event following 'cursor' has been read
+static bool try_read(unsigned int &cursor, event_t &event)
+{
+    unsigned int read_cursor = cursor;
+    unsigned int dropped_count;
+    bool read = ring.read(read_cursor, event, dropped_count);
+    if (dropped_count > 0) {
+        // The dropped event comes first (the read event, if any, will be read again)
+        cursor = read ? read_cursor - 1 : read_cursor;
+        event.seq = cursor;
+        event.type = event_type_t::DROPPED;
+        snprintf(event.data, EVENT_DATA_SIZE, "%u", dropped_count);
+        return true;
+    }
+    if (!read) {
+        return false;
+    }
+    event.seq = read_cursor;
+    cursor = read_cursor;
+    return true;
+}
+
+bool event_ring_read(unsigned int &cursor, int timeout_ms, event_t &event)
+{
+    auto timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!try_read(cursor, event)) {
+        if (std::chrono::steady_clock::now() >= timeout) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(EVENT_POLL_MS));
+    }
+    return true;
+}
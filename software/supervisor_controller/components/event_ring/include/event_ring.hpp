@@ -0,0 +1,65 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include <assert.h>
+#include <stdarg.h>
+#include <string.h>
+
+enum class event_type_t : char {
+    LOG = 0,   // log line (without terminating new line)
+    STATE,     // status field change, in json : {"<field>":"<value>"}
+    DETECTION, // sun tracker detection, in json : {"result":"<result>","target":[left,top,right,bottom]}
+    DROPPED,   // (not pushed, returned by 'event_ring_read' when a reader missed overwritten events)
+};
+
+// Convenient function for logging and serialization
+inline const char *str(event_type_t type)
+{
+    switch (type) {
+    case event_type_t::LOG:
+        return "log";
+    case event_type_t::STATE:
+        return "state";
+    case event_type_t::DETECTION:
+        return "detection";
+    case event_type_t::DROPPED:
+        return "dropped";
+    default:
+        assert(false);
+    }
+}
+
+// Number of events kept in the ring, older events are overwritten
+static const int EVENT_RING_SIZE = 64;
+
+// Max size of event data, including terminating NULL char (longer data is truncated)
+static const int EVENT_DATA_SIZE = 128;
+
+struct event_t {
+    unsigned int seq; // incremented at each pushed event, starting at 1
+    event_type_t type;
+    char data[EVENT_DATA_SIZE];
+};
+
+// Add an event in the ring, it's lock-free : it's never blocked by readers nor by other writers
+// Note : it's called by the web logger, so nothing must be logged here
+void event_ring_push(event_type_t type, const char *data, int len);
+inline void event_ring_push(event_type_t type, const char *data) { event_ring_push(type, data, strlen(data)); }
+
+// Same as 'event_ring_push' but the data is formatted directly in the ring, like 'vprintf'
+// (a terminating new line is removed)
+void event_ring_vpush(event_type_t type, const char *format, va_list args);
+
+// return the sequence number of the last pushed event (0 if no event has been pushed yet)
+unsigned int event_ring_get_last_seq();
+
+// Each reader has its own cursor : the sequence number of the last event it has read
+// (0 to read all the events still in the ring)
+// Wait up to 'timeout_ms' for the event following 'cursor' and return true if there is one
+// (immediately if it's already available, otherwise it can be received up to a few tens of ms after its push)
+// Cursor is then set to the read event
+// If the next events have been overwritten, a DROPPED event is returned with the number of missed events as data,
+// the cursor is then set just before the oldest event still in the ring
+bool event_ring_read(unsigned int &cursor, int timeout_ms, event_t &event);
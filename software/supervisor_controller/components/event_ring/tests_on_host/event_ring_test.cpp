@@ -0,0 +1,141 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+
+#include "event_ring.hpp"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+TEST(read_timeout_without_event, []() {
+    unsigned int cursor = 0;
+    event_t event;
+    EXPECT(!event_ring_read(cursor, 10, event));
+    EXPECT(cursor == 0);
+});
+
+TEST(each_reader_has_its_own_cursor, []() {
+    event_ring_push(event_type_t::LOG, "first");
+    event_ring_push(event_type_t::STATE, "second");
+    EXPECT(event_ring_get_last_seq() == 2);
+
+    unsigned int cursor_1 = 0;
+    unsigned int cursor_2 = 0;
+    event_t event;
+    EXPECT(event_ring_read(cursor_1, 0, event));
+    EXPECT(event.seq == 1);
+    EXPECT(event.type == event_type_t::LOG);
+    EXPECT(!strcmp(event.data, "first"));
+    EXPECT(event_ring_read(cursor_1, 0, event));
+    EXPECT(event.type == event_type_t::STATE);
+    EXPECT(cursor_1 == 2);
+    EXPECT(!event_ring_read(cursor_1, 0, event));
+
+    EXPECT(event_ring_read(cursor_2, 0, event));
+    EXPECT(!strcmp(event.data, "first"));
+    EXPECT(cursor_2 == 1);
+});
+
+TEST(long_data_is_truncated, []() {
+    char data[EVENT_DATA_SIZE * 2];
+    memset(data, 'x', sizeof(data));
+    event_ring_push(event_type_t::LOG, data, sizeof(data));
+
+    unsigned int cursor = 0;
+    event_t event;
+    EXPECT(event_ring_read(cursor, 0, event));
+    EXPECT(strlen(event.data) == EVENT_DATA_SIZE - 1);
+});
+
+static void push_formatted(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    event_ring_vpush(event_type_t::LOG, format, args);
+    va_end(args);
+}
+
+TEST(formatted_data_is_written_without_new_line, []() {
+    unsigned int cursor = event_ring_get_last_seq();
+    push_formatted("I (%i) %s: done\n", 12, "tag");
+
+    event_t event;
+    EXPECT(event_ring_read(cursor, 0, event));
+    EXPECT(event.type == event_type_t::LOG);
+    EXPECT(!strcmp(event.data, "I (12) tag: done"));
+});
+
+TEST(slow_reader_gets_dropped_event, []() {
+    unsigned int cursor = 0;
+    event_t event;
+    event_ring_push(event_type_t::LOG, "0");
+    EXPECT(event_ring_read(cursor, 0, event));
+
+    for (int i = 1; i <= EVENT_RING_SIZE + 3; i++) {
+        event_ring_push(event_type_t::LOG, "x");
+    }
+
+    EXPECT(event_ring_read(cursor, 0, event));
+    EXPECT(event.type == event_type_t::DROPPED);
+    EXPECT(!strcmp(event.data, "3"));
+    EXPECT(event_ring_read(cursor, 0, event));
+    EXPECT(event.seq == 5);
+    EXPECT(event.type == event_type_t::LOG);
+});
+
+TEST(read_returns_on_push, []() {
+    std::thread writer([]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        event_ring_push(event_type_t::DETECTION, "{}");
+    });
+    unsigned int cursor = 0;
+    event_t event;
+    EXPECT(event_ring_read(cursor, 5000, event));
+    writer.join();
+    EXPECT(event.type == event_type_t::DETECTION);
+});
+
+TEST(concurrent_writers_and_reader, []() {
+    static const int WRITER_COUNT = 4;
+    static const int EVENT_PER_WRITER = 10000;
+    unsigned int first_seq = event_ring_get_last_seq() + 1;
+    unsigned int last_seq = first_seq + WRITER_COUNT * EVENT_PER_WRITER - 1;
+    std::vector<std::thread> writers;
+    for (int w = 0; w < WRITER_COUNT; w++) {
+        writers.emplace_back([w]() {
+            // Each writer fills its data with its own char, so a torn event can be detected
+            char data[EVENT_DATA_SIZE];
+            memset(data, 'a' + w, sizeof(data));
+            for (int i = 0; i < EVENT_PER_WRITER; i++) {
+                event_ring_push(event_type_t::LOG, data, sizeof(data));
+            }
+        });
+    }
+
+    // The reader stops at the last pushed event (or if no event is received for a long time)
+    unsigned int cursor = first_seq - 1;
+    int read_count = 0;
+    event_t event;
+    while (cursor != last_seq && event_ring_read(cursor, 5000, event)) {
+        if (event.type == event_type_t::DROPPED) {
+            read_count += atoi(event.data);
+            continue;
+        }
+        EXPECT(event.seq == cursor);
+        EXPECT(strlen(event.data) == EVENT_DATA_SIZE - 1);
+        char writer_char[2] = {event.data[0], '\0'};
+        EXPECT(strspn(event.data, writer_char) == EVENT_DATA_SIZE - 1);
+        read_count++;
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    EXPECT(cursor == last_seq);
+    EXPECT(read_count == WRITER_COUNT * EVENT_PER_WRITER);
+});
+
+CREATE_MAIN_ENTRY_POINT();
@@ -0,0 +1,81 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include "esp_timer.h" // replaced by stub/esp_timer.h for tests on host
+
+#include <assert.h>
+#include <stdint.h>
+
+// Measured stages of the tracking loop and of the web interface
+enum class metrics_stage_t : char {
+    CAPTURE = 0,        // wait for a camera frame
+    CONVERSION,         // image conversion
+    CAPSTONE_DETECTION, // target detection
+    SPOT_DETECTION,     // spot light detection in target area
+    JPEG_ENCODING,      // stream image encoding
+    MOTORS_UART,        // motors stop command round trip
+    COUNT,              // (number of stages, not a stage)
+};
+
+// Convenient function for logging
+inline const char *str(metrics_stage_t stage)
+{
+    switch (stage) {
+    case metrics_stage_t::CAPTURE:
+        return "capture";
+    case metrics_stage_t::CONVERSION:
+        return "conversion";
+    case metrics_stage_t::CAPSTONE_DETECTION:
+        return "capstone-detection";
+    case metrics_stage_t::SPOT_DETECTION:
+        return "spot-detection";
+    case metrics_stage_t::JPEG_ENCODING:
+        return "jpeg-encoding";
+    case metrics_stage_t::MOTORS_UART:
+        return "motors-uart";
+    default:
+        assert(false);
+    }
+}
+
+// Statistics of a stage :
+// min and max are computed on all samples since startup,
+// avg and p95 are computed on the last METRICS_SAMPLE_COUNT samples
+struct metrics_summary_t {
+    int count;
+    int min_us;
+    int avg_us;
+    int max_us;
+    int p95_us;
+};
+
+static const int METRICS_SAMPLE_COUNT = 64;
+
+// Record a stage duration
+// Lock-free : it can be called from any task, concurrently
+void metrics_record(metrics_stage_t stage, int duration_us);
+
+// Summary of the samples recorded so far (count is 0 if no sample has been recorded)
+// Samples recorded concurrently with this call can be partially taken into account
+metrics_summary_t metrics_get_summary(metrics_stage_t stage);
+
+// Record the duration between its creation and its destruction :
+// { metrics_scoped_timer_t timer(metrics_stage_t::CAPTURE); ... }
+class metrics_scoped_timer_t {
+  public:
+    explicit metrics_scoped_timer_t(metrics_stage_t stage)
+        : stage(stage)
+        , start_us(esp_timer_get_time())
+    {
+    }
+    ~metrics_scoped_timer_t() { metrics_record(stage, (int)(esp_timer_get_time() - start_us)); }
+
+    metrics_scoped_timer_t(const metrics_scoped_timer_t &) = delete;
+    metrics_scoped_timer_t &operator=(const metrics_scoped_timer_t &) = delete;
+
+  private:
+    metrics_stage_t stage;
+    int64_t start_us;
+};
@@ -0,0 +1,76 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+
+static const int STAGE_COUNT = static_cast<int>(metrics_stage_t::COUNT);
+
+// Samples of each stage are written in a fixed-size ring, without lock :
+// - each writer reserves a slot by incrementing 'sample_count'
+// - running statistics are updated with atomic operations
+// All atomics are 32 bits : 64 bits atomics are not lock-free on the 32 bits target,
+// so there is no running sum, the average is computed from the ring like p95.
+// A reader can see a slot being rewritten by a concurrent writer,
+// this only makes p95 slightly inaccurate, which is acceptable for metrics.
+struct stage_samples_t {
+    std::atomic<int> samples[METRICS_SAMPLE_COUNT];
+    std::atomic<unsigned int> sample_count;
+    std::atomic<int> min_us{INT_MAX};
+    std::atomic<int> max_us{0};
+};
+
+static stage_samples_t stages[STAGE_COUNT];
+
+static stage_samples_t &get_stage_samples(metrics_stage_t stage)
+{
+    int index = static_cast<int>(stage);
+    assert(index >= 0 && index < STAGE_COUNT);
+    return stages[index];
+}
+
+void metrics_record(metrics_stage_t stage, int duration_us)
+{
+    stage_samples_t &s = get_stage_samples(stage);
+
+    unsigned int index = s.sample_count.fetch_add(1, std::memory_order_relaxed);
+    s.samples[index % METRICS_SAMPLE_COUNT].store(duration_us, std::memory_order_relaxed);
+
+    int min_us = s.min_us.load(std::memory_order_relaxed);
+    while (duration_us < min_us && !s.min_us.compare_exchange_weak(min_us, duration_us, std::memory_order_relaxed)) {
+    }
+    int max_us = s.max_us.load(std::memory_order_relaxed);
+    while (duration_us > max_us && !s.max_us.compare_exchange_weak(max_us, duration_us, std::memory_order_relaxed)) {
+    }
+}
+
+metrics_summary_t metrics_get_summary(metrics_stage_t stage)
+{
+    stage_samples_t &s = get_stage_samples(stage);
+
+    unsigned int count = s.sample_count.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return {.count = 0, .min_us = 0, .avg_us = 0, .max_us = 0, .p95_us = 0};
+    }
+
+    int last_samples[METRICS_SAMPLE_COUNT];
+    int last_sample_count = std::min(count, (unsigned int)METRICS_SAMPLE_COUNT);
+    int64_t last_samples_sum_us = 0;
+    for (int i = 0; i < last_sample_count; i++) {
+        last_samples[i] = s.samples[i].load(std::memory_order_relaxed);
+        last_samples_sum_us += last_samples[i];
+    }
+    int p95_index = (last_sample_count * 95 + 99) / 100 - 1;
+    std::nth_element(last_samples, last_samples + p95_index, last_samples + last_sample_count);
+
+    return {
+        .count = (int)std::min(count, (unsigned int)INT_MAX),
+        .min_us = s.min_us.load(std::memory_order_relaxed),
+        .avg_us = (int)(last_samples_sum_us / last_sample_count),
+        .max_us = s.max_us.load(std::memory_order_relaxed),
+        .p95_us = last_samples[p95_index],
+    };
+}
@@ -0,0 +1,50 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+
+#include "metrics.hpp"
+
+TEST(summary_is_empty_without_sample, []() {
+    metrics_summary_t summary = metrics_get_summary(metrics_stage_t::CAPTURE);
+    EXPECT(summary.count == 0);
+    EXPECT(summary.p95_us == 0);
+});
+
+TEST(summary_of_few_samples, []() {
+    metrics_record(metrics_stage_t::CONVERSION, 30);
+    metrics_record(metrics_stage_t::CONVERSION, 10);
+    metrics_record(metrics_stage_t::CONVERSION, 20);
+
+    metrics_summary_t summary = metrics_get_summary(metrics_stage_t::CONVERSION);
+    EXPECT(summary.count == 3);
+    EXPECT(summary.min_us == 10);
+    EXPECT(summary.avg_us == 20);
+    EXPECT(summary.max_us == 30);
+    EXPECT(summary.p95_us == 30);
+});
+
+TEST(p95_is_computed_on_last_samples, []() {
+    // Old samples are overwritten in the ring but still count in min and max
+    metrics_record(metrics_stage_t::SPOT_DETECTION, 10000);
+    for (int i = 1; i <= METRICS_SAMPLE_COUNT; i++) {
+        metrics_record(metrics_stage_t::SPOT_DETECTION, i);
+    }
+
+    metrics_summary_t summary = metrics_get_summary(metrics_stage_t::SPOT_DETECTION);
+    EXPECT(summary.count == METRICS_SAMPLE_COUNT + 1);
+    EXPECT(summary.min_us == 1);
+    EXPECT(summary.max_us == 10000);
+    EXPECT(summary.avg_us == (METRICS_SAMPLE_COUNT + 1) / 2);
+    EXPECT(summary.p95_us == METRICS_SAMPLE_COUNT * 95 / 100 + 1);
+});
+
+TEST(scoped_timer_records_a_sample, []() {
+    { metrics_scoped_timer_t timer(metrics_stage_t::MOTORS_UART); }
+
+    metrics_summary_t summary = metrics_get_summary(metrics_stage_t::MOTORS_UART);
+    EXPECT(summary.count == 1);
+    EXPECT(summary.min_us >= 0);
+});
+
+CREATE_MAIN_ENTRY_POINT();
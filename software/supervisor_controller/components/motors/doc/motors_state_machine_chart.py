@@ -29,12 +29,12 @@ Edge(chart, stopping, moving, "->", "START_MOVE", layout=EdgeLayout.TOP_TOP_CURV
 Edge(chart, moving, stopping, "->", "STOP")
 Edge(chart, moving, state_cond_1, "->")
 Edge(chart, stopping, state_cond_2, "->")
-Edge(chart, state_cond_1, stopped, "->", "[state==STOPPED]", layout=EdgeLayout.LEFT_LEFT_CURVED)
-Edge(chart, state_cond_2, stopped, "->", "[state==STOPPED]", layout=EdgeLayout.RIGHT_RIGHT_CURVED)
+Edge(chart, state_cond_1, stopped, "->", "HW_STOPPED", layout=EdgeLayout.LEFT_LEFT_CURVED)
+Edge(chart, state_cond_2, stopped, "->", "HW_STOPPED", layout=EdgeLayout.RIGHT_RIGHT_CURVED)
 Edge(chart, state_cond_1, moving, "->", "[else]", layout=EdgeLayout.RIGHT_RIGHT_CURVED)
 Edge(chart, state_cond_2, stopping, "->", "[else]", layout=EdgeLayout.LEFT_LEFT_CURVED)
-Edge(chart, state_cond_2, error, "->", "[state==UNKNOWN]", layout=EdgeLayout.BOTTOM_BOTTOM_CURVED)
-Edge(chart, state_cond_1, error, "->", "[state==UNKNOWN]", layout=EdgeLayout.BOTTOM_BOTTOM_CURVED)
+Edge(chart, state_cond_2, error, "->", "HW_NOT_RESPONDING", layout=EdgeLayout.BOTTOM_BOTTOM_CURVED)
+Edge(chart, state_cond_1, error, "->", "HW_NOT_RESPONDING", layout=EdgeLayout.BOTTOM_BOTTOM_CURVED)
 
 # Manually adjust view size because edge text is not yet automatically taken into account
 Point(chart, 2.2, 2)
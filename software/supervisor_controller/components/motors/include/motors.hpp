@@ -5,18 +5,33 @@
 
 #include "motors_direction.hpp"
 
+#include <stdint.h>
+
+// Timestamped record of a motors stop, given to stopped callbacks
+struct motors_stopped_event_t {
+    // Time at which motors were known to be stopped (esp_timer clock, same as camera frame timestamps) :
+    // it's the time the stop notification of the motors controller was handled (within milliseconds after the stop),
+    // so images entirely exposed after this time are not blurred by the move (see camera_capture)
+    int64_t time_us;
+};
+
 // callback called when motors pass from moving to stopped
 // (not called repetitively while motors stay stopped)
-typedef void (*motors_stopped_callback)();
+typedef void (*motors_stopped_callback)(const motors_stopped_event_t &event);
 
 void motors_register_stopped_callback(motors_stopped_callback callback);
 
 const char *motors_get_state(); // for display and debug only
 
+unsigned int motors_get_unhandled_transition_count(); // for instrumentation only
+
 void motors_init();
 
 void motors_start_move_continuous(motors_direction_t direction);
 
 void motors_start_move_one_step(motors_direction_t direction);
 
+// Move all the plan steps in sequence, the motors stopped callbacks are called after the last one
+void motors_start_move_steps(const motors_plan_t &plan);
+
 void motors_stop();
@@ -44,3 +44,27 @@ inline const char *str(motors_direction_t direction)
         assert(false);
     }
 }
+
+// The motors controller buffers up to 5 commands, one of them is used to notify the end of the plan
+static const int MOTORS_PLAN_MAX_STEPS = 4;
+
+// Run time of a single manual step
+static const int MOTORS_ONE_STEP_TIME_MS = 150;
+// Max run time of a step ('continuous' moves are not supposed to be infinite because hard angle limit)
+static const int MOTORS_MAX_STEP_TIME_MS = 10000;
+
+// Sequence of moves, sent at once to the motors controller, and executed without stopping between steps
+struct motors_plan_t {
+    int step_count; // 0 if there is nothing to move
+    motors_direction_t directions[MOTORS_PLAN_MAX_STEPS];
+    int step_times_ms[MOTORS_PLAN_MAX_STEPS]; // 1 to MOTORS_MAX_STEP_TIME_MS
+};
+
+inline motors_plan_t motors_plan_one_step(motors_direction_t direction, int step_time_ms = MOTORS_ONE_STEP_TIME_MS)
+{
+    motors_plan_t plan{};
+    plan.step_count = 1;
+    plan.directions[0] = direction;
+    plan.step_times_ms[0] = step_time_ms;
+    return plan;
+}
@@ -2,122 +2,119 @@
 // This code is distributed under GNU GPL v3 license
 
 #include "motors.hpp"
+#include "component_runtime.hpp"
+#include "motors_hw.hpp"
 #include "motors_state_machine.hpp"
+#include "status_snapshot.hpp"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 
-#include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
+#include <atomic>
 #include <vector>
 
 static const char *TAG = "motors";
 
 // This file is the public interface of the motors component
-// It does not implement logic by itself but provides thread safety to state_machine layer
-// It's accomplished by :
-// - preventing multiple simultaneous calls to state_machine functions
-//   by calling them from a dedicated task
-// - protecting state and transition values with a mutex
-static const int STATE_MUTEX_TIMEOUT_MS = 100;
-static SemaphoreHandle_t state_mutex;
-static const int INTER_UPDATE_DELAY_MS = 100;
-static motors_state_t current_state = motors_state_t::UNINITIALIZED;
-static motors_transition_t asked_transition = motors_transition_t::NONE;
-static motors_direction_t asked_direction = motors_direction_t::NONE;
+// It does not implement logic by itself, thread safety of the state_machine layer is provided by component_runtime
+// Transitions are queued and treated in order with their payload (no order is lost)
+static component_runtime_t<motors_state_t, motors_transition_t, motors_plan_t, merge_policy_t::QUEUE>
+    runtime(TAG, motors_state_t::UNINITIALIZED);
+// The motors hardware is never polled : the end of each command is notified asynchronously
+// and received as HW_STOPPED or HW_NOT_RESPONDING transition
 static std::vector<motors_stopped_callback> stopped_callbacks;
 
+// Time of the command notified by the last HW_STOPPED transition
+static std::atomic<int64_t> hw_stopped_command_time_us = 0;
+// Time of the last command sent to the motors (only used by the motors task)
+static int64_t last_command_time_us = 0;
+
 void motors_register_stopped_callback(motors_stopped_callback callback) { stopped_callbacks.push_back(callback); }
 
-// This function must not be called from an ISR (interrupt service routine)
-// because mutex does not support it. Neither ESP32 doc nor FreeRTOS doc is clear
-// about what happens in this case, various forums seem to indicate that an 'abort()'
-// is triggered with an explanation message.
-const char *motors_get_state()
+const char *motors_get_state() { return str(runtime.get_state()); }
+
+unsigned int motors_get_unhandled_transition_count() { return motors_state_machine_get_unhandled_count(); }
+
+// Called from motors_hw reception task
+static void on_hw_state(motor_hw_state_t hw_state, int64_t request_time_us)
 {
-    assert(xSemaphoreTake(state_mutex, pdMS_TO_TICKS(STATE_MUTEX_TIMEOUT_MS)));
-    auto state = current_state;
-    xSemaphoreGive(state_mutex);
-    return str(state);
+    if (hw_state == motor_hw_state_t::STOPPED) {
+        hw_stopped_command_time_us = request_time_us;
+        runtime.post(motors_transition_t::HW_STOPPED);
+    } else if (hw_state == motor_hw_state_t::UNKNOWN) {
+        runtime.post(motors_transition_t::HW_NOT_RESPONDING);
+    }
 }
 
-// Note : transition will be reset if state changes after this call
-void set_transition(motors_transition_t transition, motors_direction_t direction = motors_direction_t::NONE)
+static bool is_command(motors_transition_t transition)
 {
-    assert(xSemaphoreTake(state_mutex, pdMS_TO_TICKS(STATE_MUTEX_TIMEOUT_MS)));
-    if (asked_transition != motors_transition_t::NONE) {
-        ESP_LOGW(
-            TAG,
-            "Old transition '%s' ignored because new transition '%s' is asked before the old transition processing",
-            str(asked_transition),
-            str(transition));
-    }
-    asked_transition = transition;
-    asked_direction = direction;
-    xSemaphoreGive(state_mutex);
+    return transition == motors_transition_t::STOP || transition == motors_transition_t::START_MOVE_CONTINUOUS
+           || transition == motors_transition_t::START_MOVE_STEPS;
 }
 
-static void motors_task(void *arg)
+static motors_state_t
+motors_update(motors_state_t state, motors_transition_t transition, motors_plan_t plan, int &next_delay_ms)
 {
-    while (true) {
-        assert(xSemaphoreTake(state_mutex, pdMS_TO_TICKS(STATE_MUTEX_TIMEOUT_MS)));
-        motors_state_t state = current_state;
-        motors_transition_t transition = asked_transition;
-        motors_direction_t direction = asked_direction;
-
-        // Reset asked transition :
-        // - it will be "consumed" by 'state_machine_update' outside of the mutex guard
-        // - one transition must not be treated multiple times by 'state_machine_update'
-        // - we allow another transition to be set while 'state_machine_update' is running
-        asked_transition = motors_transition_t::NONE;
-        asked_direction = motors_direction_t::NONE;
-        xSemaphoreGive(state_mutex);
-
-        motors_state_t new_state = motors_state_machine_update(state, transition, direction);
-
-        if (new_state != state) {
-            ESP_LOGI(TAG,
-                     "update(state: %s, transition: %s, direction: %s) -> new_state: %s",
-                     str(state),
-                     str(transition),
-                     str(direction),
-                     str(new_state));
-        }
+    int64_t update_time_us = esp_timer_get_time();
+    if (is_command(transition)) {
+        last_command_time_us = update_time_us;
+    }
 
-        assert(xSemaphoreTake(state_mutex, pdMS_TO_TICKS(STATE_MUTEX_TIMEOUT_MS)));
-        if (current_state != motors_state_t::STOPPED && new_state == motors_state_t::STOPPED) {
-            for (auto callback : stopped_callbacks) {
-                callback();
-            }
-        }
-        current_state = new_state;
-        xSemaphoreGive(state_mutex);
+    motors_state_t new_state;
+    if (transition == motors_transition_t::HW_STOPPED && hw_stopped_command_time_us < last_command_time_us) {
+        // Notification of a command replaced by the last one, the motors may have started again since
+        ESP_LOGD(TAG, "Outdated motors stopped notification ignored");
+        new_state = state;
+    } else {
+        new_state = motors_state_machine_update(state, transition, plan);
+    }
 
-        // Simple wait between state updates because :
-        // - don't need a strict period between state updates (don't use periodic timer)
-        // - don't need to treat event as fast as possible
-        vTaskDelay(pdMS_TO_TICKS(INTER_UPDATE_DELAY_MS));
+    if (new_state != state) {
+        ESP_LOGI(TAG,
+                 "update(state: %s, transition: %s, steps: %i, direction: %s) -> new_state: %s",
+                 str(state),
+                 str(transition),
+                 plan.step_count,
+                 str(plan.directions[0]),
+                 str(new_state));
     }
+
+    if (state != motors_state_t::STOPPED && new_state == motors_state_t::STOPPED) {
+        // The stop is notified within milliseconds, so the update time is close to the actual stop time
+        motors_stopped_event_t event = {.time_us = update_time_us};
+        for (auto callback : stopped_callbacks) {
+            callback(event);
+        }
+    }
+
+    status_snapshot_set(status_field_t::MOTORS_STATE, str(new_state));
+
+    // States only change on transitions, no need to update them until the next one
+    return new_state;
 }
 
 void motors_init()
 {
     ESP_LOGD(TAG, "motors_init");
 
-    assert(current_state == motors_state_t::UNINITIALIZED);
-
-    state_mutex = xSemaphoreCreateMutex();
-
-    xTaskCreate(motors_task, TAG, 4 * 1024, NULL, 5, NULL);
+    motors_hw_register_state_callback(on_hw_state);
+    runtime.start(motors_update);
 }
 
 void motors_start_move_continuous(motors_direction_t direction)
 {
-    set_transition(motors_transition_t::START_MOVE_CONTINUOUS, direction);
+    runtime.post(motors_transition_t::START_MOVE_CONTINUOUS, motors_plan_one_step(direction));
 }
 
 void motors_start_move_one_step(motors_direction_t direction)
 {
-    set_transition(motors_transition_t::START_MOVE_ONE_STEP, direction);
+    runtime.post(motors_transition_t::START_MOVE_STEPS, motors_plan_one_step(direction));
+}
+
+void motors_start_move_steps(const motors_plan_t &plan)
+{
+    assert(plan.step_count >= 1 && plan.step_count <= MOTORS_PLAN_MAX_STEPS);
+    runtime.post(motors_transition_t::START_MOVE_STEPS, plan);
 }
 
-void motors_stop() { set_transition(motors_transition_t::STOP); }
+void motors_stop() { runtime.post(motors_transition_t::STOP); }
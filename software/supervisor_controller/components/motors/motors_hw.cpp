@@ -2,10 +2,18 @@
 // This code is distributed under GNU GPL v3 license
 
 #include "motors_hw.hpp"
+#include "motors_transport.hpp"
 
 #include "driver/uart.h"
 #include "esp_log.h"
-#include "string.h"
+#include "esp_timer.h"
+#include "metrics.hpp"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
 static const char *TAG = "motors_hw";
 
 #define MOTOR_CONTROLLER_RX_PIN 15
@@ -15,9 +23,77 @@ static const char *TAG = "motors_hw";
 
 #define BUFFER_SIZE (128) // (keep small to stay below task stack size)
 
-static const int REPLY_READ_TIME_MS = 80;
+static const int UART_EVENT_QUEUE_SIZE = 10;
+// Max delay between the end of a command and its stop notification
+static const int REPLY_TIMEOUT_MS = 80;
+
+// Measured current where motors are stopped (they reached their end)
+static const uint16_t CMD_THRESHOLD = 200;
 
-const char END_CHAR = '\n';
+static_assert(MOTORS_PLAN_MAX_STEPS <= MOTORS_PROTOCOL_MAX_STEPS, "a plan must fit in a single MOVE frame");
+static_assert(MOTORS_MAX_STEP_TIME_MS <= 32767, "step times are int on the motors controller (16 bits)");
+
+// Pending request timeouts are checked at least at this period
+static const int RX_TASK_PERIOD_MS = 10;
+
+// Stop notifications are received by a dedicated task, so commands never block the caller
+// The transport state is shared between this task and the callers, it's protected by 'transport_mutex'
+static QueueHandle_t uart_queue = NULL;
+static SemaphoreHandle_t transport_mutex = NULL;
+static motors_hw_state_callback state_callback = NULL;
+
+// Called by the transport, with 'transport_mutex' taken
+static void on_stop_notification(const motors_frame_t *reply, int64_t request_time_us)
+{
+    motor_hw_state_t state;
+    if (reply == NULL) {
+        state = motor_hw_state_t::UNKNOWN;
+    } else if (reply->running == 0) {
+        state = motor_hw_state_t::STOPPED;
+    } else {
+        state = motor_hw_state_t::MOVING;
+    }
+    ESP_LOGV(TAG, "Stop notification: %s", str(state));
+    if (state_callback != NULL) {
+        state_callback(state, request_time_us);
+    }
+}
+
+// The stop command is notified immediately, so its notification delay is the UART round trip
+static void on_stop_command_notification(const motors_frame_t *reply, int64_t request_time_us)
+{
+    if (reply != NULL) {
+        metrics_record(metrics_stage_t::MOTORS_UART, (int)(esp_timer_get_time() - request_time_us));
+    }
+    on_stop_notification(reply, request_time_us);
+}
+
+static void motors_hw_rx_task(void *arg)
+{
+    uint8_t data[BUFFER_SIZE];
+    while (true) {
+        uart_event_t event;
+        if (xQueueReceive(uart_queue, &event, pdMS_TO_TICKS(RX_TASK_PERIOD_MS)) == pdTRUE) {
+            if (event.type == UART_DATA) {
+                // Read all buffered data, possibly more than this event size
+                int len;
+                while ((len = uart_read_bytes(MOTOR_CONTROLLER_UART_PORT_NUM, data, BUFFER_SIZE, 0)) > 0) {
+                    xSemaphoreTake(transport_mutex, portMAX_DELAY);
+                    motors_transport_receive(data, len);
+                    xSemaphoreGive(transport_mutex);
+                }
+            } else if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL) {
+                // Received data are lost, the pending requests will time out
+                ESP_LOGW(TAG, "UART reception overflow (event %i)", (int)event.type);
+                uart_flush_input(MOTOR_CONTROLLER_UART_PORT_NUM);
+                xQueueReset(uart_queue);
+            }
+        }
+        xSemaphoreTake(transport_mutex, portMAX_DELAY);
+        motors_transport_check_timeouts(esp_timer_get_time());
+        xSemaphoreGive(transport_mutex);
+    }
+}
 
 motor_hw_error_t motors_hw_init()
 {
@@ -34,7 +110,8 @@ motor_hw_error_t motors_hw_init()
         .source_clk = UART_SCLK_APB,
     };
 
-    if (uart_driver_install(MOTOR_CONTROLLER_UART_PORT_NUM, BUFFER_SIZE * 2, 0, 0, NULL, 0) != ESP_OK)
+    if (uart_driver_install(MOTOR_CONTROLLER_UART_PORT_NUM, BUFFER_SIZE * 2, 0, UART_EVENT_QUEUE_SIZE, &uart_queue, 0)
+        != ESP_OK)
         return motor_hw_error_t::CANNOT_USE_UART;
     if (uart_param_config(MOTOR_CONTROLLER_UART_PORT_NUM, &uart_config) != ESP_OK)
         return motor_hw_error_t::CANNOT_USE_UART;
@@ -46,43 +123,43 @@ motor_hw_error_t motors_hw_init()
         != ESP_OK)
         return motor_hw_error_t::CANNOT_USE_UART;
 
-    return motor_hw_error_t::NO_ERROR;
-}
+    transport_mutex = xSemaphoreCreateMutex();
+    assert(transport_mutex != NULL);
+    xTaskCreate(motors_hw_rx_task, TAG, 3 * 1024, NULL, 5, NULL);
 
-bool motors_hw_write_commands(const char *commands)
-{
-    ESP_LOGV(TAG, "Send '%s' to motors", commands);
-    int res = uart_write_bytes(MOTOR_CONTROLLER_UART_PORT_NUM, commands, strlen(commands));
-    res += uart_write_bytes(MOTOR_CONTROLLER_UART_PORT_NUM, &END_CHAR, 1);
-    return (res == strlen(commands) + 1);
+    return motor_hw_error_t::NO_ERROR;
 }
 
-// Return true if the last character received is '1'
-char motors_hw_read_reply()
+// Send the command frame with a new request id, so the motors controller notifies when motors stop
+// (a new command clears the previous ones on the motors controller, so the previous notification is cancelled)
+static void send_command(const motors_frame_t &command, int max_time_ms, motors_transport_callback callback)
 {
-    char reply[BUFFER_SIZE];
-    int len =
-        uart_read_bytes(MOTOR_CONTROLLER_UART_PORT_NUM, reply, (BUFFER_SIZE - 1), pdMS_TO_TICKS(REPLY_READ_TIME_MS));
-    if (len > 0) {
-        reply[len] = '\0';
-        char result = reply[len - 1];
-        ESP_LOGV(TAG, "Reply: '%s' (len: %i, result:'%c')", reply, len, result);
-        return result;
-    } else {
-        ESP_LOGW(TAG, "No reply");
-        return '?';
+    uint8_t frame[MOTORS_PROTOCOL_MAX_FRAME_SIZE];
+    xSemaphoreTake(transport_mutex, portMAX_DELAY);
+    motors_transport_cancel_requests();
+    int size = motors_transport_start_request(command,
+                                              esp_timer_get_time(),
+                                              max_time_ms + REPLY_TIMEOUT_MS,
+                                              callback,
+                                              frame,
+                                              MOTORS_PROTOCOL_MAX_FRAME_SIZE);
+    if (size > 0) {
+        ESP_LOGV(TAG, "Send frame (opcode: %i, request_id: %i) to motors", (int)frame[2], (int)frame[3]);
+        // (if it fails, the request will time out)
+        uart_write_bytes(MOTOR_CONTROLLER_UART_PORT_NUM, frame, size);
     }
+    xSemaphoreGive(transport_mutex);
 }
 
 void motors_hw_stop()
 {
     ESP_LOGV(TAG, "motors_hw_stop");
-    motors_hw_write_commands("c");
+    motors_frame_t command = {.opcode = motors_opcode_t::STOP};
+    send_command(command, 0, on_stop_command_notification);
 }
 
-void motors_hw_start_move(motors_direction_t direction, bool continuous)
+static uint8_t get_motor_pins(motors_direction_t direction)
 {
-    ESP_LOGV(TAG, "motors_hw_start_move(direction = %s, continuous = %i)", str(direction), continuous ? 1 : 0);
     int motor_pins = 0;
 
     if (direction == motors_direction_t::UP) {
@@ -109,28 +186,42 @@ void motors_hw_start_move(motors_direction_t direction, bool continuous)
     // but the current supervisor software manage only one panel.
     // The same command is sent to both panel outputs
     // so it works whatever the actual output connected to the real panel is
-    motor_pins = motor_pins + (motor_pins * 16);
-
-    // 'continuous' is not supposed to be infinite because hard angle limit
-    int cmd_max_time_ms = continuous ? 10000 : 150;
-    int cmd_threshold = 200;
-    static char command[1024];
-    sprintf(command, "o:%i,%i,%i", motor_pins, cmd_max_time_ms, cmd_threshold);
-    motors_hw_write_commands(command);
+    return motor_pins + (motor_pins * 16);
+}
+
+// Send all steps of the plan in a single MOVE frame
+static void send_move(const motors_plan_t &plan)
+{
+    assert(plan.step_count >= 1 && plan.step_count <= MOTORS_PROTOCOL_MAX_STEPS);
+    motors_frame_t command = {
+        .opcode = motors_opcode_t::MOVE,
+        .step_count = (uint8_t)plan.step_count,
+        .threshold = CMD_THRESHOLD,
+    };
+    int total_time_ms = 0;
+    for (int i = 0; i < plan.step_count; i++) {
+        assert(plan.step_times_ms[i] >= 1 && plan.step_times_ms[i] <= MOTORS_MAX_STEP_TIME_MS);
+        command.motor_pins[i] = get_motor_pins(plan.directions[i]);
+        command.max_times_ms[i] = (uint16_t)plan.step_times_ms[i];
+        total_time_ms += plan.step_times_ms[i];
+    }
+    send_command(command, total_time_ms, on_stop_notification);
 }
 
-motor_hw_state_t motor_hw_get_state()
+void motors_hw_start_move_continuous(motors_direction_t direction)
 {
-    motors_hw_write_commands("s");
+    ESP_LOGV(TAG, "motors_hw_start_move_continuous(direction = %s)", str(direction));
+    send_move(motors_plan_one_step(direction, MOTORS_MAX_STEP_TIME_MS));
+}
 
-    char reply = motors_hw_read_reply();
-    motor_hw_state_t state;
-    if (reply == '1')
-        state = motor_hw_state_t::MOVING;
-    else if (reply == '0')
-        state = motor_hw_state_t::STOPPED;
-    else
-        state = motor_hw_state_t::UNKNOWN;
-    ESP_LOGV(TAG, "motor_hw_get_state(): %s", str(state));
-    return state;
+void motors_hw_start_move_steps(const motors_plan_t &plan)
+{
+    ESP_LOGV(TAG,
+             "motors_hw_start_move_steps(step_count = %i, first direction = %s, first step time = %i ms)",
+             plan.step_count,
+             str(plan.directions[0]),
+             plan.step_times_ms[0]);
+    send_move(plan);
 }
+
+void motors_hw_register_state_callback(motors_hw_state_callback callback) { state_callback = callback; }
@@ -6,6 +6,7 @@
 #include "motors_direction.hpp"
 
 #include <assert.h>
+#include <stdint.h>
 
 enum class motor_hw_error_t : char { NO_ERROR = 0, CANNOT_USE_UART };
 
@@ -30,6 +31,18 @@ motor_hw_error_t motors_hw_init();
 
 void motors_hw_stop();
 
-void motors_hw_start_move(motors_direction_t direction, bool continuous);
+void motors_hw_start_move_continuous(motors_direction_t direction);
 
-motor_hw_state_t motor_hw_get_state();
+// All the plan steps are sent in a single command
+void motors_hw_start_move_steps(const motors_plan_t &plan);
+
+// Called from the motors_hw reception task when a command completes :
+// - 'state' is STOPPED when the motors controller notifies the end of the command,
+//   or UNKNOWN if it did not notify in time
+// - 'request_time_us' is the time the command was sent
+// The completion of a command replaced by a new one is never notified
+// (it must return quickly and must not call motors_hw functions)
+typedef void (*motors_hw_state_callback)(motor_hw_state_t state, int64_t request_time_us);
+
+// Must be called before motors_hw_init
+void motors_hw_register_state_callback(motors_hw_state_callback callback);
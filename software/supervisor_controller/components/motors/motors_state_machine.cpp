@@ -4,58 +4,94 @@
 #include "motors_state_machine.hpp"
 #include "motors_hw.hpp"
 
-#include "esp_log.h" // replaced by stub/esp_log.h for tests on host
-
 #include <assert.h>
-
-static const char *TAG = "motors_state_machine";
+#include <stddef.h>
 
 static motors_direction_t continuous_motors_direction = motors_direction_t::NONE;
 
-motors_state_t motors_state_machine_update(motors_state_t current_state,
-                                           motors_transition_t transition,
-                                           motors_direction_t motors_direction)
-{
+typedef motors_state_t (*motors_handler_t)(motors_state_t current_state, const motors_plan_t &plan);
+typedef transition_table_t<motors_state_t, motors_transition_t, motors_handler_t> motors_table_t;
 
-    if (current_state == motors_state_t::UNINITIALIZED) {
-        if (motors_hw_init() != motor_hw_error_t::NO_ERROR) {
-            return motors_state_t::ERROR;
-        }
+static motors_state_t stay(motors_state_t current_state, const motors_plan_t &) { return current_state; }
 
-        return motors_state_t::STOPPED;
+static motors_state_t initialize(motors_state_t, const motors_plan_t &)
+{
+    if (motors_hw_init() != motor_hw_error_t::NO_ERROR) {
+        return motors_state_t::ERROR;
     }
 
-    // Transitions can be applied to any state,
-    // treat them globally outside of 'if(state==...){}' blocs to avoid repetition
-    if (transition == motors_transition_t::START_MOVE_CONTINUOUS) {
-        continuous_motors_direction = motors_direction;
-        motors_hw_start_move(motors_direction, true);
-        return motors_state_t::MOVING;
-    } else if (transition == motors_transition_t::START_MOVE_ONE_STEP) {
-        motors_hw_start_move(motors_direction, false);
-        return motors_state_t::MOVING;
-    } else if (transition == motors_transition_t::STOP) {
-        motors_hw_stop();
-        return motors_state_t::STOPPING;
-    }
+    return motors_state_t::STOPPED;
+}
 
-    if (current_state == motors_state_t::MOVING || current_state == motors_state_t::STOPPING) {
-        // STOPPING and MOVING states are treated the same way
-        auto hw_state = motor_hw_get_state();
-        if (hw_state == motor_hw_state_t::UNKNOWN) {
-            return motors_state_t::ERROR;
-        }
+static motors_state_t start_move_continuous(motors_state_t, const motors_plan_t &plan)
+{
+    continuous_motors_direction = plan.directions[0];
+    motors_hw_start_move_continuous(plan.directions[0]);
+    return motors_state_t::MOVING;
+}
 
-        if (hw_state == motor_hw_state_t::STOPPED) {
-            return motors_state_t::STOPPED;
-        }
+static motors_state_t start_move_steps(motors_state_t, const motors_plan_t &plan)
+{
+    motors_hw_start_move_steps(plan);
+    return motors_state_t::MOVING;
+}
 
-        // Stay in same state while motors are moving
-        return current_state;
-    }
+static motors_state_t stop(motors_state_t, const motors_plan_t &)
+{
+    motors_hw_stop();
+    return motors_state_t::STOPPING;
+}
 
-    if (transition != motors_transition_t::NONE) {
-        ESP_LOGW(TAG, "Nothing to do for state: '%s', transition: '%s'", str(current_state), str(transition));
+// STOPPING and MOVING states are treated the same way :
+// the motors controller notifies the end of the last command, the notification is received as a transition
+static motors_state_t hw_stopped(motors_state_t, const motors_plan_t &)
+{
+    return motors_state_t::STOPPED;
+}
+
+static motors_state_t hw_not_responding(motors_state_t, const motors_plan_t &)
+{
+    return motors_state_t::ERROR;
+}
+
+static constexpr auto ANY_STATE = motors_table_t::ANY_STATE;
+static constexpr auto ANY_TRANSITION = motors_table_t::ANY_TRANSITION;
+
+static constexpr motors_table_t::entry_t TRANSITIONS[] = {
+    // Hardware must be initialized first, whatever the transition
+    {motors_state_t::UNINITIALIZED, ANY_TRANSITION, initialize},
+    // Transitions can be applied to any other state
+    {ANY_STATE, motors_transition_t::START_MOVE_CONTINUOUS, start_move_continuous},
+    {ANY_STATE, motors_transition_t::START_MOVE_STEPS, start_move_steps},
+    {ANY_STATE, motors_transition_t::STOP, stop},
+    // Update without transition
+    {ANY_STATE, motors_transition_t::NONE, stay},
+    // Command notifications are only meaningful while moving or stopping
+    // (late notifications of a previous move are unhandled : they are only counted)
+    {ANY_STATE, motors_transition_t::HW_STOPPED, NULL},
+    {ANY_STATE, motors_transition_t::HW_NOT_RESPONDING, NULL},
+    {motors_state_t::MOVING, motors_transition_t::HW_STOPPED, hw_stopped},
+    {motors_state_t::STOPPING, motors_transition_t::HW_STOPPED, hw_stopped},
+    {motors_state_t::MOVING, motors_transition_t::HW_NOT_RESPONDING, hw_not_responding},
+    {motors_state_t::STOPPING, motors_transition_t::HW_NOT_RESPONDING, hw_not_responding},
+};
+
+static constexpr motors_table_t TABLE(TRANSITIONS);
+static_assert(TABLE.is_complete(), "each (state, transition) pair must have exactly one most specific entry");
+
+static unhandled_counter_t<static_cast<int>(motors_state_t::COUNT), static_cast<int>(motors_transition_t::COUNT)>
+    unhandled_counter;
+
+unsigned int motors_state_machine_get_unhandled_count() { return unhandled_counter.get_total(); }
+
+motors_state_t motors_state_machine_update(motors_state_t current_state,
+                                           motors_transition_t transition,
+                                           const motors_plan_t &plan)
+{
+    motors_handler_t handler = TABLE.get_handler(current_state, transition);
+    if (handler == NULL) {
+        unhandled_counter.record(current_state, transition);
+        return current_state;
     }
-    return current_state;
+    return handler(current_state, plan);
 }
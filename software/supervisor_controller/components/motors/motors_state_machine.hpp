@@ -4,57 +4,18 @@
 #pragma once
 
 #include "motors_direction.hpp"
+#include "transition_table.hpp"
 
-#include <assert.h>
+#define MOTORS_STATES(X) X(ERROR) X(UNINITIALIZED) X(STOPPED) X(MOVING) X(STOPPING)
+STATE_MACHINE_ENUM(motors_state_t, MOTORS_STATES)
 
-enum class motors_state_t : signed char {
-    ERROR = -1,
-    UNINITIALIZED = 0,
-    STOPPED,
-    MOVING,
-    STOPPING,
-};
+// HW_STOPPED and HW_NOT_RESPONDING are the notifications of the motors commands (stop or move) completion
+#define MOTORS_TRANSITIONS(X)                                                                                          \
+    X(NONE) X(STOP) X(START_MOVE_CONTINUOUS) X(START_MOVE_STEPS) X(HW_STOPPED) X(HW_NOT_RESPONDING)
+STATE_MACHINE_ENUM(motors_transition_t, MOTORS_TRANSITIONS)
 
-inline const char *str(motors_state_t state)
-{
-    switch (state) {
-    case motors_state_t::ERROR:
-        return "ERROR";
-    case motors_state_t::UNINITIALIZED:
-        return "UNINITIALIZED";
-    case motors_state_t::STOPPED:
-        return "STOPPED";
-    case motors_state_t::MOVING:
-        return "MOVING";
-    case motors_state_t::STOPPING:
-        return "STOPPING";
-    default:
-        assert(false);
-    }
-}
-
-enum class motors_transition_t : signed char {
-    NONE = 0,
-    STOP,
-    START_MOVE_CONTINUOUS,
-    START_MOVE_ONE_STEP,
-};
-
-inline const char *str(motors_transition_t transition)
-{
-    switch (transition) {
-    case motors_transition_t::NONE:
-        return "NONE";
-    case motors_transition_t::STOP:
-        return "STOP";
-    case motors_transition_t::START_MOVE_CONTINUOUS:
-        return "START_MOVE_CONTINUOUS";
-    case motors_transition_t::START_MOVE_ONE_STEP:
-        return "START_MOVE_ONE_STEP";
-    default:
-        assert(false);
-    }
-}
+// Number of (state, transition) pairs received by the state machine without anything to do, since startup
+unsigned int motors_state_machine_get_unhandled_count();
 
 // This function is not thread safe, the caller has the responsibility to :
 // - never call it concurrently
@@ -66,6 +27,7 @@ inline const char *str(motors_transition_t transition)
 // This function can start long-time processing functions but must returns quickly
 // so important future transitions can be treated quickly (motors manual move can
 // start quickly, even if a full image is being captured asynchronously)
+// 'plan' is the payload of START_MOVE_STEPS transition (START_MOVE_CONTINUOUS uses its first direction)
 motors_state_t motors_state_machine_update(motors_state_t current_state,
                                            motors_transition_t transition,
-                                           motors_direction_t motors_direction);
+                                           const motors_plan_t &plan);
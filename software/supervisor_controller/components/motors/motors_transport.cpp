@@ -0,0 +1,116 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "motors_transport.hpp"
+
+#include "esp_log.h" // replaced by stub/esp_log.h for tests on host
+
+static const char *TAG = "motors_transport";
+
+struct pending_request_t {
+    int id; // 0 if the slot is free
+    int64_t time_us;
+    int64_t deadline_us;
+    motors_transport_callback callback;
+};
+
+static pending_request_t pending_requests[MOTORS_TRANSPORT_MAX_PENDING_REQUESTS];
+static int last_id = 0;
+
+static motors_frame_decoder_t decoder = {};
+
+// Ids are encoded in one byte, 0 is reserved for requests without reply (and for free slots)
+static const int MAX_ID = 255;
+
+static void complete_request(pending_request_t &request, const motors_frame_t *reply)
+{
+    motors_transport_callback callback = request.callback;
+    int64_t time_us = request.time_us;
+    request.id = 0;
+    callback(reply, time_us);
+}
+
+int motors_transport_start_request(motors_frame_t request,
+                                   int64_t now_us,
+                                   int timeout_ms,
+                                   motors_transport_callback callback,
+                                   uint8_t *frame,
+                                   int frame_size)
+{
+    for (auto &pending_request : pending_requests) {
+        if (pending_request.id == 0) {
+            last_id = last_id % MAX_ID + 1;
+            request.request_id = last_id;
+            int size = motors_protocol_encode(request, frame, frame_size);
+            if (size == 0) {
+                return 0;
+            }
+            pending_request = {
+                .id = last_id,
+                .time_us = now_us,
+                .deadline_us = now_us + (int64_t)timeout_ms * 1000,
+                .callback = callback,
+            };
+            return size;
+        }
+    }
+    ESP_LOGW(TAG, "Too many pending requests, opcode %i is not sent", (int)request.opcode);
+    return 0;
+}
+
+static void receive_frame(const motors_frame_t &frame)
+{
+    if (frame.opcode != motors_opcode_t::REPLY) {
+        ESP_LOGW(TAG, "Unexpected frame opcode %i", (int)frame.opcode);
+        return;
+    }
+    for (auto &request : pending_requests) {
+        if (request.id != 0 && request.id == frame.request_id) {
+            complete_request(request, &frame);
+            return;
+        }
+    }
+    // (expected for cancelled requests)
+    ESP_LOGD(TAG, "Reply ignored : no pending request with id %i", (int)frame.request_id);
+}
+
+void motors_transport_receive(const uint8_t *data, int len)
+{
+    for (int i = 0; i < len; i++) {
+        motors_frame_t frame;
+        motors_decode_result_t result = motors_protocol_decode(decoder, data[i], frame);
+        if (result == motors_decode_result_t::FRAME) {
+            receive_frame(frame);
+        } else if (result == motors_decode_result_t::INVALID) {
+            ESP_LOGW(TAG, "Invalid frame ignored");
+        }
+    }
+}
+
+void motors_transport_cancel_requests()
+{
+    for (auto &request : pending_requests) {
+        request.id = 0;
+    }
+}
+
+void motors_transport_check_timeouts(int64_t now_us)
+{
+    for (auto &request : pending_requests) {
+        if (request.id != 0 && now_us > request.deadline_us) {
+            ESP_LOGW(TAG, "No reply to request %i", request.id);
+            complete_request(request, NULL);
+        }
+    }
+}
+
+int motors_transport_get_pending_count()
+{
+    int count = 0;
+    for (auto &request : pending_requests) {
+        if (request.id != 0) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,42 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include "motors_protocol.h" // shared with the motors controller (see ../../../motors_controller)
+
+#include <stdint.h>
+
+// Request/reply matching on the serial link with the motors controller, without esp32 dependency :
+// - a request is a binary frame with a request id (see motors_protocol.h)
+// - its reply is a REPLY frame with the same id, received in any number of chunks
+// - a reply completes the pending request with the same id, a request without reply completes on its timeout
+// These functions are not thread safe, the caller must serialize them
+
+static const int MOTORS_TRANSPORT_MAX_PENDING_REQUESTS = 4;
+
+// Called when a request completes : 'reply' is NULL if it timed out
+// 'request_time_us' is the time given when the request was started
+// (it's called from 'motors_transport_receive' or 'motors_transport_check_timeouts', so it must not start a request)
+typedef void (*motors_transport_callback)(const motors_frame_t *reply, int64_t request_time_us);
+
+// Register a new pending request and encode its frame (with a new request id), to be sent by the caller
+// Return the frame size, or 0 if too many requests are pending
+int motors_transport_start_request(motors_frame_t request,
+                                   int64_t now_us,
+                                   int timeout_ms,
+                                   motors_transport_callback callback,
+                                   uint8_t *frame,
+                                   int frame_size);
+
+// Decode received bytes, incrementally : each complete reply frame completes its request
+// (a reply with an unknown id, received after its request timed out or was cancelled, is ignored)
+void motors_transport_receive(const uint8_t *data, int len);
+
+// Forget all pending requests, without calling their callback (their late replies will be ignored)
+void motors_transport_cancel_requests();
+
+// Complete the pending requests whose timeout expired
+void motors_transport_check_timeouts(int64_t now_us);
+
+int motors_transport_get_pending_count();
@@ -0,0 +1,150 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+#include "motors_protocol.h"
+
+#include <vector>
+
+static motors_frame_t get_move_frame()
+{
+    motors_frame_t frame = {};
+    frame.opcode = motors_opcode_t::MOVE;
+    frame.request_id = 12;
+    frame.step_count = 2;
+    frame.motor_pins[0] = 153;
+    frame.motor_pins[1] = 102;
+    frame.max_times_ms[0] = 10000;
+    frame.max_times_ms[1] = 150;
+    frame.threshold = 200;
+    return frame;
+}
+
+static std::vector<uint8_t> encode(const motors_frame_t &frame)
+{
+    uint8_t buffer[MOTORS_PROTOCOL_MAX_FRAME_SIZE];
+    int size = motors_protocol_encode(frame, buffer, MOTORS_PROTOCOL_MAX_FRAME_SIZE);
+    return std::vector<uint8_t>(buffer, buffer + size);
+}
+
+// Decode all bytes, return the decoded frames count and the last decoded frame
+static int decode(motors_frame_decoder_t &decoder, const std::vector<uint8_t> &bytes, motors_frame_t &frame)
+{
+    int frame_count = 0;
+    for (uint8_t byte : bytes) {
+        if (motors_protocol_decode(decoder, byte, frame) == motors_decode_result_t::FRAME) {
+            frame_count++;
+        }
+    }
+    return frame_count;
+}
+
+TEST(crc8, []() {
+    // CRC-8 check value of the polynomial 0x07
+    const uint8_t data[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    EXPECT(motors_protocol_crc8(data, sizeof(data)) == 0xF4);
+});
+
+TEST(move_layout, []() {
+    std::vector<uint8_t> bytes = encode(get_move_frame());
+    EXPECT(bytes.size() == 20);
+    EXPECT(bytes[0] == MOTORS_PROTOCOL_SYNC);
+    EXPECT(bytes[1] == MOTORS_PROTOCOL_VERSION);
+    EXPECT(bytes[2] == static_cast<uint8_t>(motors_opcode_t::MOVE));
+    EXPECT(bytes[3] == 12);
+    EXPECT(bytes[4] == 2);
+    // All steps are sent, even unused ones
+    EXPECT(bytes[5] == 153 && bytes[6] == 102 && bytes[7] == 0 && bytes[8] == 0);
+    // Little-endian fields
+    EXPECT(bytes[9] == 0x10 && bytes[10] == 0x27); // 10000
+    EXPECT(bytes[11] == 150 && bytes[12] == 0);
+    EXPECT(bytes[13] == 0 && bytes[14] == 0 && bytes[15] == 0 && bytes[16] == 0);
+    EXPECT(bytes[17] == 200 && bytes[18] == 0);
+    EXPECT(bytes[19] == motors_protocol_crc8(&bytes[1], 18));
+});
+
+TEST(round_trip, []() {
+    motors_frame_decoder_t decoder = {};
+    motors_frame_t decoded;
+
+    EXPECT(decode(decoder, encode(get_move_frame()), decoded) == 1);
+    EXPECT(decoded.opcode == motors_opcode_t::MOVE);
+    EXPECT(decoded.request_id == 12);
+    EXPECT(decoded.step_count == 2);
+    EXPECT(decoded.motor_pins[0] == 153);
+    EXPECT(decoded.motor_pins[1] == 102);
+    EXPECT(decoded.max_times_ms[0] == 10000);
+    EXPECT(decoded.max_times_ms[1] == 150);
+    EXPECT(decoded.threshold == 200);
+
+    motors_frame_t reply = {};
+    reply.opcode = motors_opcode_t::REPLY;
+    reply.request_id = 255;
+    reply.running = 1;
+    std::vector<uint8_t> bytes = encode(reply);
+    EXPECT(bytes.size() == 6);
+    EXPECT(decode(decoder, bytes, decoded) == 1);
+    EXPECT(decoded.opcode == motors_opcode_t::REPLY);
+    EXPECT(decoded.request_id == 255);
+    EXPECT(decoded.running == 1);
+
+    motors_frame_t stop = {};
+    stop.opcode = motors_opcode_t::STOP;
+    EXPECT(encode(stop).size() == 5);
+});
+
+TEST(too_small_buffer, []() {
+    uint8_t buffer[MOTORS_PROTOCOL_MAX_FRAME_SIZE - 1];
+    EXPECT(motors_protocol_encode(get_move_frame(), buffer, sizeof(buffer)) == 0);
+});
+
+TEST(corrupted_frames, []() {
+    motors_frame_decoder_t decoder = {};
+    motors_frame_t decoded;
+    std::vector<uint8_t> valid = encode(get_move_frame());
+
+    // Any corrupted byte after SYNC makes the frame invalid
+    for (size_t i = 1; i < valid.size(); i++) {
+        std::vector<uint8_t> corrupted = valid;
+        corrupted[i] ^= 0x01;
+        EXPECT(decode(decoder, corrupted, decoded) == 0);
+        // Decoder resynchronizes on the next frame
+        EXPECT(decode(decoder, valid, decoded) == 1);
+    }
+
+    // Unknown version
+    std::vector<uint8_t> bytes = valid;
+    bytes[1] = MOTORS_PROTOCOL_VERSION + 1;
+    EXPECT(decode(decoder, bytes, decoded) == 0);
+    EXPECT(decode(decoder, valid, decoded) == 1);
+});
+
+TEST(invalid_step_count, []() {
+    motors_frame_decoder_t decoder = {};
+    motors_frame_t decoded;
+
+    // Frames with a valid CRC but without step or with too many steps are invalid
+    motors_frame_t frame = get_move_frame();
+    frame.step_count = 0;
+    EXPECT(decode(decoder, encode(frame), decoded) == 0);
+    frame.step_count = MOTORS_PROTOCOL_MAX_STEPS + 1;
+    EXPECT(decode(decoder, encode(frame), decoded) == 0);
+    frame.step_count = MOTORS_PROTOCOL_MAX_STEPS;
+    EXPECT(decode(decoder, encode(frame), decoded) == 1);
+});
+
+TEST(bytes_outside_frames, []() {
+    motors_frame_decoder_t decoder = {};
+    motors_frame_t decoded;
+
+    // Text and noise between frames are ignored
+    std::vector<uint8_t> bytes = {'1', '2', ':', '0', '\n'};
+    std::vector<uint8_t> frame = encode(get_move_frame());
+    bytes.insert(bytes.end(), frame.begin(), frame.end());
+    bytes.push_back(0);
+    bytes.insert(bytes.end(), frame.begin(), frame.end());
+    EXPECT(decode(decoder, bytes, decoded) == 2);
+    EXPECT(!motors_protocol_is_decoding(decoder));
+});
+
+CREATE_MAIN_ENTRY_POINT();
@@ -7,95 +7,103 @@
 
 MINI_MOCK_FUNCTION(motors_hw_init, motor_hw_error_t, (), ());
 MINI_MOCK_FUNCTION(motors_hw_stop, void, (), ());
-MINI_MOCK_FUNCTION(motors_hw_start_move,
-                   void,
-                   (motors_direction_t direction, bool continuous),
-                   (direction, continuous));
-MINI_MOCK_FUNCTION(motor_hw_get_state, motor_hw_state_t, (), ());
+MINI_MOCK_FUNCTION(motors_hw_start_move_continuous, void, (motors_direction_t direction), (direction));
+MINI_MOCK_FUNCTION(motors_hw_start_move_steps, void, (const motors_plan_t &plan), (plan));
+
+static const motors_plan_t NO_PLAN = {};
 
 TEST(initialize, []() {
     // Nominal case : no hw error
     MINI_MOCK_ON_CALL(motors_hw_init, []() { return motor_hw_error_t::NO_ERROR; });
     motors_state_t state =
-        motors_state_machine_update(motors_state_t::UNINITIALIZED, motors_transition_t::NONE, motors_direction_t::NONE);
+        motors_state_machine_update(motors_state_t::UNINITIALIZED, motors_transition_t::NONE, NO_PLAN);
     EXPECT(state == motors_state_t::STOPPED);
 
     // With hardware error : report error
     MINI_MOCK_ON_CALL(motors_hw_init, []() { return motor_hw_error_t::CANNOT_USE_UART; });
-    state =
-        motors_state_machine_update(motors_state_t::UNINITIALIZED, motors_transition_t::NONE, motors_direction_t::NONE);
+    state = motors_state_machine_update(motors_state_t::UNINITIALIZED, motors_transition_t::NONE, NO_PLAN);
     EXPECT(state == motors_state_t::ERROR);
 });
 
 // Test typical "move" scenario as a single whole story, with nominal case and basic corner cases
 TEST(move, []() {
-    motors_direction_t DIRECTION_1 = motors_direction_t::UP_LEFT;
-    motors_direction_t DIRECTION_2 = motors_direction_t::UP;
-    motors_direction_t DIRECTION_3 = motors_direction_t::DOWN_RIGHT;
+    motors_plan_t PLAN_1 = motors_plan_one_step(motors_direction_t::UP_LEFT);
+    motors_plan_t PLAN_2 = {
+        .step_count = 3,
+        .directions = {motors_direction_t::UP_LEFT, motors_direction_t::UP_LEFT, motors_direction_t::UP},
+        .step_times_ms = {150, 150, 300},
+    };
+    motors_plan_t PLAN_3 = motors_plan_one_step(motors_direction_t::DOWN_RIGHT);
 
     // Start move from STOPPED state
-    MINI_MOCK_ON_CALL(motors_hw_start_move, [&](motors_direction_t direction, bool continuous) {
-        EXPECT(direction == DIRECTION_1);
-        EXPECT(!continuous);
+    MINI_MOCK_ON_CALL(motors_hw_start_move_steps, [&](const motors_plan_t &plan) {
+        EXPECT(plan.step_count == 1);
+        EXPECT(plan.directions[0] == motors_direction_t::UP_LEFT);
     });
     motors_state_t state =
-        motors_state_machine_update(motors_state_t::STOPPED, motors_transition_t::START_MOVE_ONE_STEP, DIRECTION_1);
+        motors_state_machine_update(motors_state_t::STOPPED, motors_transition_t::START_MOVE_STEPS, PLAN_1);
     EXPECT(state == motors_state_t::MOVING);
 
-    // Change direction while already moving
-    MINI_MOCK_ON_CALL(motors_hw_start_move, [&](motors_direction_t direction, bool continuous) {
-        EXPECT(direction == DIRECTION_2);
-        EXPECT(!continuous);
+    // Change plan while already moving : all steps are sent at once
+    MINI_MOCK_ON_CALL(motors_hw_start_move_steps, [&](const motors_plan_t &plan) {
+        EXPECT(plan.step_count == 3);
+        EXPECT(plan.directions[0] == motors_direction_t::UP_LEFT);
+        EXPECT(plan.directions[1] == motors_direction_t::UP_LEFT);
+        EXPECT(plan.directions[2] == motors_direction_t::UP);
+        EXPECT(plan.step_times_ms[2] == 300);
     });
-    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::START_MOVE_ONE_STEP, DIRECTION_2);
+    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::START_MOVE_STEPS, PLAN_2);
     EXPECT(state == motors_state_t::MOVING);
 
     // Start moving continuous while already moving
-    MINI_MOCK_ON_CALL(motors_hw_start_move, [&](motors_direction_t direction, bool continuous) {
-        EXPECT(direction == DIRECTION_3);
-        EXPECT(continuous);
-    });
-    state =
-        motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::START_MOVE_CONTINUOUS, DIRECTION_3);
+    MINI_MOCK_ON_CALL(motors_hw_start_move_continuous,
+                      [&](motors_direction_t direction) { EXPECT(direction == motors_direction_t::DOWN_RIGHT); });
+    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::START_MOVE_CONTINUOUS, PLAN_3);
     EXPECT(state == motors_state_t::MOVING);
 
-    // Update move : motors are still moving -> stay in state, do nothing
-    MINI_MOCK_ON_CALL(motor_hw_get_state, []() { return motor_hw_state_t::MOVING; });
-    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::NONE, motors_direction_t::NONE);
+    // Update move without notification : stay in state, do nothing
+    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::NONE, NO_PLAN);
     EXPECT(state == motors_state_t::MOVING);
 
-    // Update move : motors are stopped -> stopped
-    MINI_MOCK_ON_CALL(motor_hw_get_state, []() { return motor_hw_state_t::STOPPED; });
-    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::NONE, motors_direction_t::NONE);
+    // Motors controller notifies the end of the move -> stopped
+    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::HW_STOPPED, NO_PLAN);
     EXPECT(state == motors_state_t::STOPPED);
 
-    // Update move : motors do not reply -> go to error
-    MINI_MOCK_ON_CALL(motor_hw_get_state, []() { return motor_hw_state_t::UNKNOWN; });
-    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::NONE, motors_direction_t::NONE);
+    // Motors controller does not notify in time -> go to error
+    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::HW_NOT_RESPONDING, NO_PLAN);
     EXPECT(state == motors_state_t::ERROR);
 
     // Stop move
     MINI_MOCK_ON_CALL(motors_hw_stop, []() {});
-    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::STOP, motors_direction_t::NONE);
+    state = motors_state_machine_update(motors_state_t::MOVING, motors_transition_t::STOP, NO_PLAN);
     EXPECT(state == motors_state_t::STOPPING);
 });
 
 TEST(stopping, []() {
-    // Stopping : motors are still moving
-    MINI_MOCK_ON_CALL(motor_hw_get_state, []() { return motor_hw_state_t::MOVING; });
-    motors_state_t state =
-        motors_state_machine_update(motors_state_t::STOPPING, motors_transition_t::NONE, motors_direction_t::NONE);
+    // Stopping : stay in state until notified
+    motors_state_t state = motors_state_machine_update(motors_state_t::STOPPING, motors_transition_t::NONE, NO_PLAN);
     EXPECT(state == motors_state_t::STOPPING);
 
     // Stopping : motors are stopped
-    MINI_MOCK_ON_CALL(motor_hw_get_state, []() { return motor_hw_state_t::STOPPED; });
-    state = motors_state_machine_update(motors_state_t::STOPPING, motors_transition_t::NONE, motors_direction_t::NONE);
+    state = motors_state_machine_update(motors_state_t::STOPPING, motors_transition_t::HW_STOPPED, NO_PLAN);
     EXPECT(state == motors_state_t::STOPPED);
 
-    // Stopping : motors do not reply -> go to error
-    MINI_MOCK_ON_CALL(motor_hw_get_state, []() { return motor_hw_state_t::UNKNOWN; });
-    state = motors_state_machine_update(motors_state_t::STOPPING, motors_transition_t::NONE, motors_direction_t::NONE);
+    // Stopping : motors controller does not notify in time -> go to error
+    state = motors_state_machine_update(motors_state_t::STOPPING, motors_transition_t::HW_NOT_RESPONDING, NO_PLAN);
+    EXPECT(state == motors_state_t::ERROR);
+});
+
+TEST(late_hw_state, []() {
+    // Late notifications of a previous move are ignored, they are counted as unhandled
+    unsigned int unhandled_count = motors_state_machine_get_unhandled_count();
+    motors_state_t state =
+        motors_state_machine_update(motors_state_t::STOPPED, motors_transition_t::HW_STOPPED, NO_PLAN);
+    EXPECT(state == motors_state_t::STOPPED);
+    state = motors_state_machine_update(motors_state_t::STOPPED, motors_transition_t::HW_NOT_RESPONDING, NO_PLAN);
+    EXPECT(state == motors_state_t::STOPPED);
+    state = motors_state_machine_update(motors_state_t::ERROR, motors_transition_t::HW_STOPPED, NO_PLAN);
     EXPECT(state == motors_state_t::ERROR);
+    EXPECT(motors_state_machine_get_unhandled_count() == unhandled_count + 3);
 });
 
 CREATE_MAIN_ENTRY_POINT();
@@ -0,0 +1,135 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+#include "motors_transport.hpp"
+
+#include <string>
+#include <vector>
+
+static const int TIMEOUT_MS = 80;
+
+// Completed requests, in order : "<request_time>=<running>" ("<request_time>=timeout" if timed out)
+static std::string completed;
+
+static void on_reply(const motors_frame_t *reply, int64_t request_time_us)
+{
+    completed += std::to_string(request_time_us) + "=" + (reply != NULL ? std::to_string(reply->running) : "timeout")
+                 + ";";
+}
+
+// Start a request at the given time and return its request id (0 if not started)
+static uint8_t start_request(int64_t now_us)
+{
+    motors_frame_t request = {.opcode = motors_opcode_t::STATE};
+    uint8_t frame[MOTORS_PROTOCOL_MAX_FRAME_SIZE];
+    int size = motors_transport_start_request(request, now_us, TIMEOUT_MS, on_reply, frame, sizeof(frame));
+    if (size == 0) {
+        return 0;
+    }
+    EXPECT(frame[0] == MOTORS_PROTOCOL_SYNC);
+    EXPECT(frame[2] == static_cast<uint8_t>(motors_opcode_t::STATE));
+    return frame[3];
+}
+
+static std::vector<uint8_t> encode_reply(uint8_t request_id, uint8_t running)
+{
+    motors_frame_t reply = {.opcode = motors_opcode_t::REPLY, .request_id = request_id, .running = running};
+    uint8_t frame[MOTORS_PROTOCOL_MAX_FRAME_SIZE];
+    int size = motors_protocol_encode(reply, frame, sizeof(frame));
+    return std::vector<uint8_t>(frame, frame + size);
+}
+
+static void receive(const std::vector<uint8_t> &data) { motors_transport_receive(data.data(), data.size()); }
+
+// Complete all pending requests, so each test starts with an empty table
+static void reset()
+{
+    motors_transport_check_timeouts(INT64_MAX);
+    completed.clear();
+}
+
+TEST(request_reply, []() {
+    reset();
+    uint8_t id = start_request(1000);
+    EXPECT(id != 0);
+    EXPECT(motors_transport_get_pending_count() == 1);
+
+    // Reply received in several chunks
+    std::vector<uint8_t> reply = encode_reply(id, 1);
+    receive(std::vector<uint8_t>(reply.begin(), reply.begin() + 3));
+    EXPECT(completed.empty());
+    receive(std::vector<uint8_t>(reply.begin() + 3, reply.end()));
+    EXPECT(completed == "1000=1;");
+    EXPECT(motors_transport_get_pending_count() == 0);
+});
+
+TEST(out_of_order_replies, []() {
+    reset();
+    uint8_t id_1 = start_request(1000);
+    uint8_t id_2 = start_request(2000);
+    EXPECT(id_1 != id_2);
+    EXPECT(motors_transport_get_pending_count() == 2);
+
+    // Each reply completes its own request, whatever the order, even in a single chunk
+    std::vector<uint8_t> replies = encode_reply(id_2, 0);
+    std::vector<uint8_t> reply_1 = encode_reply(id_1, 1);
+    replies.insert(replies.end(), reply_1.begin(), reply_1.end());
+    receive(replies);
+    EXPECT(completed == "2000=0;1000=1;");
+});
+
+TEST(timeout, []() {
+    reset();
+    uint8_t id = start_request(1000);
+
+    motors_transport_check_timeouts(1000 + TIMEOUT_MS * 1000);
+    EXPECT(completed.empty());
+    motors_transport_check_timeouts(1000 + TIMEOUT_MS * 1000 + 1);
+    EXPECT(completed == "1000=timeout;");
+    EXPECT(motors_transport_get_pending_count() == 0);
+
+    // Late reply is ignored
+    receive(encode_reply(id, 1));
+    EXPECT(completed == "1000=timeout;");
+});
+
+TEST(cancel, []() {
+    reset();
+    uint8_t id = start_request(1000);
+    motors_transport_cancel_requests();
+    EXPECT(motors_transport_get_pending_count() == 0);
+
+    // Cancelled request never completes
+    receive(encode_reply(id, 0));
+    motors_transport_check_timeouts(INT64_MAX);
+    EXPECT(completed.empty());
+});
+
+TEST(invalid_frames, []() {
+    reset();
+    uint8_t id = start_request(1000);
+
+    // Corrupted frames, and text, are ignored
+    std::vector<uint8_t> corrupted = encode_reply(id, 0);
+    corrupted.back() ^= 0xFF;
+    receive(corrupted);
+    receive({'1', ':', '0', '\n'});
+    EXPECT(completed.empty());
+    EXPECT(motors_transport_get_pending_count() == 1);
+
+    // Next valid frame is still decoded
+    receive(encode_reply(id, 0));
+    EXPECT(completed == "1000=0;");
+});
+
+TEST(too_many_requests, []() {
+    reset();
+    for (int i = 0; i < MOTORS_TRANSPORT_MAX_PENDING_REQUESTS; i++) {
+        EXPECT(start_request(1000) != 0);
+    }
+    EXPECT(start_request(1000) == 0);
+    EXPECT(motors_transport_get_pending_count() == MOTORS_TRANSPORT_MAX_PENDING_REQUESTS);
+});
+
+CREATE_MAIN_ENTRY_POINT();
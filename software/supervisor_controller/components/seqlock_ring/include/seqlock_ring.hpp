@@ -0,0 +1,77 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include <atomic>
+
+// Fixed-size ring of the last pushed items, shared by any number of writers and readers
+// It's lock-free, so writers never wait (the oldest items are overwritten when the ring is full) :
+// - each writer reserves a sequence number by incrementing 'last_reserved_seq'
+// - it marks the slot as being written (seq 0), fills it, then publishes it by setting its seq
+// - a reader copies the slot and checks its seq before and after the copy,
+//   if the seq has changed, the slot has been overwritten during the copy
+// Items are copied, they must be trivially copyable
+template <typename Item, int SIZE> class seqlock_ring_t {
+  public:
+    // Fill the slot of a new item by calling 'write(Item &item)'
+    // Note : 'write' must not push in the same ring
+    template <typename Writer> void push(Writer write)
+    {
+        unsigned int seq = last_reserved_seq.fetch_add(1, std::memory_order_relaxed) + 1;
+        slot_t &slot = slots[seq % SIZE];
+
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        write(slot.item);
+        slot.seq.store(seq, std::memory_order_release);
+    }
+
+    // return the sequence number of the last pushed item (0 if no item has been pushed yet)
+    unsigned int get_last_seq() const { return last_reserved_seq.load(std::memory_order_relaxed); }
+
+    // Each reader has its own cursor : the sequence number of the last item it has read
+    // (0 to read all the items still in the ring)
+    // Read the item following 'cursor', return false if there is no more item (or if it's not published yet)
+    // 'dropped_count' is set to the number of items overwritten since 'cursor', they are skipped
+    bool read(unsigned int &cursor, Item &item, unsigned int &dropped_count) const
+    {
+        dropped_count = 0;
+        while (true) {
+            unsigned int last_seq = last_reserved_seq.load(std::memory_order_relaxed);
+            // (sequence number comparisons support wrap around)
+            if ((int)(last_seq - cursor) <= 0) {
+                return false;
+            }
+
+            unsigned int next_seq = cursor + 1;
+            unsigned int oldest_seq = last_seq > SIZE ? last_seq - SIZE + 1 : 1;
+            if ((int)(oldest_seq - next_seq) > 0) {
+                dropped_count += oldest_seq - next_seq;
+                cursor = oldest_seq - 1;
+                continue;
+            }
+
+            const slot_t &slot = slots[next_seq % SIZE];
+            if (slot.seq.load(std::memory_order_acquire) != next_seq) {
+                return false; // not published yet (or just overwritten, it will be seen as dropped next time)
+            }
+            item = slot.item;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != next_seq) {
+                continue; // overwritten during the copy, it's now seen as dropped
+            }
+            cursor = next_seq;
+            return true;
+        }
+    }
+
+  private:
+    struct slot_t {
+        std::atomic<unsigned int> seq = 0; // seq of the item in this slot, 0 while it's being written
+        Item item;
+    };
+
+    slot_t slots[SIZE]; // item 'seq' is in slot 'seq % SIZE'
+    std::atomic<unsigned int> last_reserved_seq = 0;
+};
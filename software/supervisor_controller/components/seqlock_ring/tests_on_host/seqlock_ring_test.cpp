@@ -0,0 +1,107 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+
+#include "seqlock_ring.hpp"
+
+#include <thread>
+#include <vector>
+
+static const int RING_SIZE = 8;
+
+struct test_item_t {
+    int values[16];
+};
+
+static void fill(test_item_t &item, int value)
+{
+    for (int &v : item.values) {
+        v = value;
+    }
+}
+
+TEST(read_nothing_from_empty_ring, []() {
+    seqlock_ring_t<test_item_t, RING_SIZE> ring;
+    unsigned int cursor = 0;
+    test_item_t item;
+    unsigned int dropped_count;
+    EXPECT(!ring.read(cursor, item, dropped_count));
+    EXPECT(cursor == 0);
+    EXPECT(dropped_count == 0);
+});
+
+TEST(items_are_read_in_push_order, []() {
+    seqlock_ring_t<test_item_t, RING_SIZE> ring;
+    ring.push([](test_item_t &item) { fill(item, 1); });
+    ring.push([](test_item_t &item) { fill(item, 2); });
+    EXPECT(ring.get_last_seq() == 2);
+
+    unsigned int cursor = 0;
+    test_item_t item;
+    unsigned int dropped_count;
+    EXPECT(ring.read(cursor, item, dropped_count));
+    EXPECT(item.values[0] == 1);
+    EXPECT(cursor == 1);
+    EXPECT(ring.read(cursor, item, dropped_count));
+    EXPECT(item.values[0] == 2);
+    EXPECT(cursor == 2);
+    EXPECT(!ring.read(cursor, item, dropped_count));
+});
+
+TEST(overwritten_items_are_counted, []() {
+    seqlock_ring_t<test_item_t, RING_SIZE> ring;
+    for (int i = 1; i <= RING_SIZE + 3; i++) {
+        ring.push([i](test_item_t &item) { fill(item, i); });
+    }
+
+    unsigned int cursor = 0;
+    test_item_t item;
+    unsigned int dropped_count;
+    EXPECT(ring.read(cursor, item, dropped_count));
+    EXPECT(dropped_count == 3);
+    EXPECT(item.values[0] == 4);
+    EXPECT(cursor == 4);
+    EXPECT(ring.read(cursor, item, dropped_count));
+    EXPECT(dropped_count == 0);
+    EXPECT(item.values[0] == 5);
+});
+
+TEST(concurrent_writers_and_reader, []() {
+    static seqlock_ring_t<test_item_t, RING_SIZE> ring;
+    static const int WRITER_COUNT = 4;
+    static const int ITEM_PER_WRITER = 10000;
+    static const unsigned int LAST_SEQ = WRITER_COUNT * ITEM_PER_WRITER;
+    std::vector<std::thread> writers;
+    for (int w = 0; w < WRITER_COUNT; w++) {
+        writers.emplace_back([w]() {
+            // Each writer fills its items with its own value, so a torn item can be detected
+            for (int i = 0; i < ITEM_PER_WRITER; i++) {
+                ring.push([w](test_item_t &item) { fill(item, w); });
+            }
+        });
+    }
+
+    // The reader stops at the last pushed item
+    unsigned int cursor = 0;
+    unsigned int read_count = 0;
+    test_item_t item;
+    unsigned int dropped_count;
+    while (cursor != LAST_SEQ) {
+        if (!ring.read(cursor, item, dropped_count)) {
+            read_count += dropped_count;
+            std::this_thread::yield();
+            continue;
+        }
+        read_count += dropped_count + 1;
+        for (int v : item.values) {
+            EXPECT(v == item.values[0]);
+        }
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    EXPECT(read_count == LAST_SEQ);
+});
+
+CREATE_MAIN_ENTRY_POINT();
@@ -0,0 +1,49 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include <assert.h>
+
+// Displayed values of the system status
+enum class status_field_t : char {
+    SUPERVISOR_STATE = 0,  // see supervisor_get_state
+    SUN_TRACKER_STATE,     // see sun_tracker_get_state
+    SUN_TRACKER_DETECTION, // see sun_tracker_get_detection_result
+    MOTORS_STATE,          // see motors_get_state
+    COUNT,                 // (number of fields, not a field)
+};
+
+// Convenient function for logging and serialization
+inline const char *str(status_field_t field)
+{
+    switch (field) {
+    case status_field_t::SUPERVISOR_STATE:
+        return "supervisor-state";
+    case status_field_t::SUN_TRACKER_STATE:
+        return "sun-tracker-state";
+    case status_field_t::SUN_TRACKER_DETECTION:
+        return "sun-tracker-detection";
+    case status_field_t::MOTORS_STATE:
+        return "motors-state";
+    default:
+        assert(false);
+    }
+}
+
+static const int STATUS_FIELD_COUNT = static_cast<int>(status_field_t::COUNT);
+
+// Consistent copy of all status fields
+// 'seq' is incremented at each change, so a client knows if its last snapshot is outdated
+struct status_snapshot_t {
+    unsigned int seq;
+    const char *values[STATUS_FIELD_COUNT]; // "?" until the field is set
+};
+
+// Set a field of the status, called by component tasks after each update
+// 'value' must be a static string (typically the result of a 'str' function)
+// Nothing is done if the value is unchanged, so it can be called at each update
+// Each change is also pushed as a STATE event (see event_ring.hpp)
+void status_snapshot_set(status_field_t field, const char *value);
+
+status_snapshot_t status_snapshot_get();
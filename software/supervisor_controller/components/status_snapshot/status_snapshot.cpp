@@ -0,0 +1,46 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "status_snapshot.hpp"
+#include "event_ring.hpp"
+
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+// Standard mutex is used instead of FreeRTOS one,
+// so this component can be tested on host (it relies on FreeRTOS on target)
+static std::mutex snapshot_mutex;
+static status_snapshot_t current_snapshot = {.seq = 0, .values = {"?", "?", "?", "?"}};
+static_assert(STATUS_FIELD_COUNT == 4, "initial values of 'current_snapshot' must be updated");
+
+static int get_field_index(status_field_t field)
+{
+    int index = static_cast<int>(field);
+    assert(index >= 0 && index < STATUS_FIELD_COUNT);
+    return index;
+}
+
+void status_snapshot_set(status_field_t field, const char *value)
+{
+    int index = get_field_index(field);
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex);
+        if (!strcmp(current_snapshot.values[index], value)) {
+            return;
+        }
+        current_snapshot.values[index] = value;
+        current_snapshot.seq++;
+    }
+
+    // Also push the change to event clients
+    char data[EVENT_DATA_SIZE];
+    int len = snprintf(data, sizeof(data), "{\"%s\":\"%s\"}", str(field), value);
+    event_ring_push(event_type_t::STATE, data, len);
+}
+
+status_snapshot_t status_snapshot_get()
+{
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    return current_snapshot;
+}
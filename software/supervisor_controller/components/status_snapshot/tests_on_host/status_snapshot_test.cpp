@@ -0,0 +1,29 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+
+#include "status_snapshot.hpp"
+
+#include <string.h>
+
+TEST(initial_values_are_unknown, []() {
+    status_snapshot_t snapshot = status_snapshot_get();
+    EXPECT(snapshot.seq == 0);
+    EXPECT(!strcmp(snapshot.values[static_cast<int>(status_field_t::MOTORS_STATE)], "?"));
+});
+
+TEST(seq_is_incremented_only_on_change, []() {
+    status_snapshot_set(status_field_t::SUPERVISOR_STATE, "IDLE");
+    status_snapshot_t snapshot = status_snapshot_get();
+    EXPECT(snapshot.seq == 1);
+    EXPECT(!strcmp(snapshot.values[static_cast<int>(status_field_t::SUPERVISOR_STATE)], "IDLE"));
+
+    status_snapshot_set(status_field_t::SUPERVISOR_STATE, "IDLE");
+    EXPECT(status_snapshot_get().seq == 1);
+
+    status_snapshot_set(status_field_t::SUPERVISOR_STATE, "SUN_TRACKING");
+    EXPECT(status_snapshot_get().seq == 2);
+});
+
+CREATE_MAIN_ENTRY_POINT();
@@ -27,7 +27,7 @@ Edge(chart, idle, start_cond_1, "->", "START / sun_tracker_logic_detect()")
 Edge(chart, idle_back, idle, "->")
 Edge(chart, start_cond_1, result_error, "-", "[else] / result=ERROR")
 Edge(chart, start_cond_1, start_cond_2, "->", "[detection.result==SUCCESS]")
-Edge(chart, start_cond_2, result_success, "-", "[detection.direction==NONE] / result=SUCCESS")
+Edge(chart, start_cond_2, result_success, "-", "[detection.plan.step_count==0] / result=SUCCESS")
 Edge(chart, start_cond_2, tracking, "->", "[else] / motors_start_move(direction)")
 Edge(chart, tracking, stopping, "->", "STOP")
 Edge(chart, stopping, idle_back, "-", "MOTORS_STOPPED / result=ABORTED", layout=EdgeLayout.RIGHT_RIGHT_CURVED)
@@ -13,6 +13,8 @@ const char *sun_tracker_get_state(); // for display and debug only
 
 const char *sun_tracker_get_detection_result(); // for display and debug only
 
+unsigned int sun_tracker_get_unhandled_transition_count(); // for instrumentation only
+
 void sun_tracker_init();
 
 void sun_tracker_start();
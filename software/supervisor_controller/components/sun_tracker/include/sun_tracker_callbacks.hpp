@@ -44,4 +44,5 @@ typedef std::function<void(sun_tracker_result_t)> sun_tracker_result_callback;
 // Note : full image is GRAYSCALE for optimization (time to capture, less conversions)
 // but target image is RGB88 to draw interresting things
 // the callback has the responsibility to check image format
-typedef std::function<void(CImg<unsigned char> &)> sun_tracker_image_callback;
+// 'target_area' is the detected target area in this image (-1 coordinates if not detected)
+typedef std::function<void(CImg<unsigned char> &, const rectangle_t &target_area)> sun_tracker_image_callback;
@@ -2,27 +2,29 @@
 // This code is distributed under GNU GPL v3 license
 
 #include "sun_tracker.hpp"
+#include "component_runtime.hpp"
+#include "event_ring.hpp"
 #include "motors.hpp"
+#include "status_snapshot.hpp"
+#include "sun_tracker_motion_model.hpp"
 #include "sun_tracker_state_machine.hpp"
 
 #include "esp_log.h"
 
-#include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
+#include <atomic>
 
 static const char *TAG = "sun_tracker";
 
 // This file is the public interface of the sun_tracker component
-// It does not implement logic by itself but provides thread safety to state_machine layer
-// It's accomplished by :
-// - preventing multiple simultaneous calls to state_machine functions
-//   by calling them from a dedicated task
-// - protecting state and transition values with a mutex
-static const int STATE_MUTEX_TIMEOUT_MS = 100;
-static SemaphoreHandle_t state_mutex;
-static const int INTER_UPDATE_DELAY_MS = 100;
-static sun_tracker_state_t current_state = sun_tracker_state_t::UNINITIALIZED;
-static sun_tracker_transition_t asked_transition = sun_tracker_transition_t::NONE;
+// It does not implement logic by itself, thread safety of the state_machine layer is provided by component_runtime
+// Transitions are flags accumulated until the next update (e.g. STOP and MOTORS_STOPPED can be treated together)
+static component_runtime_t<sun_tracker_state_t, sun_tracker_transition_t, no_payload_t, merge_policy_t::BITWISE_OR>
+    runtime(TAG, sun_tracker_state_t::UNINITIALIZED);
+// Update period of the states which capture and detect continuously (preview of the target detection)
+static const int POLLING_DELAY_MS = 100;
+// Last motors stop, written before posting MOTORS_STOPPED transition, so it's visible to the update treating it
+static std::atomic<int64_t> last_motors_stop_time_us = 0;
+static std::atomic<sun_tracker_detection_result_t> last_detection_result = sun_tracker_detection_result_t::UNKNOWN;
 static sun_tracker_result_callback result_callback = NULL;
 static sun_tracker_image_callback image_callback = NULL;
 
@@ -47,95 +49,78 @@ void publish_result(sun_tracker_result_t result)
     }
 }
 
-void publish_full_image(CImg<unsigned char> &full_image)
+// Called by the state machine after each detection
+void publish_full_image(CImg<unsigned char> &full_image, const rectangle_t &target_area)
 {
+    char data[EVENT_DATA_SIZE];
+    int len = snprintf(data,
+                       sizeof(data),
+                       "{\"result\":\"%s\",\"target\":[%i,%i,%i,%i]}",
+                       str(sun_tracker_state_machine_get_detection_result()),
+                       target_area.left_px,
+                       target_area.top_px,
+                       target_area.right_px,
+                       target_area.bottom_px);
+    event_ring_push(event_type_t::DETECTION, data, len);
+
     if (image_callback != NULL) {
-        image_callback(full_image);
+        image_callback(full_image, target_area);
     }
 }
 
-// This function must not be called from an ISR (interrupt service routine)
-// because mutex does not support it. Neither ESP32 doc nor FreeRTOS doc is clear
-// about what happens in this case, various forums seem to indicate that an 'abort()'
-// is triggered with an explanation message.
-const char *sun_tracker_get_state()
-{
-    assert(xSemaphoreTake(state_mutex, pdMS_TO_TICKS(STATE_MUTEX_TIMEOUT_MS)));
-    auto state = current_state;
-    xSemaphoreGive(state_mutex);
-    return str(state);
-}
+const char *sun_tracker_get_state() { return str(runtime.get_state()); }
 
-// This function must not be called from an ISR (interrupt service routine)
-// because mutex does not support it. Neither ESP32 doc nor FreeRTOS doc is clear
-// about what happens in this case, various forums seem to indicate that an 'abort()'
-// is triggered with an explanation message.
-const char *sun_tracker_get_detection_result()
-{
-    assert(xSemaphoreTake(state_mutex, pdMS_TO_TICKS(STATE_MUTEX_TIMEOUT_MS)));
-    auto result = sun_tracker_state_machine_get_detection_result();
-    xSemaphoreGive(state_mutex);
-    return str(result);
-}
+const char *sun_tracker_get_detection_result() { return str(last_detection_result.load()); }
 
-// Note : transition will be reset if state changes after this call
-void set_transition(sun_tracker_transition_t transition)
-{
-    assert(xSemaphoreTake(state_mutex, pdMS_TO_TICKS(STATE_MUTEX_TIMEOUT_MS)));
-    asked_transition = static_cast<sun_tracker_transition_t>(asked_transition | transition);
-    xSemaphoreGive(state_mutex);
-}
+unsigned int sun_tracker_get_unhandled_transition_count() { return sun_tracker_state_machine_get_unhandled_count(); }
 
-static void sun_tracker_task(void *arg)
+static sun_tracker_state_t sun_tracker_update(sun_tracker_state_t state,
+                                              sun_tracker_transition_t transition,
+                                              no_payload_t payload,
+                                              int &next_delay_ms)
 {
-    while (true) {
-        assert(xSemaphoreTake(state_mutex, pdMS_TO_TICKS(STATE_MUTEX_TIMEOUT_MS)));
-        sun_tracker_state_t state = current_state;
-        sun_tracker_transition_t transition = asked_transition;
-
-        // Reset asked transition :
-        // - it will be "consumed" by 'state_machine_update' outside of the mutex guard
-        // - one transition must not be treated multiple times by 'state_machine_update'
-        // - we allow another transition to be set while 'state_machine_update' is running
-        asked_transition = sun_tracker_transition_t::NONE;
-        xSemaphoreGive(state_mutex);
-
-        sun_tracker_result_t result;
-        sun_tracker_state_t new_state = sun_tracker_state_machine_update(state, transition, publish_full_image, result);
-
-        if (new_state != state) {
-            ESP_LOGI(
-                TAG, "update(state: %s, transition: %s) -> new_state: %s", str(state), str(transition), str(new_state));
-        }
-
-        assert(xSemaphoreTake(state_mutex, pdMS_TO_TICKS(STATE_MUTEX_TIMEOUT_MS)));
-        current_state = new_state;
-        publish_result(result);
-        xSemaphoreGive(state_mutex);
-
-        // Simple wait between state updates because :
-        // - don't need a strict period between state updates (don't use periodic timer)
-        // - don't need to treat event as fast as possible
-        vTaskDelay(pdMS_TO_TICKS(INTER_UPDATE_DELAY_MS));
+    motors_stopped_event_t motors_stop = {.time_us = last_motors_stop_time_us};
+    sun_tracker_result_t result;
+    sun_tracker_state_t new_state =
+        sun_tracker_state_machine_update(state, transition, motors_stop, publish_full_image, result);
+
+    if (new_state != state) {
+        ESP_LOGI(
+            TAG, "update(state: %s, transition: %s) -> new_state: %s", str(state), str(transition), str(new_state));
     }
+
+    publish_result(result);
+    last_detection_result = sun_tracker_state_machine_get_detection_result();
+
+    status_snapshot_set(status_field_t::SUN_TRACKER_STATE, str(new_state));
+    status_snapshot_set(status_field_t::SUN_TRACKER_DETECTION, str(last_detection_result.load()));
+
+    // Other states only change on asked transitions, no need to update them until the next one
+    // (don't need a strict period between state updates, so don't use periodic timer)
+    if (new_state == sun_tracker_state_t::IDLE) {
+        next_delay_ms = POLLING_DELAY_MS;
+    }
+    return new_state;
 }
 
 // Called by motors when motors just stopped
-void sun_tracker_motors_stopped() { set_transition(sun_tracker_transition_t::MOTORS_STOPPED); }
+// Stop event is recorded to process only the images captured after it
+void sun_tracker_motors_stopped(const motors_stopped_event_t &event)
+{
+    last_motors_stop_time_us = event.time_us;
+    runtime.post(sun_tracker_transition_t::MOTORS_STOPPED);
+}
 
 void sun_tracker_init()
 {
     ESP_LOGD(TAG, "sun_tracker_init");
 
-    assert(current_state == sun_tracker_state_t::UNINITIALIZED);
-
+    sun_tracker_motion_model_init();
     motors_register_stopped_callback(sun_tracker_motors_stopped);
 
-    state_mutex = xSemaphoreCreateMutex();
-
-    xTaskCreate(sun_tracker_task, TAG, 4 * 1024, NULL, 5, NULL);
+    runtime.start(sun_tracker_update);
 }
 
-void sun_tracker_start() { set_transition(sun_tracker_transition_t::START); }
+void sun_tracker_start() { runtime.post(sun_tracker_transition_t::START); }
 
-void sun_tracker_stop() { set_transition(sun_tracker_transition_t::STOP); }
+void sun_tracker_stop() { runtime.post(sun_tracker_transition_t::STOP); }
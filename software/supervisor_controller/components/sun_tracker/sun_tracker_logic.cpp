@@ -6,8 +6,11 @@
 #include "esp_log.h" // replaced by stub/esp_log.h for tests on host
 
 #include "camera.hpp"
+#include "deferred_log.hpp"
 #include "image.hpp"
+#include "metrics.hpp"
 #include "motors_direction.hpp"
+#include "sun_tracker_motion_model.hpp"
 #include "target_detector.hpp"
 
 #include <assert.h>
@@ -17,46 +20,59 @@ static const char *TAG = "sun_tracker_logic";
 static const int MIN_LIGHTED_PIXEL_LEVEL = 250;
 static const int MIN_LIGHTED_PIXELS_COUNT = 10;
 static const int MIN_SPOT_SIZE_PX = 20;
-static const int MAX_DISTANCE_FROM_TARGET_CENTER_PX = 5;
 static const unsigned char BLACK = 0;
 static const unsigned char WHITE = 255;
 
-rectangle_t get_vertical_segment(const CImg<unsigned char> &img, int x)
+// Number of lighted pixels in each column and each row of the target area
+// Allocated statically to avoid memory allocation at each detection
+static int lighted_pixels_per_column[CAMERA_WIDTH];
+static int lighted_pixels_per_row[CAMERA_HEIGHT];
+
+// Count lighted pixels of each column and each row of the given area in a single pass
+// Image is read row by row, directly in full image memory (no crop copy)
+void count_lighted_pixels(const CImg<unsigned char> &img, const rectangle_t &area, unsigned char min_level)
 {
-    assert(x >= 0);
-    assert(x < img.width());
-    return {
-        .left_px = x,
-        .top_px = 0,
-        .right_px = x,
-        .bottom_px = img.height() - 1,
-    };
+    int width = area.right_px - area.left_px + 1;
+    int height = area.bottom_px - area.top_px + 1;
+    assert(width <= CAMERA_WIDTH);
+    assert(height <= CAMERA_HEIGHT);
+
+    for (int x = 0; x < width; x++) {
+        lighted_pixels_per_column[x] = 0;
+    }
+
+    for (int y = 0; y < height; y++) {
+        const unsigned char *row = img.data(area.left_px, area.top_px + y);
+        int row_count = 0;
+        for (int x = 0; x < width; x++) {
+            int lighted = (row[x] >= min_level) ? 1 : 0;
+            row_count += lighted;
+            lighted_pixels_per_column[x] += lighted;
+        }
+        lighted_pixels_per_row[y] = row_count;
+    }
 }
 
-rectangle_t get_horizontal_segment(const CImg<unsigned char> &img, int y)
+// return the index of the first count greater than min_count, or -1 if not found
+int find_first_lighted(const int *counts, int size, int min_count)
 {
-    assert(y >= 0);
-    assert(y < img.height());
-    return {
-        .left_px = 0,
-        .top_px = y,
-        .right_px = img.width() - 1,
-        .bottom_px = y,
-    };
+    for (int i = 0; i < size; i++) {
+        if (counts[i] > min_count) {
+            return i;
+        }
+    }
+    return -1;
 }
 
-int count_lighted_pixels(const CImg<unsigned char> &img, rectangle_t rect, unsigned char min_level)
+// return the index of the last count greater than min_count, or -1 if not found
+int find_last_lighted(const int *counts, int size, int min_count)
 {
-    int result = 0;
-    for (int x = rect.left_px; x <= rect.right_px; x++) {
-        for (int y = rect.top_px; y <= rect.bottom_px; y++) {
-            unsigned char v = img(x, y);
-            if (v >= min_level) {
-                result++;
-            }
+    for (int i = size - 1; i >= 0; i--) {
+        if (counts[i] > min_count) {
+            return i;
         }
     }
-    return result;
+    return -1;
 }
 
 // return true if spot has been found
@@ -64,63 +80,43 @@ bool get_spot_light_rectangle(const CImg<unsigned char> &full_img,
                               rectangle_t &target_area,
                               rectangle_t &result_in_target_area)
 {
-    // TODO? work directly in full_img
-    CImg<unsigned char> target_img =
-        full_img.get_crop(target_area.left_px, target_area.top_px, target_area.right_px, target_area.bottom_px);
+    assert(target_area.left_px >= 0);
+    assert(target_area.top_px >= 0);
+    assert(target_area.right_px < full_img.width());
+    assert(target_area.bottom_px < full_img.height());
+
+    metrics_scoped_timer_t timer(metrics_stage_t::SPOT_DETECTION);
 
     result_in_target_area = {-1, -1, -1, -1};
 
-    cimg_forX(target_img, x)
-    {
-        rectangle_t segment = get_vertical_segment(target_img, x);
-        if (count_lighted_pixels(target_img, segment, MIN_LIGHTED_PIXEL_LEVEL) > MIN_LIGHTED_PIXELS_COUNT) {
-            result_in_target_area.left_px = x;
-            break;
-        }
-    }
+    count_lighted_pixels(full_img, target_area, MIN_LIGHTED_PIXEL_LEVEL);
+
+    int width = target_area.right_px - target_area.left_px + 1;
+    int height = target_area.bottom_px - target_area.top_px + 1;
+
+    result_in_target_area.left_px = find_first_lighted(lighted_pixels_per_column, width, MIN_LIGHTED_PIXELS_COUNT);
     if (result_in_target_area.left_px < 0) {
         return false;
     }
-    cimg_forX(target_img, x)
-    {
-        rectangle_t segment = get_vertical_segment(target_img, target_img.width() - x - 1);
-        if (count_lighted_pixels(target_img, segment, MIN_LIGHTED_PIXEL_LEVEL) > MIN_LIGHTED_PIXELS_COUNT) {
-            result_in_target_area.right_px = target_img.width() - x - 1;
-            break;
-        }
-    }
+    result_in_target_area.right_px = find_last_lighted(lighted_pixels_per_column, width, MIN_LIGHTED_PIXELS_COUNT);
     if (result_in_target_area.right_px < 0) {
         return false;
     }
-    cimg_forY(target_img, y)
-    {
-        rectangle_t segment = get_horizontal_segment(target_img, y);
-        if (count_lighted_pixels(target_img, segment, MIN_LIGHTED_PIXEL_LEVEL) > MIN_LIGHTED_PIXELS_COUNT) {
-            result_in_target_area.top_px = y;
-            break;
-        }
-    }
+    result_in_target_area.top_px = find_first_lighted(lighted_pixels_per_row, height, MIN_LIGHTED_PIXELS_COUNT);
     if (result_in_target_area.top_px < 0) {
         return false;
     }
-    cimg_forY(target_img, y)
-    {
-        rectangle_t segment = get_horizontal_segment(target_img, target_img.height() - y - 1);
-        if (count_lighted_pixels(target_img, segment, MIN_LIGHTED_PIXEL_LEVEL) > MIN_LIGHTED_PIXELS_COUNT) {
-            result_in_target_area.bottom_px = target_img.height() - y - 1;
-            break;
-        }
-    }
+    result_in_target_area.bottom_px = find_last_lighted(lighted_pixels_per_row, height, MIN_LIGHTED_PIXELS_COUNT);
     if (result_in_target_area.bottom_px < 0) {
         return false;
     }
 
-    ESP_LOGD(TAG,
-             "get_spot_light_rectangle: left_px: %i ; top_px: %i ; right_px: %i ; bottom_px: %i",
-             result_in_target_area.left_px,
-             result_in_target_area.top_px,
-             result_in_target_area.right_px,
-             result_in_target_area.bottom_px);
+    DEFERRED_LOGD(TAG,
+                  "get_spot_light_rectangle: left_px: %i ; top_px: %i ; right_px: %i ; bottom_px: %i",
+                  result_in_target_area.left_px,
+                  result_in_target_area.top_px,
+                  result_in_target_area.right_px,
+                  result_in_target_area.bottom_px);
     return true;
 }
 
@@ -147,7 +143,7 @@ void draw_motors_arrow(CImg<unsigned char> &image, sun_tracker_detection_t detec
     int arrow_x = 0;
     int arrow_y = 0;
 
-    switch (detection.direction) {
+    switch (detection.plan.directions[0]) {
     case motors_direction_t::UP:
         arrow_y = -10;
         break;
@@ -185,40 +181,12 @@ void draw_motors_arrow(CImg<unsigned char> &image, sun_tracker_detection_t detec
     image.draw_arrow(spot_x, spot_y, spot_x + arrow_x, spot_y + arrow_y, &BLACK, 1, 45, -20);
 }
 
-// Find the best motors direction to move away from lighted borders
-motors_direction_t get_best_motors_direction(sun_tracker_detection_t detection)
+spot_offset_t get_spot_offset(sun_tracker_detection_t detection)
 {
-    int target_center_x = detection.target_area.get_width_px() / 2;
-    int target_center_y = detection.target_area.get_height_px() / 2;
-    int spot_light_center_x = detection.spot_light.get_center_x_px();
-    int spot_light_center_y = detection.spot_light.get_center_y_px();
-    bool go_up = (spot_light_center_y > target_center_y + MAX_DISTANCE_FROM_TARGET_CENTER_PX);
-    bool go_down = (spot_light_center_y < target_center_y - MAX_DISTANCE_FROM_TARGET_CENTER_PX);
-    if (spot_light_center_x > target_center_x + MAX_DISTANCE_FROM_TARGET_CENTER_PX) {
-        if (go_up) {
-            return motors_direction_t::UP_LEFT;
-        } else if (go_down) {
-            return motors_direction_t::DOWN_LEFT;
-        } else {
-            return motors_direction_t::LEFT;
-        }
-    }
-    if (spot_light_center_x < target_center_x - MAX_DISTANCE_FROM_TARGET_CENTER_PX) {
-        if (go_up) {
-            return motors_direction_t::UP_RIGHT;
-        } else if (go_down) {
-            return motors_direction_t::DOWN_RIGHT;
-        } else {
-            return motors_direction_t::RIGHT;
-        }
-    }
-    if (go_down) {
-        return motors_direction_t::DOWN;
-    }
-    if (go_up) {
-        return motors_direction_t::UP;
-    }
-    return motors_direction_t::NONE;
+    return {
+        .x_px = detection.spot_light.get_center_x_px() - detection.target_area.get_width_px() / 2,
+        .y_px = detection.spot_light.get_center_y_px() - detection.target_area.get_height_px() / 2,
+    };
 }
 
 sun_tracker_detection_t sun_tracker_logic_detect(CImg<unsigned char> &full_img)
@@ -227,7 +195,9 @@ sun_tracker_detection_t sun_tracker_logic_detect(CImg<unsigned char> &full_img)
         .result = sun_tracker_detection_result_t::UNKNOWN,
         .target_area = {-1, -1, -1, -1},
         .spot_light = {-1, -1, -1, -1},
-        .direction = motors_direction_t::NONE,
+        .offset = {0, 0},
+        .plan = {}, // (no step)
+        .target_drift_px = -1,
     };
 
     if (!target_detector_detect(full_img, detection.target_area)) {
@@ -235,6 +205,7 @@ sun_tracker_detection_t sun_tracker_logic_detect(CImg<unsigned char> &full_img)
         ESP_LOGW(TAG, "sun_tracker_logic_detect: TARGET_NOT_DETECTED");
         return detection;
     }
+    detection.target_drift_px = target_detector_get_drift_px();
 
     if (!get_spot_light_rectangle(full_img, detection.target_area, detection.spot_light)) {
         detection.result = sun_tracker_detection_result_t::SPOT_NOT_DETECTED;
@@ -252,8 +223,15 @@ sun_tracker_detection_t sun_tracker_logic_detect(CImg<unsigned char> &full_img)
     }
 
     detection.result = sun_tracker_detection_result_t::SUCCESS;
-    detection.direction = get_best_motors_direction(detection);
-    ESP_LOGD(TAG, "sun_tracker_logic_detect: SUCCESS (direction: %s)", str(detection.direction));
+    detection.offset = get_spot_offset(detection);
+    detection.plan = sun_tracker_motion_model_get_plan(detection.offset);
+    DEFERRED_LOGD(TAG,
+                  "sun_tracker_logic_detect: SUCCESS (offset: %i, %i px ; steps: %i, first: %s during %i ms)",
+                  detection.offset.x_px,
+                  detection.offset.y_px,
+                  detection.plan.step_count,
+                  str(detection.plan.directions[0]),
+                  detection.plan.step_times_ms[0]);
 
     draw_motors_arrow(full_img, detection);
 
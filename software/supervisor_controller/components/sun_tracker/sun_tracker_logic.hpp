@@ -6,6 +6,7 @@
 #include "image.hpp"
 #include "motors_direction.hpp"
 #include "sun_tracker_detection_result.hpp"
+#include "sun_tracker_motion_model.hpp"
 
 #include <assert.h>
 
@@ -13,7 +14,9 @@ struct sun_tracker_detection_t {
     sun_tracker_detection_result_t result;
     rectangle_t target_area;
     rectangle_t spot_light; // relative to target_area
-    motors_direction_t direction;
+    spot_offset_t offset;   // spot light center offset from target area center
+    motors_plan_t plan;     // steps to move the spot light to the target center, no step if already centered
+    int target_drift_px;    // how far target moved since previous detection, -1 if unknown
 };
 
 // Detect target area and spot light rectangle
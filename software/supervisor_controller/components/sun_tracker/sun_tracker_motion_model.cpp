@@ -0,0 +1,121 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "sun_tracker_motion_model.hpp"
+
+#include "deferred_log.hpp"
+
+#include <algorithm>
+#include <stdlib.h>
+
+static const char *TAG = "sun_tracker_motion_model";
+
+// Initial gain : the spot light moves about 8 px during a 150 ms step
+// (underestimated on purpose : the first move must not overshoot the target center)
+static const int INITIAL_GAIN_PX_PER_S = 8 * 1000 / MOTORS_ONE_STEP_TIME_MS;
+
+// Shorter moves are not reliable (motors inertia)
+static const int MIN_STEP_TIME_MS = 30;
+// Longer moves are split in several moves, so a wrong gain cannot move the spot light far away
+static const int MAX_STEP_TIME_MS = 2000;
+
+// The spot light is considered centered below this distance (on each axis)
+// It's increased if the learned gain is so high that a minimal move could not get closer
+static const int MAX_DISTANCE_FROM_TARGET_CENTER_PX = 5;
+
+// One step direction moving the spot light toward the target center, indexed by the sign of the spot light offset
+// (+1 for each index) : [y sign][x sign]
+static const motors_direction_t DIRECTIONS[3][3] = {
+    {motors_direction_t::DOWN_RIGHT, motors_direction_t::DOWN, motors_direction_t::DOWN_LEFT},
+    {motors_direction_t::RIGHT, motors_direction_t::NONE, motors_direction_t::LEFT},
+    {motors_direction_t::UP_RIGHT, motors_direction_t::UP, motors_direction_t::UP_LEFT},
+};
+
+static motion_gains_t gains = {INITIAL_GAIN_PX_PER_S, INITIAL_GAIN_PX_PER_S};
+
+void sun_tracker_motion_model_init() { gains = {INITIAL_GAIN_PX_PER_S, INITIAL_GAIN_PX_PER_S}; }
+
+static int sign(int value) { return (value > 0) ? 1 : ((value < 0) ? -1 : 0); }
+
+// return the time to move the spot light by 'offset_px' on one axis, or 0 if it's already centered
+static int get_move_time_ms(int offset_px, int gain_px_per_s)
+{
+    int tolerance_px = std::max(MAX_DISTANCE_FROM_TARGET_CENTER_PX, gain_px_per_s * MIN_STEP_TIME_MS / 2000);
+    if (abs(offset_px) <= tolerance_px) {
+        return 0;
+    }
+    return std::clamp(abs(offset_px) * 1000 / gain_px_per_s, MIN_STEP_TIME_MS, MAX_STEP_TIME_MS);
+}
+
+static void add_step(motors_plan_t &plan, int sign_x, int sign_y, int time_ms)
+{
+    plan.directions[plan.step_count] = DIRECTIONS[sign_y + 1][sign_x + 1];
+    plan.step_times_ms[plan.step_count] = time_ms;
+    plan.step_count++;
+}
+
+motors_plan_t sun_tracker_motion_model_get_plan(const spot_offset_t &offset)
+{
+    int time_x_ms = get_move_time_ms(offset.x_px, gains.x_px_per_s);
+    int time_y_ms = get_move_time_ms(offset.y_px, gains.y_px_per_s);
+    int sign_x = sign(offset.x_px);
+    int sign_y = sign(offset.y_px);
+
+    motors_plan_t plan{};
+    int diagonal_time_ms = std::min(time_x_ms, time_y_ms);
+    if (diagonal_time_ms > 0) {
+        add_step(plan, sign_x, sign_y, diagonal_time_ms);
+    }
+    // (the remaining time is ignored if it's too short to move)
+    if (time_x_ms - diagonal_time_ms >= MIN_STEP_TIME_MS) {
+        add_step(plan, sign_x, 0, time_x_ms - diagonal_time_ms);
+    } else if (time_y_ms - diagonal_time_ms >= MIN_STEP_TIME_MS) {
+        add_step(plan, 0, sign_y, time_y_ms - diagonal_time_ms);
+    }
+    return plan;
+}
+
+static bool is_moving_x(motors_direction_t direction)
+{
+    return direction != motors_direction_t::NONE && direction != motors_direction_t::UP
+           && direction != motors_direction_t::DOWN;
+}
+
+static bool is_moving_y(motors_direction_t direction)
+{
+    return direction != motors_direction_t::NONE && direction != motors_direction_t::LEFT
+           && direction != motors_direction_t::RIGHT;
+}
+
+// Move the gain halfway to the observed one, if the spot light moved toward the target center
+static int learn_gain(int gain_px_per_s, int offset_before_px, int offset_after_px, int time_ms)
+{
+    int displacement_px = (offset_before_px - offset_after_px) * sign(offset_before_px);
+    if (time_ms == 0 || displacement_px <= 0) {
+        return gain_px_per_s;
+    }
+    int observed_gain_px_per_s = displacement_px * 1000 / time_ms;
+    return std::clamp((gain_px_per_s + observed_gain_px_per_s) / 2, MIN_GAIN_PX_PER_S, MAX_GAIN_PX_PER_S);
+}
+
+void sun_tracker_motion_model_learn(const spot_offset_t &offset_before,
+                                    const motors_plan_t &plan,
+                                    const spot_offset_t &offset_after)
+{
+    int time_x_ms = 0;
+    int time_y_ms = 0;
+    for (int i = 0; i < plan.step_count; i++) {
+        if (is_moving_x(plan.directions[i])) {
+            time_x_ms += plan.step_times_ms[i];
+        }
+        if (is_moving_y(plan.directions[i])) {
+            time_y_ms += plan.step_times_ms[i];
+        }
+    }
+
+    gains.x_px_per_s = learn_gain(gains.x_px_per_s, offset_before.x_px, offset_after.x_px, time_x_ms);
+    gains.y_px_per_s = learn_gain(gains.y_px_per_s, offset_before.y_px, offset_after.y_px, time_y_ms);
+    DEFERRED_LOGD(TAG, "learned gains: x: %i px/s ; y: %i px/s", gains.x_px_per_s, gains.y_px_per_s);
+}
+
+motion_gains_t sun_tracker_motion_model_get_gains() { return gains; }
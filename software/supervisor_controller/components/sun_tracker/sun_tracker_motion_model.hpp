@@ -0,0 +1,42 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include "motors_direction.hpp"
+
+// The motion model converts the spot light offset into motors run time on each axis.
+// The spot light speed of each axis (gain) is not known precisely : it depends on the panel, the motors and
+// the distance to the target. It's learned online from the spot light displacement observed after each move.
+
+// Spot light center offset from the target area center (image axes : x to the right, y to the bottom)
+struct spot_offset_t {
+    int x_px;
+    int y_px;
+};
+
+// Learned gains are kept in this range, so a wrong observation (spot light partly outside the target area,
+// motors at their end, etc.) cannot lead to absurd moves
+static const int MIN_GAIN_PX_PER_S = 10;
+static const int MAX_GAIN_PX_PER_S = 500;
+
+// Spot light speed on each axis when motors are running
+struct motion_gains_t {
+    int x_px_per_s;
+    int y_px_per_s;
+};
+
+// Reset the learned gains to their initial value
+void sun_tracker_motion_model_init();
+
+// return the plan to move the spot light to the target center, without any step if it's already centered
+// The plan has at most 2 steps : a diagonal step while both axes must move, then a straight step on the other axis
+motors_plan_t sun_tracker_motion_model_get_plan(const spot_offset_t &offset);
+
+// Update the gains with the spot light displacement observed after 'plan' execution
+// 'offset_before' is the offset the plan was computed from, 'offset_after' is the offset detected after the move
+void sun_tracker_motion_model_learn(const spot_offset_t &offset_before,
+                                    const motors_plan_t &plan,
+                                    const spot_offset_t &offset_after);
+
+motion_gains_t sun_tracker_motion_model_get_gains();
@@ -3,6 +3,7 @@
 
 #include "sun_tracker_state_machine.hpp"
 #include "sun_tracker_logic.hpp"
+#include "sun_tracker_motion_model.hpp"
 
 #include "esp_log.h" // replaced by stub/esp_log.h for tests on host
 
@@ -11,19 +12,22 @@
 
 static const char *TAG = "sun_tracker_state_machine";
 
-// Camera full image is created statically to avoid future memory allocations
-static CImg<unsigned char> full_img(CAMERA_WIDTH, CAMERA_HEIGHT, 1, 1);
-
 static int move_count = 0;
 
 static const int MAX_MOVES = 20;
 
+// Camera and target are fixed, target can only drift a little between two moves
+static const int MAX_TARGET_DRIFT_PX = 10;
+
+// Detection the last move has been computed from, to learn the motion model from the move result
+static sun_tracker_detection_t last_move_detection;
+
 static sun_tracker_detection_result_t last_detection_result = sun_tracker_detection_result_t::UNKNOWN;
 
 sun_tracker_detection_result_t sun_tracker_state_machine_get_detection_result() { return last_detection_result; }
 
 // return true if MAX_MOVES has been reached
-bool increment_move_count()
+static bool increment_move_count()
 {
     move_count++;
     ESP_LOGD(TAG, "move %i", move_count);
@@ -34,107 +38,196 @@ bool increment_move_count()
     return false;
 }
 
-sun_tracker_state_t sun_tracker_state_machine_update(sun_tracker_state_t current_state,
-                                                     sun_tracker_transition_t transition,
+typedef sun_tracker_state_t (*sun_tracker_handler_t)(sun_tracker_state_t current_state,
+                                                     const motors_stopped_event_t &last_motors_stop,
                                                      sun_tracker_image_callback publish_full_image,
-                                                     sun_tracker_result_t &result)
+                                                     sun_tracker_result_t &result);
+typedef transition_table_t<sun_tracker_state_t,
+                           sun_tracker_transition_t,
+                           sun_tracker_handler_t,
+                           static_cast<int>(sun_tracker_state_t::COUNT),
+                           SUN_TRACKER_TRANSITION_COUNT>
+    sun_tracker_table_t;
+
+static sun_tracker_state_t stay(sun_tracker_state_t current_state,
+                                const motors_stopped_event_t &,
+                                sun_tracker_image_callback,
+                                sun_tracker_result_t &)
 {
-    result = sun_tracker_result_t::UNKNOWN;
+    return current_state;
+}
+
+// Nothing to do but signal state_machine has started by quitting UNINITIALIZED state
+static sun_tracker_state_t initialize(sun_tracker_state_t,
+                                      const motors_stopped_event_t &,
+                                      sun_tracker_image_callback,
+                                      sun_tracker_result_t &)
+{
+    return sun_tracker_state_t::IDLE;
+}
 
-    if (current_state == sun_tracker_state_t::UNINITIALIZED) {
-        // Nothing to do but signal state_machine has started by quitting UNINITIALIZED state
+// Capture and detect, return false if detection failed
+static bool detect(int64_t min_timestamp_us,
+                   sun_tracker_image_callback publish_full_image,
+                   sun_tracker_detection_t &detection,
+                   sun_tracker_result_t &result)
+{
+    // Captured frame shares camera memory, it's released when leaving this function
+    camera_frame_t frame;
+    if (!camera_capture(min_timestamp_us, frame)) {
+        ESP_LOGE(TAG, "Camera capture failed");
+        result = sun_tracker_result_t::ERROR;
+        return false;
+    }
+
+    detection = sun_tracker_logic_detect(frame.image);
+    last_detection_result = detection.result;
+
+    // Publish full image after detection for debug purpose
+    publish_full_image(frame.image, detection.target_area);
+
+    if (detection.result != sun_tracker_detection_result_t::SUCCESS) {
+        result = sun_tracker_result_t::ERROR;
+        return false;
+    }
+    return true;
+}
+
+// Move along the detected plan, or stop tracking if the spot is on target or MAX_MOVES is reached
+static sun_tracker_state_t move_or_stop_tracking(const sun_tracker_detection_t &detection, sun_tracker_result_t &result)
+{
+    if (detection.plan.step_count == 0) {
+        result = sun_tracker_result_t::SUCCESS;
+        move_count = 0;
+        return sun_tracker_state_t::IDLE;
+    } else if (increment_move_count()) {
+        result = sun_tracker_result_t::MAX_MOVES;
+        move_count = 0;
         return sun_tracker_state_t::IDLE;
+    } else {
+        last_move_detection = detection;
+        motors_start_move_steps(detection.plan);
+        return sun_tracker_state_t::TRACKING;
     }
+}
+
+// Detection is done continuously in IDLE state (preview of the target detection)
+// In case of error, stay in IDLE state to allow user to fix target or spot
+static sun_tracker_state_t update_preview(sun_tracker_state_t,
+                                          const motors_stopped_event_t &,
+                                          sun_tracker_image_callback publish_full_image,
+                                          sun_tracker_result_t &result)
+{
+    sun_tracker_detection_t detection;
+    detect(0, publish_full_image, detection, result);
+    return sun_tracker_state_t::IDLE;
+}
 
-    if (current_state == sun_tracker_state_t::IDLE) {
-        if (!camera_capture(false, full_img)) {
-            ESP_LOGE(TAG, "Camera capture failed");
-            result = sun_tracker_result_t::ERROR;
-            return sun_tracker_state_t::IDLE;
-        }
-
-        sun_tracker_detection_t detection = sun_tracker_logic_detect(full_img);
-        last_detection_result = detection.result;
-
-        // Publish full image after detection for debug purpose
-        publish_full_image(full_img);
-
-        if (detection.result != sun_tracker_detection_result_t::SUCCESS) {
-            // Stay in IDLE state to allow user to fix target or spot
-            result = sun_tracker_result_t::ERROR;
-            return sun_tracker_state_t::IDLE;
-        }
-
-        if (transition & sun_tracker_transition_t::START) {
-            if (detection.direction == motors_direction_t::NONE) {
-                result = sun_tracker_result_t::SUCCESS;
-                move_count = 0;
-                return sun_tracker_state_t::IDLE;
-            } else if (increment_move_count()) {
-                result = sun_tracker_result_t::MAX_MOVES;
-                move_count = 0;
-                return sun_tracker_state_t::IDLE;
-            } else {
-                motors_start_move_one_step(detection.direction);
-                return sun_tracker_state_t::TRACKING;
-            }
-        }
+static sun_tracker_state_t start_tracking(sun_tracker_state_t,
+                                          const motors_stopped_event_t &,
+                                          sun_tracker_image_callback publish_full_image,
+                                          sun_tracker_result_t &result)
+{
+    sun_tracker_detection_t detection;
+    if (!detect(0, publish_full_image, detection, result)) {
+        return sun_tracker_state_t::IDLE;
     }
+    return move_or_stop_tracking(detection, result);
+}
 
-    if (current_state == sun_tracker_state_t::TRACKING) {
-        if (transition & sun_tracker_transition_t::STOP) {
-            if (transition & sun_tracker_transition_t::MOTORS_STOPPED) {
-                // Particular case when both transitions have been triggered
-                result = sun_tracker_result_t::ABORTED;
-                move_count = 0;
-                return sun_tracker_state_t::IDLE;
-            }
-            return sun_tracker_state_t::STOPPING;
-        }
-        if (transition & sun_tracker_transition_t::MOTORS_STOPPED) {
-            if (!camera_capture(true, full_img)) {
-                ESP_LOGE(TAG, "Camera capture failed");
-                result = sun_tracker_result_t::ERROR;
-                return sun_tracker_state_t::IDLE;
-            }
-
-            sun_tracker_detection_t detection = sun_tracker_logic_detect(full_img);
-            last_detection_result = detection.result;
-
-            // Publish full image after detection for debug purpose
-            publish_full_image(full_img);
-
-            // TODO : check that target has not moved too much
-            if (detection.result != sun_tracker_detection_result_t::SUCCESS) {
-                result = sun_tracker_result_t::ERROR;
-                return sun_tracker_state_t::IDLE;
-            }
-
-            if (detection.direction == motors_direction_t::NONE) {
-                result = sun_tracker_result_t::SUCCESS;
-                move_count = 0;
-                return sun_tracker_state_t::IDLE;
-            } else if (increment_move_count()) {
-                result = sun_tracker_result_t::MAX_MOVES;
-                move_count = 0;
-                return sun_tracker_state_t::IDLE;
-            } else {
-                motors_start_move_one_step(detection.direction);
-                return sun_tracker_state_t::TRACKING;
-            }
-        }
+static sun_tracker_state_t update_tracking(sun_tracker_state_t,
+                                           const motors_stopped_event_t &last_motors_stop,
+                                           sun_tracker_image_callback publish_full_image,
+                                           sun_tracker_result_t &result)
+{
+    // Use the newest frame exposed after motors stopped (older frames can be blurred)
+    sun_tracker_detection_t detection;
+    if (!detect(last_motors_stop.time_us, publish_full_image, detection, result)) {
+        return sun_tracker_state_t::IDLE;
     }
 
-    if (current_state == sun_tracker_state_t::STOPPING) {
-        if (transition & sun_tracker_transition_t::MOTORS_STOPPED) {
-            result = sun_tracker_result_t::ABORTED;
-            move_count = 0;
-            return sun_tracker_state_t::IDLE;
-        }
+    if (detection.target_drift_px > MAX_TARGET_DRIFT_PX) {
+        ESP_LOGE(TAG, "Target moved too much (%i px)", detection.target_drift_px);
+        result = sun_tracker_result_t::ERROR;
+        return sun_tracker_state_t::IDLE;
     }
 
-    if (transition != sun_tracker_transition_t::NONE) {
-        ESP_LOGW(TAG, "Nothing to do for state: '%s', transition: '%s'", str(current_state), str(transition));
+    sun_tracker_motion_model_learn(last_move_detection.offset, last_move_detection.plan, detection.offset);
+
+    return move_or_stop_tracking(detection, result);
+}
+
+static sun_tracker_state_t stop_tracking(sun_tracker_state_t,
+                                         const motors_stopped_event_t &,
+                                         sun_tracker_image_callback,
+                                         sun_tracker_result_t &)
+{
+    return sun_tracker_state_t::STOPPING;
+}
+
+static sun_tracker_state_t abort_tracking(sun_tracker_state_t,
+                                          const motors_stopped_event_t &,
+                                          sun_tracker_image_callback,
+                                          sun_tracker_result_t &result)
+{
+    result = sun_tracker_result_t::ABORTED;
+    move_count = 0;
+    return sun_tracker_state_t::IDLE;
+}
+
+static constexpr auto ANY_TRANSITION = sun_tracker_table_t::ANY_TRANSITION;
+
+// Transitions are bitfields, so the table has an entry for each combination
+static constexpr sun_tracker_table_t::entry_t TRANSITIONS[] = {
+    {sun_tracker_state_t::UNINITIALIZED, ANY_TRANSITION, initialize},
+
+    // STOP and MOTORS_STOPPED are meaningless in IDLE state, but they don't prevent the preview update
+    {sun_tracker_state_t::IDLE, ANY_TRANSITION, update_preview},
+    {sun_tracker_state_t::IDLE, START, start_tracking},
+    {sun_tracker_state_t::IDLE, START | STOP, start_tracking},
+    {sun_tracker_state_t::IDLE, START | MOTORS_STOPPED, start_tracking},
+    {sun_tracker_state_t::IDLE, START | STOP | MOTORS_STOPPED, start_tracking},
+
+    {sun_tracker_state_t::TRACKING, NONE, stay},
+    {sun_tracker_state_t::TRACKING, START, NULL},
+    {sun_tracker_state_t::TRACKING, STOP, stop_tracking},
+    {sun_tracker_state_t::TRACKING, START | STOP, stop_tracking},
+    {sun_tracker_state_t::TRACKING, MOTORS_STOPPED, update_tracking},
+    {sun_tracker_state_t::TRACKING, START | MOTORS_STOPPED, update_tracking},
+    // Particular case when both transitions have been triggered
+    {sun_tracker_state_t::TRACKING, STOP | MOTORS_STOPPED, abort_tracking},
+    {sun_tracker_state_t::TRACKING, START | STOP | MOTORS_STOPPED, abort_tracking},
+
+    {sun_tracker_state_t::STOPPING, NONE, stay},
+    {sun_tracker_state_t::STOPPING, START, NULL},
+    {sun_tracker_state_t::STOPPING, STOP, NULL},
+    {sun_tracker_state_t::STOPPING, START | STOP, NULL},
+    {sun_tracker_state_t::STOPPING, MOTORS_STOPPED, abort_tracking},
+    {sun_tracker_state_t::STOPPING, START | MOTORS_STOPPED, abort_tracking},
+    {sun_tracker_state_t::STOPPING, STOP | MOTORS_STOPPED, abort_tracking},
+    {sun_tracker_state_t::STOPPING, START | STOP | MOTORS_STOPPED, abort_tracking},
+};
+
+static constexpr sun_tracker_table_t TABLE(TRANSITIONS);
+static_assert(TABLE.is_complete(), "each (state, transition) pair must have exactly one most specific entry");
+
+static unhandled_counter_t<static_cast<int>(sun_tracker_state_t::COUNT), SUN_TRACKER_TRANSITION_COUNT>
+    unhandled_counter;
+
+unsigned int sun_tracker_state_machine_get_unhandled_count() { return unhandled_counter.get_total(); }
+
+sun_tracker_state_t sun_tracker_state_machine_update(sun_tracker_state_t current_state,
+                                                     sun_tracker_transition_t transition,
+                                                     const motors_stopped_event_t &last_motors_stop,
+                                                     sun_tracker_image_callback publish_full_image,
+                                                     sun_tracker_result_t &result)
+{
+    result = sun_tracker_result_t::UNKNOWN;
+
+    sun_tracker_handler_t handler = TABLE.get_handler(current_state, transition);
+    if (handler == NULL) {
+        unhandled_counter.record(current_state, transition);
+        return current_state;
     }
-    return current_state;
+    return handler(current_state, last_motors_stop, publish_full_image, result);
 }
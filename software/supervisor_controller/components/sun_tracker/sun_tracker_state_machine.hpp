@@ -4,33 +4,13 @@
 #pragma once
 
 #include "camera.hpp"
+#include "motors.hpp"
 #include "sun_tracker_callbacks.hpp"
 #include "sun_tracker_detection_result.hpp"
+#include "transition_table.hpp"
 
-#include <assert.h>
-
-enum class sun_tracker_state_t : signed char {
-    UNINITIALIZED,
-    IDLE,
-    TRACKING,
-    STOPPING,
-};
-
-inline const char *str(sun_tracker_state_t state)
-{
-    switch (state) {
-    case sun_tracker_state_t::UNINITIALIZED:
-        return "UNINITIALIZED";
-    case sun_tracker_state_t::IDLE:
-        return "IDLE";
-    case sun_tracker_state_t::TRACKING:
-        return "TRACKING";
-    case sun_tracker_state_t::STOPPING:
-        return "STOPPING";
-    default:
-        assert(false);
-    }
-}
+#define SUN_TRACKER_STATES(X) X(UNINITIALIZED) X(IDLE) X(TRACKING) X(STOPPING)
+STATE_MACHINE_ENUM(sun_tracker_state_t, SUN_TRACKER_STATES)
 
 // Transitions are declared as bitfield to allow several different transitions
 // to be triggered while the state machine is processing the current state
@@ -39,13 +19,21 @@ inline const char *str(sun_tracker_state_t state)
 // - we must properly manage the case where 'STOP' and 'MOTORS_STOPPED' transitions
 // are triggered during the same single call of state_machine_update
 // because neither of these transition can be ignored
-enum sun_tracker_transition_t {
+enum sun_tracker_transition_t : signed char {
     NONE = 0,
     START = 1,
     STOP = 2,
     MOTORS_STOPPED = 4,
 };
 
+// Number of transition combinations (the transition table has an entry for each of them)
+static const int SUN_TRACKER_TRANSITION_COUNT = (START | STOP | MOTORS_STOPPED) + 1;
+
+constexpr sun_tracker_transition_t operator|(sun_tracker_transition_t left, sun_tracker_transition_t right)
+{
+    return static_cast<sun_tracker_transition_t>(static_cast<int>(left) | static_cast<int>(right));
+}
+
 inline const char *str(sun_tracker_transition_t transition)
 {
     switch (transition) {
@@ -65,6 +53,9 @@ inline const char *str(sun_tracker_transition_t transition)
 // for debug purpose
 sun_tracker_detection_result_t sun_tracker_state_machine_get_detection_result();
 
+// Number of (state, transition) pairs received by the state machine without anything to do, since startup
+unsigned int sun_tracker_state_machine_get_unhandled_count();
+
 // This function is not thread safe, the caller has the responsibility to :
 // - never call it concurrently
 // - cache sun_tracker state to give it (optionaly asynchronously) to external components
@@ -75,8 +66,10 @@ sun_tracker_detection_result_t sun_tracker_state_machine_get_detection_result();
 // This function can execute long-time processing functions,
 // the caller has the responsibility to run it in a separated task
 // and listen to external events and cache them asynchronously
+// 'last_motors_stop' is the event of the last 'MOTORS_STOPPED' transition
 // 'logic_result' output param is only for display purpose
 sun_tracker_state_t sun_tracker_state_machine_update(sun_tracker_state_t current_state,
                                                      sun_tracker_transition_t transition,
+                                                     const motors_stopped_event_t &last_motors_stop,
                                                      sun_tracker_image_callback publish_full_image,
                                                      sun_tracker_result_t &result);
@@ -7,6 +7,7 @@
 #include "sun_tracker_logic.hpp"
 
 MINI_MOCK_FUNCTION(target_detector_detect, bool, (CImg<unsigned char> & image, rectangle_t &target), (image, target));
+MINI_MOCK_FUNCTION(target_detector_get_drift_px, int, (), ());
 
 CImg<unsigned char> load_image_as_grayscale(const char *image_path)
 {
@@ -22,6 +23,7 @@ TEST(detect_spot_on_center, []() {
         target = {120, 195, 200, 250};
         return true;
     });
+    MINI_MOCK_ON_CALL(target_detector_get_drift_px, []() { return -1; });
 
     CImg<unsigned char> full_img = load_image_as_grayscale("spot_on_center.jpg");
 
@@ -33,7 +35,7 @@ TEST(detect_spot_on_center, []() {
     EXPECT(detection.spot_light.top_px == 10);
     EXPECT(detection.spot_light.right_px == 58);
     EXPECT(detection.spot_light.bottom_px == 46);
-    EXPECT(detection.direction == motors_direction_t::NONE);
+    EXPECT(detection.plan.step_count == 0);
 });
 
 TEST(detect_spot_on_left_border, []() {
@@ -41,6 +43,7 @@ TEST(detect_spot_on_left_border, []() {
         target = {140, 195, 200, 250};
         return true;
     });
+    MINI_MOCK_ON_CALL(target_detector_get_drift_px, []() { return -1; });
 
     CImg<unsigned char> full_img = load_image_as_grayscale("spot_on_center.jpg");
 
@@ -52,7 +55,8 @@ TEST(detect_spot_on_left_border, []() {
     EXPECT(detection.spot_light.top_px == 10);
     EXPECT(detection.spot_light.right_px == 38);
     EXPECT(detection.spot_light.bottom_px == 46);
-    EXPECT(detection.direction == motors_direction_t::RIGHT);
+    EXPECT(detection.plan.step_count == 1);
+    EXPECT(detection.plan.directions[0] == motors_direction_t::RIGHT);
 });
 
 TEST(detect_spot_to_small, []() {
@@ -60,6 +64,7 @@ TEST(detect_spot_to_small, []() {
         target = {140, 195, 200, 250};
         return true;
     });
+    MINI_MOCK_ON_CALL(target_detector_get_drift_px, []() { return -1; });
 
     CImg<unsigned char> full_img = load_image_as_grayscale("small_spot.jpg");
 
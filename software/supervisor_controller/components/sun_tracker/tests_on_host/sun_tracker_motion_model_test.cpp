@@ -0,0 +1,99 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+
+#include "sun_tracker_motion_model.hpp"
+
+#include <stdlib.h>
+
+static int get_expected_time_ms(int offset_px, int gain_px_per_s) { return abs(offset_px) * 1000 / gain_px_per_s; }
+
+TEST(spot_on_center, []() {
+    sun_tracker_motion_model_init();
+    motors_plan_t plan = sun_tracker_motion_model_get_plan({.x_px = 2, .y_px = -3});
+    EXPECT(plan.step_count == 0);
+});
+
+TEST(move_time_is_proportional_to_offset, []() {
+    sun_tracker_motion_model_init();
+    motion_gains_t gains = sun_tracker_motion_model_get_gains();
+
+    motors_plan_t plan = sun_tracker_motion_model_get_plan({.x_px = -20, .y_px = 0});
+    EXPECT(plan.step_count == 1);
+    EXPECT(plan.directions[0] == motors_direction_t::RIGHT);
+    EXPECT(plan.step_times_ms[0] == get_expected_time_ms(20, gains.x_px_per_s));
+
+    plan = sun_tracker_motion_model_get_plan({.x_px = 0, .y_px = 40});
+    EXPECT(plan.step_count == 1);
+    EXPECT(plan.directions[0] == motors_direction_t::UP);
+    EXPECT(plan.step_times_ms[0] == get_expected_time_ms(40, gains.y_px_per_s));
+
+    // Very far spot : the move is limited
+    plan = sun_tracker_motion_model_get_plan({.x_px = 1000, .y_px = 0});
+    EXPECT(plan.step_count == 1);
+    EXPECT(plan.directions[0] == motors_direction_t::LEFT);
+    EXPECT(plan.step_times_ms[0] < get_expected_time_ms(1000, gains.x_px_per_s));
+});
+
+TEST(diagonal_then_straight_step, []() {
+    sun_tracker_motion_model_init();
+    motion_gains_t gains = sun_tracker_motion_model_get_gains();
+
+    // Both axes move during the diagonal step, then only the farthest one
+    motors_plan_t plan = sun_tracker_motion_model_get_plan({.x_px = 40, .y_px = -20});
+    int time_x_ms = get_expected_time_ms(40, gains.x_px_per_s);
+    int time_y_ms = get_expected_time_ms(20, gains.y_px_per_s);
+    EXPECT(plan.step_count == 2);
+    EXPECT(plan.directions[0] == motors_direction_t::DOWN_LEFT);
+    EXPECT(plan.step_times_ms[0] == time_y_ms);
+    EXPECT(plan.directions[1] == motors_direction_t::LEFT);
+    EXPECT(plan.step_times_ms[1] == time_x_ms - time_y_ms);
+});
+
+TEST(learn_gains, []() {
+    sun_tracker_motion_model_init();
+    motion_gains_t initial_gains = sun_tracker_motion_model_get_gains();
+
+    // The spot light moved 30 px in 1 s on x axis, it did not move on y axis
+    motors_plan_t plan = motors_plan_one_step(motors_direction_t::RIGHT, 1000);
+    sun_tracker_motion_model_learn({.x_px = -40, .y_px = 3}, plan, {.x_px = -10, .y_px = 3});
+    motion_gains_t gains = sun_tracker_motion_model_get_gains();
+    EXPECT(gains.x_px_per_s == (initial_gains.x_px_per_s + 30) / 2);
+    EXPECT(gains.y_px_per_s == initial_gains.y_px_per_s);
+
+    // The spot light overshot the target center on y axis : 60 px in 500 ms
+    plan = motors_plan_one_step(motors_direction_t::DOWN, 500);
+    sun_tracker_motion_model_learn({.x_px = 0, .y_px = -40}, plan, {.x_px = 0, .y_px = 20});
+    EXPECT(sun_tracker_motion_model_get_gains().y_px_per_s == (initial_gains.y_px_per_s + 120) / 2);
+
+    // Learned gains are used for next plans
+    gains = sun_tracker_motion_model_get_gains();
+    plan = sun_tracker_motion_model_get_plan({.x_px = -20, .y_px = 0});
+    EXPECT(plan.step_times_ms[0] == get_expected_time_ms(20, gains.x_px_per_s));
+});
+
+TEST(ignore_wrong_observations, []() {
+    sun_tracker_motion_model_init();
+    motion_gains_t initial_gains = sun_tracker_motion_model_get_gains();
+
+    // The spot light moved away from the target center (motors at their end, etc.)
+    motors_plan_t plan = motors_plan_one_step(motors_direction_t::UP_LEFT, 200);
+    sun_tracker_motion_model_learn({.x_px = 20, .y_px = 20}, plan, {.x_px = 25, .y_px = 20});
+    motion_gains_t gains = sun_tracker_motion_model_get_gains();
+    EXPECT(gains.x_px_per_s == initial_gains.x_px_per_s);
+    EXPECT(gains.y_px_per_s == initial_gains.y_px_per_s);
+
+    // Absurd displacement : the gain is capped
+    for (int i = 0; i < 20; i++) {
+        sun_tracker_motion_model_learn({.x_px = 20, .y_px = 20}, plan, {.x_px = -5000, .y_px = 20});
+    }
+    gains = sun_tracker_motion_model_get_gains();
+    EXPECT(gains.x_px_per_s == MAX_GAIN_PX_PER_S);
+    EXPECT(gains.y_px_per_s == initial_gains.y_px_per_s);
+    // Even with the highest gain, the spot light can be centered with a minimal move
+    // (6 px is beyond the fixed 5 px tolerance, but a 30 ms move at 500 px/s would move 7 px)
+    EXPECT(sun_tracker_motion_model_get_plan({.x_px = 6, .y_px = 0}).step_count == 0);
+});
+
+CREATE_MAIN_ENTRY_POINT();
@@ -10,13 +10,19 @@
 
 MINI_MOCK_FUNCTION(camera_capture,
                    bool,
-                   (bool drop_current_image, CImg<unsigned char> &grayscale_cimg),
-                   (drop_current_image, grayscale_cimg));
+                   (int64_t min_timestamp_us, camera_frame_t &frame),
+                   (min_timestamp_us, frame));
 MINI_MOCK_FUNCTION(sun_tracker_logic_detect, sun_tracker_detection_t, (CImg<unsigned char> & full_img), (full_img));
-MINI_MOCK_FUNCTION(motors_start_move_one_step, void, (motors_direction_t direction), (direction));
+MINI_MOCK_FUNCTION(motors_start_move_steps, void, (const motors_plan_t &plan), (plan));
+MINI_MOCK_FUNCTION(sun_tracker_motion_model_learn,
+                   void,
+                   (const spot_offset_t &offset_before, const motors_plan_t &plan, const spot_offset_t &offset_after),
+                   (offset_before, plan, offset_after));
+
+static const motors_stopped_event_t MOTORS_STOP = {.time_us = 123456};
 
 // sun_tracker image callbacks are for display purpose only,
-void drop(CImg<unsigned char> &img) {}
+void drop(CImg<unsigned char> &img, const rectangle_t &target_area) {}
 
 TEST(typical_scenario, []() {
     CImg<unsigned char> img;
@@ -25,16 +31,18 @@ TEST(typical_scenario, []() {
     // Define common dummy mocks used for all tests bellow
     MINI_MOCK_ON_CALL(
         camera_capture,
-        [](bool drop_current_image, CImg<unsigned char> &img) {
+        [](int64_t min_timestamp_us, camera_frame_t &frame) {
+            // Only the images captured after motors stopped are expected in TRACKING state
+            EXPECT(min_timestamp_us == 0 || min_timestamp_us == MOTORS_STOP.time_us);
             // return dummy black image (not used because sun_tracker_logic is mocked)
-            img = CImg<unsigned char>(CAMERA_WIDTH, CAMERA_HEIGHT, 1, 1, 0);
+            frame.image.assign(CAMERA_WIDTH, CAMERA_HEIGHT, 1, 1, 0);
             return true;
         },
-        7);
+        8);
 
     // From 'UNINITIALIZED' state
     sun_tracker_state_t state = sun_tracker_state_machine_update(
-        sun_tracker_state_t::UNINITIALIZED, sun_tracker_transition_t::NONE, drop, result);
+        sun_tracker_state_t::UNINITIALIZED, sun_tracker_transition_t::NONE, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::UNKNOWN);
     EXPECT(state == sun_tracker_state_t::IDLE);
 
@@ -42,7 +50,8 @@ TEST(typical_scenario, []() {
     MINI_MOCK_ON_CALL(sun_tracker_logic_detect, [](CImg<unsigned char> &image) {
         return sun_tracker_detection_t{.result = sun_tracker_detection_result_t::SPOT_NOT_DETECTED};
     });
-    state = sun_tracker_state_machine_update(sun_tracker_state_t::IDLE, sun_tracker_transition_t::NONE, drop, result);
+    state = sun_tracker_state_machine_update(
+        sun_tracker_state_t::IDLE, sun_tracker_transition_t::NONE, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::ERROR);
     EXPECT(state == sun_tracker_state_t::IDLE);
 
@@ -50,7 +59,8 @@ TEST(typical_scenario, []() {
     MINI_MOCK_ON_CALL(sun_tracker_logic_detect, [](CImg<unsigned char> &image) {
         return sun_tracker_detection_t{.result = sun_tracker_detection_result_t::SPOT_NOT_DETECTED};
     });
-    state = sun_tracker_state_machine_update(sun_tracker_state_t::IDLE, sun_tracker_transition_t::START, drop, result);
+    state = sun_tracker_state_machine_update(
+        sun_tracker_state_t::IDLE, sun_tracker_transition_t::START, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::ERROR);
     EXPECT(state == sun_tracker_state_t::IDLE);
 
@@ -60,10 +70,11 @@ TEST(typical_scenario, []() {
             .result = sun_tracker_detection_result_t::SUCCESS,
             .target_area = {100, 200, 300, 400},
             .spot_light = {65, 5, 95, 35},
-            .direction = motors_direction_t::NONE,
+            .plan = {}, // (no step)
         };
     });
-    state = sun_tracker_state_machine_update(sun_tracker_state_t::IDLE, sun_tracker_transition_t::START, drop, result);
+    state = sun_tracker_state_machine_update(
+        sun_tracker_state_t::IDLE, sun_tracker_transition_t::START, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::SUCCESS);
     EXPECT(state == sun_tracker_state_t::IDLE);
 
@@ -73,13 +84,19 @@ TEST(typical_scenario, []() {
             .result = sun_tracker_detection_result_t::SUCCESS,
             .target_area = {100, 200, 300, 400},
             .spot_light = {65, 5, 95, 35},
-            .direction = motors_direction_t::DOWN_LEFT,
+            .offset = {-20, -70},
+            .plan = {.step_count = 2,
+                     .directions = {motors_direction_t::DOWN_LEFT, motors_direction_t::LEFT},
+                     .step_times_ms = {300, 100}},
         };
     });
-    MINI_MOCK_ON_CALL(motors_start_move_one_step, [](motors_direction_t motors_direction) {
-        EXPECT(motors_direction == motors_direction_t::DOWN_LEFT);
+    MINI_MOCK_ON_CALL(motors_start_move_steps, [](const motors_plan_t &plan) {
+        EXPECT(plan.step_count == 2);
+        EXPECT(plan.directions[0] == motors_direction_t::DOWN_LEFT);
+        EXPECT(plan.directions[1] == motors_direction_t::LEFT);
     });
-    state = sun_tracker_state_machine_update(sun_tracker_state_t::IDLE, sun_tracker_transition_t::START, drop, result);
+    state = sun_tracker_state_machine_update(
+        sun_tracker_state_t::IDLE, sun_tracker_transition_t::START, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::UNKNOWN);
     EXPECT(state == sun_tracker_state_t::TRACKING);
 
@@ -87,14 +104,24 @@ TEST(typical_scenario, []() {
     MINI_MOCK_ON_CALL(sun_tracker_logic_detect, [](CImg<unsigned char> &image) {
         return sun_tracker_detection_t{
             .result = sun_tracker_detection_result_t::SUCCESS,
-            .direction = motors_direction_t::DOWN,
+            .offset = {0, -10},
+            .plan = motors_plan_one_step(motors_direction_t::DOWN),
         };
     });
-    MINI_MOCK_ON_CALL(motors_start_move_one_step, [](motors_direction_t motors_direction) {
-        EXPECT(motors_direction == motors_direction_t::DOWN);
+    // The motion model learns from the previous move result
+    MINI_MOCK_ON_CALL(
+        sun_tracker_motion_model_learn,
+        [](const spot_offset_t &offset_before, const motors_plan_t &plan, const spot_offset_t &offset_after) {
+            EXPECT(offset_before.x_px == -20 && offset_before.y_px == -70);
+            EXPECT(plan.step_count == 2);
+            EXPECT(offset_after.x_px == 0 && offset_after.y_px == -10);
+        });
+    MINI_MOCK_ON_CALL(motors_start_move_steps, [](const motors_plan_t &plan) {
+        EXPECT(plan.step_count == 1);
+        EXPECT(plan.directions[0] == motors_direction_t::DOWN);
     });
     state = sun_tracker_state_machine_update(
-        sun_tracker_state_t::TRACKING, sun_tracker_transition_t::MOTORS_STOPPED, drop, result);
+        sun_tracker_state_t::TRACKING, sun_tracker_transition_t::MOTORS_STOPPED, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::UNKNOWN);
     EXPECT(state == sun_tracker_state_t::TRACKING);
 
@@ -104,8 +131,14 @@ TEST(typical_scenario, []() {
             .result = sun_tracker_detection_result_t::SUCCESS,
         };
     });
+    MINI_MOCK_ON_CALL(
+        sun_tracker_motion_model_learn,
+        [](const spot_offset_t &offset_before, const motors_plan_t &plan, const spot_offset_t &offset_after) {
+            EXPECT(offset_before.x_px == 0 && offset_before.y_px == -10);
+            EXPECT(plan.directions[0] == motors_direction_t::DOWN);
+        });
     state = sun_tracker_state_machine_update(
-        sun_tracker_state_t::TRACKING, sun_tracker_transition_t::MOTORS_STOPPED, drop, result);
+        sun_tracker_state_t::TRACKING, sun_tracker_transition_t::MOTORS_STOPPED, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::SUCCESS);
     EXPECT(state == sun_tracker_state_t::IDLE);
 
@@ -116,20 +149,33 @@ TEST(typical_scenario, []() {
         };
     });
     state = sun_tracker_state_machine_update(
-        sun_tracker_state_t::TRACKING, sun_tracker_transition_t::MOTORS_STOPPED, drop, result);
+        sun_tracker_state_t::TRACKING, sun_tracker_transition_t::MOTORS_STOPPED, MOTORS_STOP, drop, result);
+    EXPECT(result == sun_tracker_result_t::ERROR);
+    EXPECT(state == sun_tracker_state_t::IDLE);
+
+    // From 'TRACKING' state with 'MOTORS_STOPPED' transition, when target moved too much
+    MINI_MOCK_ON_CALL(sun_tracker_logic_detect, [](CImg<unsigned char> &image) {
+        return sun_tracker_detection_t{
+            .result = sun_tracker_detection_result_t::SUCCESS,
+            .plan = motors_plan_one_step(motors_direction_t::DOWN),
+            .target_drift_px = 50,
+        };
+    });
+    state = sun_tracker_state_machine_update(
+        sun_tracker_state_t::TRACKING, sun_tracker_transition_t::MOTORS_STOPPED, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::ERROR);
     EXPECT(state == sun_tracker_state_t::IDLE);
 
     // From 'TRACKING' state with 'STOP' transition
-    state =
-        sun_tracker_state_machine_update(sun_tracker_state_t::TRACKING, sun_tracker_transition_t::STOP, drop, result);
+    state = sun_tracker_state_machine_update(
+        sun_tracker_state_t::TRACKING, sun_tracker_transition_t::STOP, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::UNKNOWN);
     EXPECT(state == sun_tracker_state_t::STOPPING);
 
     // From 'TRACKING' state with 'STOP' and 'MOTORS_STOPPED' transitions
     sun_tracker_transition_t t = static_cast<sun_tracker_transition_t>(sun_tracker_transition_t::MOTORS_STOPPED
                                                                        | sun_tracker_transition_t::STOP);
-    state = sun_tracker_state_machine_update(sun_tracker_state_t::TRACKING, t, drop, result);
+    state = sun_tracker_state_machine_update(sun_tracker_state_t::TRACKING, t, MOTORS_STOP, drop, result);
     EXPECT(result == sun_tracker_result_t::ABORTED);
     EXPECT(state == sun_tracker_state_t::IDLE);
 });
@@ -0,0 +1,369 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+// Host benchmark of the vision pipeline stages (image conversions, target detection, spot light detection)
+// Usage : vision_pipeline_benchmark [iterations] [json_output_path]
+// - each stage is run 'iterations' times on test images and synthetic variants of them
+// - latency percentiles and heap allocations of each stage are written as JSON
+//   (in 'json_output_path', default : vision_pipeline_benchmark.json)
+// - a summary is printed for humans
+
+#include "camera.hpp"
+#include "image_conversion.hpp"
+#include "sun_tracker_logic.hpp"
+#include "synthetic_target.hpp"
+#include "target_detector.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+// Not exposed in sun_tracker_logic.hpp, but worth measuring on its own
+bool get_spot_light_rectangle(const CImg<unsigned char> &full_img,
+                              rectangle_t &target_area,
+                              rectangle_t &result_in_target_area);
+
+// Heap allocations are counted by replacing global operator new,
+// CImg and std containers allocate through it
+static long allocation_count = 0;
+static long allocated_bytes = 0;
+
+// Both operator new and new[] allocate with malloc, to match the free of the delete operators
+// (forwarding new[] to new triggers -Wmismatched-new-delete)
+static void *counted_malloc(size_t size)
+{
+    allocation_count++;
+    allocated_bytes += size;
+    void *p = malloc(size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new(size_t size) { return counted_malloc(size); }
+void *operator new[](size_t size) { return counted_malloc(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+struct stage_result_t {
+    std::string stage;
+    std::string input;
+    int iterations;
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double max_us;
+    double allocations_per_call;
+    double allocated_bytes_per_call;
+};
+
+static std::vector<stage_result_t> results;
+
+// return the given percentile of the sorted durations (nearest rank)
+static double percentile(const std::vector<double> &sorted_durations_us, int percent)
+{
+    int rank = (percent * (int)sorted_durations_us.size() + 99) / 100;
+    return sorted_durations_us[std::max(rank, 1) - 1];
+}
+
+// Run 'prepare' then measure 'run' at each iteration
+// 'prepare' is not measured (it's used to restore inputs modified by 'run')
+static void benchmark(const char *stage,
+                      const char *input,
+                      int iterations,
+                      std::function<void()> prepare,
+                      std::function<void()> run)
+{
+    std::vector<double> durations_us;
+    durations_us.reserve(iterations);
+    long stage_allocation_count = 0;
+    long stage_allocated_bytes = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        prepare();
+        long allocation_count_before = allocation_count;
+        long allocated_bytes_before = allocated_bytes;
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        stage_allocation_count += allocation_count - allocation_count_before;
+        stage_allocated_bytes += allocated_bytes - allocated_bytes_before;
+        durations_us.push_back(elapsed.count());
+    }
+
+    std::sort(durations_us.begin(), durations_us.end());
+    results.push_back({
+        .stage = stage,
+        .input = input,
+        .iterations = iterations,
+        .p50_us = percentile(durations_us, 50),
+        .p90_us = percentile(durations_us, 90),
+        .p99_us = percentile(durations_us, 99),
+        .max_us = durations_us.back(),
+        .allocations_per_call = (double)stage_allocation_count / iterations,
+        .allocated_bytes_per_call = (double)stage_allocated_bytes / iterations,
+    });
+    const stage_result_t &r = results.back();
+    printf("%-34s %-32s p50 %9.1f us  p99 %9.1f us  %6.1f alloc/call\n",
+           stage,
+           input,
+           r.p50_us,
+           r.p99_us,
+           r.allocations_per_call);
+}
+
+static void benchmark(const char *stage, const char *input, int iterations, std::function<void()> run)
+{
+    benchmark(stage, input, iterations, []() {}, run);
+}
+
+static bool write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        printf("Cannot write %s\n", path);
+        return false;
+    }
+    fprintf(file, "{\n  \"unit\": \"us\",\n  \"stages\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const stage_result_t &r = results[i];
+        fprintf(file,
+                "    {\"stage\": \"%s\", \"input\": \"%s\", \"iterations\": %i, \"p50\": %.1f, \"p90\": %.1f, "
+                "\"p99\": %.1f, \"max\": %.1f, \"allocations_per_call\": %.1f, \"allocated_bytes_per_call\": %.1f}%s\n",
+                r.stage.c_str(),
+                r.input.c_str(),
+                r.iterations,
+                r.p50_us,
+                r.p90_us,
+                r.p99_us,
+                r.max_us,
+                r.allocations_per_call,
+                r.allocated_bytes_per_call,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+// Test images and their synthetic variants
+
+static CImg<unsigned char> load_image_as_grayscale(const char *image_path)
+{
+    CImg<unsigned char> image(image_path);
+    if (image.spectrum() >= 3) {
+        return image.get_RGBtoYCbCr().get_channel(0);
+    }
+    return image;
+}
+
+// Camera sized image with the given image at its center, surrounded by uniform background
+static CImg<unsigned char> to_camera_size(const CImg<unsigned char> &image, unsigned char background)
+{
+    CImg<unsigned char> full_image(CAMERA_WIDTH, CAMERA_HEIGHT, 1, 1, background);
+    full_image.draw_image((CAMERA_WIDTH - image.width()) / 2, (CAMERA_HEIGHT - image.height()) / 2, image);
+    return full_image;
+}
+
+static CImg<unsigned char> with_low_contrast(const CImg<unsigned char> &image)
+{
+    CImg<unsigned char> result(image);
+    cimg_for(result, p, unsigned char) { *p = 80 + *p / 2; }
+    return result;
+}
+
+static CImg<unsigned char> with_noise(const CImg<unsigned char> &image)
+{
+    CImg<unsigned char> result(image);
+    cimg_for(result, p, unsigned char) { *p = (unsigned char)std::clamp(*p + rand() % 41 - 20, 0, 255); }
+    return result;
+}
+
+// Synthetic target with a spot light in its area
+static CImg<unsigned char> create_synthetic_target_image_with_spot(int offset_x, int offset_y)
+{
+    const unsigned char white = 255;
+    CImg<unsigned char> image = create_synthetic_target_image(offset_x, offset_y);
+    image.draw_circle(400 + offset_x, 300 + offset_y, 30, &white);
+    return image;
+}
+
+// Stages
+
+static void benchmark_image_conversions(int iterations)
+{
+    const int pixel_count = CAMERA_WIDTH * CAMERA_HEIGHT;
+    const char *input = "random_800x600";
+
+    std::vector<uint16_t> rgb565(pixel_count);
+    for (auto &p : rgb565) {
+        p = (uint16_t)rand();
+    }
+    camera_fb_t rgb565_frame{};
+    rgb565_frame.buf = (uint8_t *)rgb565.data();
+    rgb565_frame.len = 2 * pixel_count;
+    rgb565_frame.width = CAMERA_WIDTH;
+    rgb565_frame.height = CAMERA_HEIGHT;
+    rgb565_frame.format = PIXFORMAT_RGB565;
+
+    CImg<unsigned char> rgb888(CAMERA_WIDTH, CAMERA_HEIGHT, 1, 3);
+    benchmark("rgb565_frame_to_rgb888_cimg", input, iterations, [&]() {
+        rgb565_frame_to_rgb888_cimg(&rgb565_frame, rgb888);
+    });
+
+    std::vector<uint8_t> gray(pixel_count);
+    std::vector<uint16_t> rgb565_output(pixel_count);
+    camera_fb_t rgb565_output_frame{};
+    rgb565_output_frame.buf = (uint8_t *)rgb565_output.data();
+    benchmark("rgb888_cimg_to_rgb565_frame", input, iterations, [&]() {
+        rgb888_cimg_to_rgb565_frame(rgb888, &rgb565_output_frame);
+    });
+
+    // Input image is modified by the conversion, it's restored before each call
+    CImg<unsigned char> rgb888_copy(rgb888);
+    benchmark(
+        "rgb888_cimg_to_grayscale_quirc",
+        input,
+        iterations,
+        [&]() { rgb888_copy.assign(rgb888.data(), CAMERA_WIDTH, CAMERA_HEIGHT, 1, 3); },
+        [&]() { rgb888_cimg_to_grayscale_quirc(rgb888_copy, gray.data()); });
+
+    CImg<unsigned char> gray_img(gray.data(), CAMERA_WIDTH, CAMERA_HEIGHT);
+    std::vector<uint8_t> gray_buffer(pixel_count);
+    camera_fb_t gray_frame{};
+    benchmark("grayscale_cimg_to_grayscale_frame", input, iterations, [&]() {
+        gray_frame = grayscale_cimg_to_grayscale_frame(gray_img, gray_buffer.data());
+    });
+
+    CImg<unsigned char> gray_img_output(CAMERA_WIDTH, CAMERA_HEIGHT);
+    benchmark("grayscale_frame_to_grayscale_cimg", input, iterations, [&]() {
+        grayscale_frame_to_grayscale_cimg(&gray_frame, gray_img_output);
+    });
+
+    benchmark("grayscale_cimg_as_grayscale_frame", input, iterations, [&]() {
+        gray_frame = grayscale_cimg_as_grayscale_frame(gray_img);
+    });
+}
+
+// Set if a detection result is not the expected one (so the benchmark does not silently measure an error path)
+static bool unexpected_detection = false;
+
+// Full scan : detector state is reset before each detection
+// Tracking : detector searches around the previous target, which is slightly moved at each detection
+static void benchmark_target_detector(const char *input,
+                                      const CImg<unsigned char> &image,
+                                      bool expected_detection,
+                                      int iterations)
+{
+    CImg<unsigned char> work_image;
+    rectangle_t target;
+    bool detected = false;
+    benchmark(
+        "target_detector_detect",
+        input,
+        iterations,
+        [&]() {
+            target_detector_init();
+            work_image.assign(image);
+        },
+        [&]() { detected = target_detector_detect(work_image, target); });
+    if (detected != expected_detection) {
+        printf("%s : target %s\n", input, detected ? "detected but not expected" : "not detected");
+        unexpected_detection = true;
+    }
+}
+
+static void benchmark_target_detector_tracking(int iterations)
+{
+    const CImg<unsigned char> images[2] = {create_synthetic_target_image_with_spot(0, 0),
+                                           create_synthetic_target_image_with_spot(3, -2)};
+    CImg<unsigned char> work_image;
+    rectangle_t target;
+    int index = 0;
+
+    target_detector_init();
+    work_image.assign(images[0]);
+    if (!target_detector_detect(work_image, target)) {
+        printf("synthetic target not detected, tracking not measured\n");
+        unexpected_detection = true;
+        return;
+    }
+    benchmark(
+        "target_detector_detect (tracking)",
+        "synthetic_target_moving",
+        iterations,
+        [&]() {
+            index = 1 - index;
+            work_image.assign(images[index]);
+        },
+        [&]() { target_detector_detect(work_image, target); });
+}
+
+static void benchmark_spot_light(int iterations)
+{
+    CImg<unsigned char> image = load_image_as_grayscale("spot_on_center.jpg");
+    rectangle_t target_area = {120, 195, 200, 250};
+    rectangle_t spot_light;
+    benchmark("get_spot_light_rectangle", "spot_on_center.jpg", iterations, [&]() {
+        get_spot_light_rectangle(image, target_area, spot_light);
+    });
+
+    CImg<unsigned char> synthetic = create_synthetic_target_image_with_spot(0, 0);
+    rectangle_t synthetic_target_area = {250, 150, 550, 450};
+    benchmark("get_spot_light_rectangle", "synthetic_target", iterations, [&]() {
+        get_spot_light_rectangle(synthetic, synthetic_target_area, spot_light);
+    });
+}
+
+// Detection results are drawn in the image, so it's restored before each call
+static void benchmark_sun_tracker_logic(const char *input, const CImg<unsigned char> &image, int iterations)
+{
+    CImg<unsigned char> work_image;
+    benchmark(
+        "sun_tracker_logic_detect",
+        input,
+        iterations,
+        [&]() {
+            target_detector_init();
+            work_image.assign(image);
+        },
+        [&]() { sun_tracker_logic_detect(work_image); });
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 100;
+    const char *json_output_path = argc > 2 ? argv[2] : "vision_pipeline_benchmark.json";
+    srand(0);
+
+    CImg<unsigned char> correct = to_camera_size(load_image_as_grayscale("correct_capstones.jpg"), 255);
+    CImg<unsigned char> synthetic = create_synthetic_target_image_with_spot(0, 0);
+    CImg<unsigned char> spot_on_center = to_camera_size(load_image_as_grayscale("spot_on_center.jpg"), 0);
+
+    benchmark_image_conversions(iterations);
+
+    benchmark_target_detector("correct_capstones.jpg", correct, true, iterations);
+    benchmark_target_detector("correct_capstones_darker", with_low_contrast(correct), true, iterations);
+    benchmark_target_detector("correct_capstones_noisy", with_noise(correct), true, iterations);
+    benchmark_target_detector("synthetic_target", synthetic, true, iterations);
+    benchmark_target_detector("synthetic_target_noisy", with_noise(synthetic), true, iterations);
+    benchmark_target_detector(
+        "no_target", CImg<unsigned char>(CAMERA_WIDTH, CAMERA_HEIGHT, 1, 1, 128), false, iterations);
+    benchmark_target_detector_tracking(iterations);
+
+    benchmark_spot_light(iterations);
+
+    benchmark_sun_tracker_logic("synthetic_target", synthetic, iterations);
+    benchmark_sun_tracker_logic("synthetic_target_noisy", with_noise(synthetic), iterations);
+    benchmark_sun_tracker_logic("spot_on_center.jpg (no target)", spot_on_center, iterations);
+
+    return write_json(json_output_path) && !unexpected_detection ? 0 : 1;
+}
@@ -7,6 +7,8 @@
 
 const char *supervisor_get_state(); // for display and debug only
 
+unsigned int supervisor_get_unhandled_transition_count(); // for instrumentation only
+
 void supervisor_init();
 
 void supervisor_start_manual_move_continuous(motors_direction_t direction);
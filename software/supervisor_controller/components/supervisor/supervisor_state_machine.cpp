@@ -20,84 +20,175 @@ static int64_t start_waiting_time_ms = 0;
 
 static int retry_count = 0;
 
-supervisor_state_t supervisor_state_machine_update(supervisor_state_t current_state,
-                                                   supervisor_transition_t transition,
+typedef supervisor_state_t (*supervisor_handler_t)(supervisor_state_t current_state,
                                                    motors_direction_t motors_direction,
-                                                   int64_t time_ms)
+                                                   int64_t time_ms);
+typedef transition_table_t<supervisor_state_t, supervisor_transition_t, supervisor_handler_t> supervisor_table_t;
+
+static supervisor_state_t stay(supervisor_state_t current_state, motors_direction_t, int64_t)
 {
-    if (current_state == supervisor_state_t::UNINITIALIZED) {
-        // Nothing to do but signal state_machine has started by quitting UNINITIALIZED state
-        return supervisor_state_t::IDLE;
-    }
+    return current_state;
+}
 
-    if (current_state == supervisor_state_t::IDLE || current_state == supervisor_state_t::MANUAL_MOVING) {
-        if (transition == supervisor_transition_t::START_MANUAL_MOVE_ONE_STEP) {
-            motors_start_move_one_step(motors_direction);
-            return supervisor_state_t::MANUAL_MOVING;
-        } else if (transition == supervisor_transition_t::START_MANUAL_MOVE_CONTINUOUS) {
-            motors_start_move_continuous(motors_direction);
-            return supervisor_state_t::MANUAL_MOVING;
-        } else if (transition == supervisor_transition_t::START_SUN_TRACKING) {
-            retry_count = 0;
-            sun_tracker_start();
-            return supervisor_state_t::SUN_TRACKING;
-        }
-    }
+// Nothing to do but signal state_machine has started by quitting UNINITIALIZED state
+static supervisor_state_t initialize(supervisor_state_t, motors_direction_t, int64_t)
+{
+    return supervisor_state_t::IDLE;
+}
 
-    if (current_state == supervisor_state_t::MANUAL_MOVING) {
-        if (transition == supervisor_transition_t::STOP_OR_RESET) {
-            motors_stop();
-            // Stay in same state until MOTORS_STOPPED transition is treated
-            return current_state;
-        } else if (transition == supervisor_transition_t::MOTORS_STOPPED) {
-            return supervisor_state_t::IDLE;
-        }
-    }
+static supervisor_state_t go_idle(supervisor_state_t, motors_direction_t, int64_t)
+{
+    return supervisor_state_t::IDLE;
+}
 
-    if (current_state == supervisor_state_t::SUN_TRACKING) {
-        if (transition == supervisor_transition_t::STOP_OR_RESET) {
-            sun_tracker_stop();
-            // Stay in same state until SUN_TRACKING transition is treated
-            return current_state;
-        } else if (transition == supervisor_transition_t::SUN_TRACKING_MAX_MOVES) {
-            ESP_LOGE(TAG, "SUN_TRACKING_MAX_MOVES: go to error state immediately");
-            return supervisor_state_t::ERROR;
-        } else if (transition == supervisor_transition_t::SUN_TRACKING_ERROR) {
-            ESP_LOGW(TAG, "SUN_TRACKING_ERROR received: retry %i", retry_count);
-            if (retry_count++ > MAX_RETRY_ON_ERROR) {
-                ESP_LOGE(TAG, "MAX_RETRY_ON_ERROR reached: go to error state");
-                return supervisor_state_t::ERROR;
-            }
-
-            // Error is often caused by bad image acquisition
-            // (auto expo leading to bad capstone detection) or misdetected spot
-            // Retrying will help in major cases
-            sun_tracker_start();
-            return supervisor_state_t::SUN_TRACKING;
-        } else if (transition == supervisor_transition_t::SUN_TRACKING_ABORTED) {
-            return supervisor_state_t::IDLE;
-        } else if (transition == supervisor_transition_t::SUN_TRACKING_SUCCESS) {
-            start_waiting_time_ms = time_ms;
-            return supervisor_state_t::WAITING_SUN_MOVE;
-        }
-    }
+static supervisor_state_t start_manual_move_one_step(supervisor_state_t, motors_direction_t motors_direction, int64_t)
+{
+    motors_start_move_one_step(motors_direction);
+    return supervisor_state_t::MANUAL_MOVING;
+}
 
-    if (current_state == supervisor_state_t::WAITING_SUN_MOVE) {
-        if (transition == supervisor_transition_t::STOP_OR_RESET) {
-            return supervisor_state_t::IDLE;
-        } else if ((time_ms - start_waiting_time_ms) > WAITING_SUN_MOVE_DURATION_MS) {
-            retry_count = 0;
-            sun_tracker_start();
-            return supervisor_state_t::SUN_TRACKING;
-        }
-    }
+static supervisor_state_t start_manual_move_continuous(supervisor_state_t, motors_direction_t motors_direction, int64_t)
+{
+    motors_start_move_continuous(motors_direction);
+    return supervisor_state_t::MANUAL_MOVING;
+}
+
+static supervisor_state_t start_sun_tracking(supervisor_state_t, motors_direction_t, int64_t)
+{
+    retry_count = 0;
+    sun_tracker_start();
+    return supervisor_state_t::SUN_TRACKING;
+}
+
+static supervisor_state_t stop_manual_move(supervisor_state_t current_state, motors_direction_t, int64_t)
+{
+    motors_stop();
+    // Stay in same state until MOTORS_STOPPED transition is treated
+    return current_state;
+}
 
-    if (current_state == supervisor_state_t::ERROR) {
-        if (transition == supervisor_transition_t::STOP_OR_RESET) {
-            // Reset error and go back to IDLE
-            return supervisor_state_t::IDLE;
-        }
+static supervisor_state_t stop_sun_tracking(supervisor_state_t current_state, motors_direction_t, int64_t)
+{
+    sun_tracker_stop();
+    // Stay in same state until SUN_TRACKING transition is treated
+    return current_state;
+}
+
+static supervisor_state_t sun_tracking_max_moves(supervisor_state_t, motors_direction_t, int64_t)
+{
+    ESP_LOGE(TAG, "SUN_TRACKING_MAX_MOVES: go to error state immediately");
+    return supervisor_state_t::ERROR;
+}
+
+static supervisor_state_t sun_tracking_error(supervisor_state_t, motors_direction_t, int64_t)
+{
+    ESP_LOGW(TAG, "SUN_TRACKING_ERROR received: retry %i", retry_count);
+    if (retry_count++ > MAX_RETRY_ON_ERROR) {
+        ESP_LOGE(TAG, "MAX_RETRY_ON_ERROR reached: go to error state");
+        return supervisor_state_t::ERROR;
     }
 
+    // Error is often caused by bad image acquisition
+    // (auto expo leading to bad capstone detection) or misdetected spot
+    // Retrying will help in major cases
+    sun_tracker_start();
+    return supervisor_state_t::SUN_TRACKING;
+}
+
+static supervisor_state_t sun_tracking_success(supervisor_state_t, motors_direction_t, int64_t time_ms)
+{
+    start_waiting_time_ms = time_ms;
+    return supervisor_state_t::WAITING_SUN_MOVE;
+}
+
+static supervisor_state_t
+wait_sun_move(supervisor_state_t current_state, motors_direction_t motors_direction, int64_t time_ms)
+{
+    if ((time_ms - start_waiting_time_ms) > WAITING_SUN_MOVE_DURATION_MS) {
+        return start_sun_tracking(current_state, motors_direction, time_ms);
+    }
     return current_state;
 }
+
+static constexpr auto ANY_TRANSITION = supervisor_table_t::ANY_TRANSITION;
+
+// Each state lists all its transitions, so the completeness check detects a forgotten one
+// (NULL handler : the transition is unhandled in this state, nothing to do)
+static constexpr supervisor_table_t::entry_t TRANSITIONS[] = {
+    {supervisor_state_t::UNINITIALIZED, ANY_TRANSITION, initialize},
+
+    {supervisor_state_t::IDLE, supervisor_transition_t::NONE, stay},
+    {supervisor_state_t::IDLE, supervisor_transition_t::STOP_OR_RESET, NULL},
+    {supervisor_state_t::IDLE, supervisor_transition_t::START_MANUAL_MOVE_CONTINUOUS, start_manual_move_continuous},
+    {supervisor_state_t::IDLE, supervisor_transition_t::START_MANUAL_MOVE_ONE_STEP, start_manual_move_one_step},
+    {supervisor_state_t::IDLE, supervisor_transition_t::MOTORS_STOPPED, NULL},
+    {supervisor_state_t::IDLE, supervisor_transition_t::START_SUN_TRACKING, start_sun_tracking},
+    {supervisor_state_t::IDLE, supervisor_transition_t::SUN_TRACKING_ERROR, NULL},
+    {supervisor_state_t::IDLE, supervisor_transition_t::SUN_TRACKING_MAX_MOVES, NULL},
+    {supervisor_state_t::IDLE, supervisor_transition_t::SUN_TRACKING_ABORTED, NULL},
+    {supervisor_state_t::IDLE, supervisor_transition_t::SUN_TRACKING_SUCCESS, NULL},
+
+    {supervisor_state_t::MANUAL_MOVING, supervisor_transition_t::NONE, stay},
+    {supervisor_state_t::MANUAL_MOVING, supervisor_transition_t::STOP_OR_RESET, stop_manual_move},
+    {supervisor_state_t::MANUAL_MOVING,
+     supervisor_transition_t::START_MANUAL_MOVE_CONTINUOUS,
+     start_manual_move_continuous},
+    {supervisor_state_t::MANUAL_MOVING,
+     supervisor_transition_t::START_MANUAL_MOVE_ONE_STEP,
+     start_manual_move_one_step},
+    {supervisor_state_t::MANUAL_MOVING, supervisor_transition_t::MOTORS_STOPPED, go_idle},
+    {supervisor_state_t::MANUAL_MOVING, supervisor_transition_t::START_SUN_TRACKING, start_sun_tracking},
+    {supervisor_state_t::MANUAL_MOVING, supervisor_transition_t::SUN_TRACKING_ERROR, NULL},
+    {supervisor_state_t::MANUAL_MOVING, supervisor_transition_t::SUN_TRACKING_MAX_MOVES, NULL},
+    {supervisor_state_t::MANUAL_MOVING, supervisor_transition_t::SUN_TRACKING_ABORTED, NULL},
+    {supervisor_state_t::MANUAL_MOVING, supervisor_transition_t::SUN_TRACKING_SUCCESS, NULL},
+
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::NONE, stay},
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::STOP_OR_RESET, stop_sun_tracking},
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::START_MANUAL_MOVE_CONTINUOUS, NULL},
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::START_MANUAL_MOVE_ONE_STEP, NULL},
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::MOTORS_STOPPED, NULL},
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::START_SUN_TRACKING, NULL},
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::SUN_TRACKING_ERROR, sun_tracking_error},
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::SUN_TRACKING_MAX_MOVES, sun_tracking_max_moves},
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::SUN_TRACKING_ABORTED, go_idle},
+    {supervisor_state_t::SUN_TRACKING, supervisor_transition_t::SUN_TRACKING_SUCCESS, sun_tracking_success},
+
+    // The waiting delay is checked at each update, whatever the transition (except reset)
+    {supervisor_state_t::WAITING_SUN_MOVE, ANY_TRANSITION, wait_sun_move},
+    {supervisor_state_t::WAITING_SUN_MOVE, supervisor_transition_t::STOP_OR_RESET, go_idle},
+
+    {supervisor_state_t::ERROR, supervisor_transition_t::NONE, stay},
+    // Reset error and go back to IDLE
+    {supervisor_state_t::ERROR, supervisor_transition_t::STOP_OR_RESET, go_idle},
+    {supervisor_state_t::ERROR, supervisor_transition_t::START_MANUAL_MOVE_CONTINUOUS, NULL},
+    {supervisor_state_t::ERROR, supervisor_transition_t::START_MANUAL_MOVE_ONE_STEP, NULL},
+    {supervisor_state_t::ERROR, supervisor_transition_t::MOTORS_STOPPED, NULL},
+    {supervisor_state_t::ERROR, supervisor_transition_t::START_SUN_TRACKING, NULL},
+    {supervisor_state_t::ERROR, supervisor_transition_t::SUN_TRACKING_ERROR, NULL},
+    {supervisor_state_t::ERROR, supervisor_transition_t::SUN_TRACKING_MAX_MOVES, NULL},
+    {supervisor_state_t::ERROR, supervisor_transition_t::SUN_TRACKING_ABORTED, NULL},
+    {supervisor_state_t::ERROR, supervisor_transition_t::SUN_TRACKING_SUCCESS, NULL},
+};
+
+static constexpr supervisor_table_t TABLE(TRANSITIONS);
+static_assert(TABLE.is_complete(), "each (state, transition) pair must have exactly one most specific entry");
+
+static unhandled_counter_t<static_cast<int>(supervisor_state_t::COUNT),
+                           static_cast<int>(supervisor_transition_t::COUNT)>
+    unhandled_counter;
+
+unsigned int supervisor_state_machine_get_unhandled_count() { return unhandled_counter.get_total(); }
+
+supervisor_state_t supervisor_state_machine_update(supervisor_state_t current_state,
+                                                   supervisor_transition_t transition,
+                                                   motors_direction_t motors_direction,
+                                                   int64_t time_ms)
+{
+    supervisor_handler_t handler = TABLE.get_handler(current_state, transition);
+    if (handler == NULL) {
+        unhandled_counter.record(current_state, transition);
+        return current_state;
+    }
+    return handler(current_state, motors_direction, time_ms);
+}
@@ -4,78 +4,28 @@
 #pragma once
 
 #include "motors_direction.hpp"
-
-#include <assert.h>
-
-enum class supervisor_state_t : signed char {
-    ERROR = -1,
-    UNINITIALIZED = 0,
-    IDLE,
-    MANUAL_MOVING,
-    SUN_TRACKING,
-    WAITING_SUN_MOVE,
-};
-
-inline const char *str(supervisor_state_t state)
-{
-    switch (state) {
-    case supervisor_state_t::ERROR:
-        return "ERROR";
-    case supervisor_state_t::UNINITIALIZED:
-        return "UNINITIALIZED";
-    case supervisor_state_t::IDLE:
-        return "IDLE";
-    case supervisor_state_t::MANUAL_MOVING:
-        return "MANUAL_MOVING";
-    case supervisor_state_t::SUN_TRACKING:
-        return "SUN_TRACKING";
-    case supervisor_state_t::WAITING_SUN_MOVE:
-        return "WAITING_SUN_MOVE";
-    default:
-        assert(false);
-    }
-}
-
-enum class supervisor_transition_t : signed char {
-    NONE = 0,
-    STOP_OR_RESET,
-    START_MANUAL_MOVE_CONTINUOUS,
-    START_MANUAL_MOVE_ONE_STEP,
-    MOTORS_STOPPED,
-    START_SUN_TRACKING,
-    SUN_TRACKING_ERROR,
-    SUN_TRACKING_MAX_MOVES,
-    SUN_TRACKING_ABORTED,
-    SUN_TRACKING_SUCCESS,
-};
-
-inline const char *str(supervisor_transition_t transition)
-{
-    switch (transition) {
-    case supervisor_transition_t::NONE:
-        return "NONE";
-    case supervisor_transition_t::STOP_OR_RESET:
-        return "STOP_OR_RESET";
-    case supervisor_transition_t::START_MANUAL_MOVE_CONTINUOUS:
-        return "START_MANUAL_MOVE_CONTINUOUS";
-    case supervisor_transition_t::START_MANUAL_MOVE_ONE_STEP:
-        return "START_MANUAL_MOVE_ONE_STEP";
-    case supervisor_transition_t::MOTORS_STOPPED:
-        return "MOTORS_STOPPED";
-    case supervisor_transition_t::START_SUN_TRACKING:
-        return "START_SUN_TRACKING";
-    case supervisor_transition_t::SUN_TRACKING_ERROR:
-        return "SUN_TRACKING_ERROR";
-    case supervisor_transition_t::SUN_TRACKING_MAX_MOVES:
-        return "SUN_TRACKING_MAX_MOVES";
-    case supervisor_transition_t::SUN_TRACKING_ABORTED:
-        return "SUN_TRACKING_ABORTED";
-    case supervisor_transition_t::SUN_TRACKING_SUCCESS:
-        return "SUN_TRACKING_SUCCESS";
-    default:
-        assert(false);
-    }
-}
+#include "transition_table.hpp"
+
+#include <stdint.h>
+
+#define SUPERVISOR_STATES(X) X(ERROR) X(UNINITIALIZED) X(IDLE) X(MANUAL_MOVING) X(SUN_TRACKING) X(WAITING_SUN_MOVE)
+STATE_MACHINE_ENUM(supervisor_state_t, SUPERVISOR_STATES)
+
+#define SUPERVISOR_TRANSITIONS(X)                                                                                      \
+    X(NONE)                                                                                                            \
+    X(STOP_OR_RESET)                                                                                                   \
+    X(START_MANUAL_MOVE_CONTINUOUS)                                                                                    \
+    X(START_MANUAL_MOVE_ONE_STEP)                                                                                      \
+    X(MOTORS_STOPPED)                                                                                                  \
+    X(START_SUN_TRACKING)                                                                                              \
+    X(SUN_TRACKING_ERROR)                                                                                              \
+    X(SUN_TRACKING_MAX_MOVES)                                                                                          \
+    X(SUN_TRACKING_ABORTED)                                                                                            \
+    X(SUN_TRACKING_SUCCESS)
+STATE_MACHINE_ENUM(supervisor_transition_t, SUPERVISOR_TRANSITIONS)
+
+// Number of (state, transition) pairs received by the state machine without anything to do, since startup
+unsigned int supervisor_state_machine_get_unhandled_count();
 
 // This function is not thread safe, the caller has the responsibility to :
 // - never call it concurrently
@@ -8,4 +8,10 @@
 void target_detector_init();
 
 // return true if target has been successfully detected
+// After a successful detection, the next one first searches capstones around the previous ones (tracking mode),
+// the full image is scanned only if this fails
 bool target_detector_detect(CImg<unsigned char>& image, rectangle_t& target);
+
+// return how far (in pixels) the target center moved between the last detection and the previous one
+// or -1 if unknown (last detection failed or no previous target)
+int target_detector_get_drift_px();
@@ -0,0 +1,328 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "multi_threshold_capstones.hpp"
+
+#include <assert.h>
+#include <cstring>
+
+static const int WINDOW_HALF_SIZE = CAPSTONE_WINDOW_SIZE / 2;
+
+// Finder pattern : dark ring, light gap, dark stone, light gap, dark ring
+static const int FINDER_RUN_COUNT = 5;
+static const int FINDER_RATIO[FINDER_RUN_COUNT] = {1, 1, 3, 1, 1};
+
+// Accepted stone area compared to ring area (in percent)
+static const int MIN_STONE_RING_RATIO = 10;
+static const int MAX_STONE_RING_RATIO = 70;
+
+static unsigned char thresholds[MAX_THRESHOLD_COUNT];
+static int threshold_count = 0;
+
+// Quantized level of each pixel value : number of thresholds lower or equal to this value,
+// so a pixel is dark for the threshold at index k if its level is lower or equal to k
+static unsigned char level_of_value[256];
+
+// Runs of consecutive pixels having the same level in the current row
+// (run_start has one more element to store the row end)
+static unsigned char run_level[MAX_IMAGE_WIDTH];
+static int run_start[MAX_IMAGE_WIDTH + 1];
+static int run_count = 0;
+
+// Labels of the pixels in the labelling window
+// Each labelled region uses a new label value, so the window is cleared only when labels wrap
+static unsigned char window_labels[CAPSTONE_WINDOW_SIZE * CAPSTONE_WINDOW_SIZE];
+static unsigned char last_label = 0;
+static int window_left = 0;
+static int window_top = 0;
+
+// Pixels to visit while labelling a region (indexes in labelling window)
+static unsigned short fill_stack[CAPSTONE_WINDOW_SIZE * CAPSTONE_WINDOW_SIZE];
+
+struct region_t {
+    int count;
+    rectangle_t box;
+    // Extreme pixels along the diagonals
+    capstone_point_t top_left;     // min x + y
+    capstone_point_t top_right;    // max x - y
+    capstone_point_t bottom_left;  // min x - y
+    capstone_point_t bottom_right; // max x + y
+    int sum_x;
+    int sum_y;
+};
+
+void multi_threshold_capstones_init(const unsigned char *new_thresholds, int new_threshold_count)
+{
+    assert(new_threshold_count <= MAX_THRESHOLD_COUNT);
+    for (int k = 0; k < new_threshold_count; k++) {
+        assert(k == 0 || new_thresholds[k - 1] < new_thresholds[k]);
+        thresholds[k] = new_thresholds[k];
+    }
+    threshold_count = new_threshold_count;
+
+    for (int value = 0; value < 256; value++) {
+        int level = 0;
+        while (level < threshold_count && thresholds[level] <= value) {
+            level++;
+        }
+        level_of_value[value] = level;
+    }
+}
+
+// Reserve two consecutive labels, clear the labelling window when labels wrap
+static unsigned char reserve_labels()
+{
+    if (last_label >= 254) {
+        memset(window_labels, 0, sizeof(window_labels));
+        last_label = 0;
+    }
+    last_label += 2;
+    return last_label - 1;
+}
+
+// return the label of the given image pixel, or 0 if it is out of labelling window
+static unsigned char get_window_label(int x, int y)
+{
+    int wx = x - window_left;
+    int wy = y - window_top;
+    if (wx < 0 || wy < 0 || wx >= CAPSTONE_WINDOW_SIZE || wy >= CAPSTONE_WINDOW_SIZE) {
+        return 0;
+    }
+    return window_labels[wx + wy * CAPSTONE_WINDOW_SIZE];
+}
+
+// Label the dark region containing the given pixel, for the threshold at index k
+// return false if the region reaches the labelling window border (too big to be a capstone part)
+static bool label_region(const CImg<unsigned char> &image, int x, int y, int k, unsigned char label, region_t &region)
+{
+    int wx = x - window_left;
+    int wy = y - window_top;
+    if (wx <= 0 || wy <= 0 || wx >= CAPSTONE_WINDOW_SIZE - 1 || wy >= CAPSTONE_WINDOW_SIZE - 1) {
+        return false;
+    }
+
+    region = {
+        .count = 0,
+        .box = {x, y, x, y},
+        .top_left = {x, y},
+        .top_right = {x, y},
+        .bottom_left = {x, y},
+        .bottom_right = {x, y},
+        .sum_x = 0,
+        .sum_y = 0,
+    };
+
+    int stack_size = 0;
+    window_labels[wx + wy * CAPSTONE_WINDOW_SIZE] = label;
+    fill_stack[stack_size++] = wx + wy * CAPSTONE_WINDOW_SIZE;
+
+    while (stack_size > 0) {
+        int index = fill_stack[--stack_size];
+        wx = index % CAPSTONE_WINDOW_SIZE;
+        wy = index / CAPSTONE_WINDOW_SIZE;
+        if (wx == 0 || wy == 0 || wx == CAPSTONE_WINDOW_SIZE - 1 || wy == CAPSTONE_WINDOW_SIZE - 1) {
+            return false;
+        }
+
+        int px = window_left + wx;
+        int py = window_top + wy;
+        region.count++;
+        region.sum_x += px;
+        region.sum_y += py;
+        region.box.left_px = std::min(region.box.left_px, px);
+        region.box.top_px = std::min(region.box.top_px, py);
+        region.box.right_px = std::max(region.box.right_px, px);
+        region.box.bottom_px = std::max(region.box.bottom_px, py);
+        if (px + py < region.top_left.x + region.top_left.y) {
+            region.top_left = {px, py};
+        }
+        if (px - py > region.top_right.x - region.top_right.y) {
+            region.top_right = {px, py};
+        }
+        if (px - py < region.bottom_left.x - region.bottom_left.y) {
+            region.bottom_left = {px, py};
+        }
+        if (px + py > region.bottom_right.x + region.bottom_right.y) {
+            region.bottom_right = {px, py};
+        }
+
+        const int neighbours[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+        for (int n = 0; n < 4; n++) {
+            int nx = px + neighbours[n][0];
+            int ny = py + neighbours[n][1];
+            if (nx < 0 || ny < 0 || nx >= image.width() || ny >= image.height()) {
+                continue;
+            }
+            int neighbour_index = index + neighbours[n][0] + neighbours[n][1] * CAPSTONE_WINDOW_SIZE;
+            if (window_labels[neighbour_index] == label || level_of_value[image(nx, ny)] > k) {
+                continue;
+            }
+            window_labels[neighbour_index] = label;
+            fill_stack[stack_size++] = neighbour_index;
+        }
+    }
+    return true;
+}
+
+// return true if the 5 last runs lengths match the finder pattern
+static bool is_finder_pattern(const int *lengths)
+{
+    int average = (lengths[0] + lengths[1] + lengths[3] + lengths[4]) / 4;
+    int error = average * 3 / 4;
+    for (int i = 0; i < FINDER_RUN_COUNT; i++) {
+        if (lengths[i] < FINDER_RATIO[i] * (average - error) || lengths[i] > FINDER_RATIO[i] * (average + error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check the candidate finder pattern found in row y for the threshold at index k
+// by labelling the ring and the stone regions around it
+// return true if it is a capstone
+static bool check_capstone(
+    const CImg<unsigned char> &image, int y, int k, const int *starts, const int *lengths, capstone_t &capstone)
+{
+    int stone_x = starts[2] + lengths[2] / 2;
+    window_left = stone_x - WINDOW_HALF_SIZE;
+    window_top = y - WINDOW_HALF_SIZE;
+
+    unsigned char ring_label = reserve_labels();
+    unsigned char stone_label = ring_label + 1;
+
+    // Left and right parts of the pattern must belong to the same ring, which does not contain the stone
+    region_t ring;
+    if (!label_region(image, starts[4], y, k, ring_label, ring)) {
+        return false;
+    }
+    if (get_window_label(starts[0], y) != ring_label || get_window_label(stone_x, y) == ring_label) {
+        return false;
+    }
+
+    region_t stone;
+    if (!label_region(image, stone_x, y, k, stone_label, stone)) {
+        return false;
+    }
+    if (stone.box.left_px <= ring.box.left_px || stone.box.top_px <= ring.box.top_px
+        || stone.box.right_px >= ring.box.right_px || stone.box.bottom_px >= ring.box.bottom_px) {
+        return false;
+    }
+
+    int ratio = stone.count * 100 / ring.count;
+    if (ratio < MIN_STONE_RING_RATIO || ratio > MAX_STONE_RING_RATIO) {
+        return false;
+    }
+
+    capstone = {
+        .threshold = thresholds[k],
+        .ring = ring.box,
+        .top_left = ring.top_left,
+        .top_right = ring.top_right,
+        .bottom_left = ring.bottom_left,
+        .bottom_right = ring.bottom_right,
+        .center_x = stone.sum_x / stone.count,
+        .center_y = stone.sum_y / stone.count,
+    };
+    return true;
+}
+
+// return true if the given pixel is in the ring of a capstone already detected at the given threshold
+static bool is_in_capstones(int x, int y, int threshold, const capstone_t *capstones, int capstone_count)
+{
+    for (int i = 0; i < capstone_count; i++) {
+        const rectangle_t &ring = capstones[i].ring;
+        if (capstones[i].threshold == threshold && x >= ring.left_px && x <= ring.right_px && y >= ring.top_px
+            && y <= ring.bottom_px) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Search finder patterns of the threshold at index k in the current row runs
+// return the new number of detected capstones
+static int scan_row(
+    const CImg<unsigned char> &image, int y, int k, capstone_t *capstones, int capstone_count, int max_capstone_count)
+{
+    // Starts and lengths of the last dark/light runs, for this threshold
+    int starts[FINDER_RUN_COUNT] = {};
+    int lengths[FINDER_RUN_COUNT] = {};
+    int known_run_count = 0;
+
+    bool dark = run_level[0] <= k;
+    int start = run_start[0];
+    for (int r = 1; r <= run_count; r++) {
+        bool run_dark = (r < run_count) && (run_level[r] <= k);
+        if (r < run_count && run_dark == dark) {
+            continue;
+        }
+
+        // The current run ends here
+        for (int i = 0; i < FINDER_RUN_COUNT - 1; i++) {
+            starts[i] = starts[i + 1];
+            lengths[i] = lengths[i + 1];
+        }
+        starts[FINDER_RUN_COUNT - 1] = start;
+        lengths[FINDER_RUN_COUNT - 1] = run_start[r] - start;
+        known_run_count++;
+
+        // Runs alternate, so 5 runs ending with a dark one are dark/light/dark/light/dark
+        if (dark && known_run_count >= FINDER_RUN_COUNT && is_finder_pattern(lengths)) {
+            int stone_x = starts[2] + lengths[2] / 2;
+            if (!is_in_capstones(stone_x, y, thresholds[k], capstones, capstone_count)
+                && check_capstone(image, y, k, starts, lengths, capstones[capstone_count])) {
+                capstone_count++;
+                if (capstone_count == max_capstone_count) {
+                    return capstone_count;
+                }
+            }
+        }
+
+        dark = run_dark;
+        start = run_start[r];
+    }
+    return capstone_count;
+}
+
+int multi_threshold_detect_capstones(const CImg<unsigned char> &image,
+                                     const rectangle_t &area,
+                                     capstone_t *capstones,
+                                     int max_capstone_count)
+{
+    // assert grayscale image
+    assert(image.depth() == 1);
+    assert(image.spectrum() == 1);
+    assert(image.width() <= MAX_IMAGE_WIDTH);
+    assert(area.left_px >= 0);
+    assert(area.top_px >= 0);
+    assert(area.right_px < image.width());
+    assert(area.bottom_px < image.height());
+    assert(threshold_count > 0);
+
+    int capstone_count = 0;
+    for (int y = area.top_px; y <= area.bottom_px && capstone_count < max_capstone_count; y++) {
+        // Quantize the row into runs of levels, this is the only per-pixel work of the detection
+        const unsigned char *row = image.data(0, y);
+        run_count = 0;
+        for (int x = area.left_px; x <= area.right_px; x++) {
+            unsigned char level = level_of_value[row[x]];
+            if (run_count == 0 || run_level[run_count - 1] != level) {
+                run_level[run_count] = level;
+                run_start[run_count] = x;
+                run_count++;
+            }
+        }
+        run_start[run_count] = area.right_px + 1;
+
+        for (int k = 0; k < threshold_count && capstone_count < max_capstone_count; k++) {
+            capstone_count = scan_row(image, y, k, capstones, capstone_count, max_capstone_count);
+        }
+    }
+    return capstone_count;
+}
+
+int multi_threshold_detect_capstones(const CImg<unsigned char> &image, capstone_t *capstones, int max_capstone_count)
+{
+    rectangle_t full_image = {0, 0, image.width() - 1, image.height() - 1};
+    return multi_threshold_detect_capstones(image, full_image, capstones, max_capstone_count);
+}
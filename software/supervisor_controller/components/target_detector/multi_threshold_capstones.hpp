@@ -0,0 +1,54 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include "image.hpp"
+
+// Maximal number of thresholds handled in a single detection pass
+static const int MAX_THRESHOLD_COUNT = 4;
+
+// Maximal image width handled (size of the static row buffers)
+static const int MAX_IMAGE_WIDTH = 800;
+
+// Side of the square window in which a capstone is labelled around its center,
+// capstones bigger than half of this window are not detected
+static const int CAPSTONE_WINDOW_SIZE = 128;
+
+struct capstone_point_t {
+    int x;
+    int y;
+};
+
+struct capstone_t {
+    int threshold;
+    rectangle_t ring; // outer bounding box of the capstone ring
+    // Outer corners of the ring : its extreme pixels along the diagonals (like quirc capstone corners)
+    // The blur rounds the ring corners, so they are inside the ring box
+    capstone_point_t top_left;
+    capstone_point_t top_right;
+    capstone_point_t bottom_left;
+    capstone_point_t bottom_right;
+    int center_x; // center of the capstone stone
+    int center_y;
+};
+
+// Set the thresholds used by next detections
+// 'thresholds' must be sorted in increasing order, a pixel is dark if it is below the threshold.
+void multi_threshold_capstones_init(const unsigned char *thresholds, int threshold_count);
+
+// Detect capstones (dark ring around a dark stone, 1:1:3:1:1 ratio) at all thresholds
+// in a single pass over the image :
+// - each image row is read once and quantized into runs of threshold levels
+// - for each threshold, the finder pattern is searched in these runs (not in pixels)
+// - regions are labelled only around candidate patterns, in a small window
+// The same capstone is usually detected at several thresholds, once per threshold.
+// return the number of capstones stored in 'capstones' (at most 'max_capstone_count')
+int multi_threshold_detect_capstones(const CImg<unsigned char> &image, capstone_t *capstones, int max_capstone_count);
+
+// Same as above, but only capstones having their pattern in the given area are detected
+// (their ring can exceed the area), the cost is proportional to the area size
+int multi_threshold_detect_capstones(const CImg<unsigned char> &image,
+                                     const rectangle_t &area,
+                                     capstone_t *capstones,
+                                     int max_capstone_count);
@@ -3,12 +3,13 @@
 
 #include "esp_log.h"
 
+#include "deferred_log.hpp"
 #include "image.hpp"
-#include "quirc.h"
+#include "metrics.hpp"
+#include "multi_threshold_capstones.hpp"
 #include "target_detector.hpp"
 
 #include <assert.h>
-#include <climits>
 
 static const char *TAG = "target_detector";
 
@@ -20,13 +21,21 @@ static const unsigned char WHITE = 255;
 static const unsigned char MIN_CAPSTONE_SIZE = 25; // 10 cm capstone viewed at 3 meters
 static const unsigned char MAX_CAPSTONE_SIZE = 60; // 10 cm capstone viewed at 1.5 meters
 
-static const unsigned char MIN_PIXEL_THRESHOLD = 100;
-static const unsigned char MAX_PIXEL_THRESHOLD = 180;
-static const unsigned char PIXEL_THRESHOLD_STEP = 40;
+// Capstones are detected at all these thresholds in a single image pass
+static const unsigned char PIXEL_THRESHOLDS[] = {100, 140, 180};
+static const int PIXEL_THRESHOLD_COUNT = sizeof(PIXEL_THRESHOLDS) / sizeof(PIXEL_THRESHOLDS[0]);
 
-static struct quirc *capstone_detector;
+// Capstones found by last detection (several times if detected at several thresholds)
+static const int MAX_FOUND_CAPSTONE_COUNT = MAX_CAPSTONE_COUNT * PIXEL_THRESHOLD_COUNT;
+static capstone_t capstones_found[MAX_FOUND_CAPSTONE_COUNT];
 
-void target_detector_init() { capstone_detector = quirc_new(); }
+// In tracking mode, capstones are searched in windows around previous capstones, with this margin
+static const int TRACKING_MARGIN_PX = MAX_CAPSTONE_SIZE / 2;
+
+struct point {
+    int x;
+    int y;
+};
 
 template <typename T> struct quad {
     T top_left;
@@ -39,18 +48,39 @@ template <typename T> struct quad {
 struct capstone_geometry {
     int width;
     int height;
-    quirc_point center;
-    quad<quirc_point> corners;
+    point center;
+    quad<point> corners;
 };
 
+// Last successfully detected target and capstones, used in tracking mode
+static bool previous_target_known = false;
+static rectangle_t previous_target;
+static capstone_geometry previous_capstones[EXPECTED_CAPSTONE_COUNT];
+static int target_drift_px = -1;
+
+void target_detector_init()
+{
+    multi_threshold_capstones_init(PIXEL_THRESHOLDS, PIXEL_THRESHOLD_COUNT);
+    previous_target_known = false;
+    target_drift_px = -1;
+}
+
+int target_detector_get_drift_px() { return target_drift_px; }
+
 void log_capstone(const capstone_geometry &geometry)
 {
-    ESP_LOGD(TAG, "capstone.center:  %i, %i", geometry.center.x, geometry.center.y);
-    ESP_LOGD(TAG, "  capstone.size:  %i, %i", geometry.width, geometry.height);
-    ESP_LOGD(TAG, "  capstone.top_left:  %i, %i", geometry.corners.top_left.x, geometry.corners.top_left.y);
-    ESP_LOGD(TAG, "  capstone.top_right:  %i, %i", geometry.corners.top_right.x, geometry.corners.top_right.y);
-    ESP_LOGD(TAG, "  capstone.bottom_left:  %i, %i", geometry.corners.bottom_left.x, geometry.corners.bottom_left.y);
-    ESP_LOGD(TAG, "  capstone.bottom_right:  %i, %i", geometry.corners.bottom_right.x, geometry.corners.bottom_right.y);
+    DEFERRED_LOGD(TAG, "capstone.center:  %i, %i", geometry.center.x, geometry.center.y);
+    DEFERRED_LOGD(TAG, "  capstone.size:  %i, %i", geometry.width, geometry.height);
+    DEFERRED_LOGD(TAG, "  capstone.top_left:  %i, %i", geometry.corners.top_left.x, geometry.corners.top_left.y);
+    DEFERRED_LOGD(TAG, "  capstone.top_right:  %i, %i", geometry.corners.top_right.x, geometry.corners.top_right.y);
+    DEFERRED_LOGD(TAG,
+                  "  capstone.bottom_left:  %i, %i",
+                  geometry.corners.bottom_left.x,
+                  geometry.corners.bottom_left.y);
+    DEFERRED_LOGD(TAG,
+                  "  capstone.bottom_right:  %i, %i",
+                  geometry.corners.bottom_right.x,
+                  geometry.corners.bottom_right.y);
 }
 
 void draw_capstone(CImg<unsigned char> &image, const capstone_geometry &capstone)
@@ -69,7 +99,7 @@ void draw_capstone(CImg<unsigned char> &image, const capstone_geometry &capstone
 
 void log_target(const rectangle_t &target)
 {
-    ESP_LOGV(TAG, "target:  %i, %i, %i, %i", target.left_px, target.top_px, target.right_px, target.bottom_px);
+    DEFERRED_LOGV(TAG, "target:  %i, %i, %i, %i", target.left_px, target.top_px, target.right_px, target.bottom_px);
 }
 
 void draw_target(CImg<unsigned char> &image, const rectangle_t &target)
@@ -82,52 +112,27 @@ void draw_target(CImg<unsigned char> &image, const rectangle_t &target)
         target.left_px - 1, target.top_px - 1, target.right_px + 1, target.bottom_px + 1, &BLACK, 1, 0x0F0F0F0F);
 }
 
-// Extract ordered corners from capstone
-quad<quirc_point> extract_corners(const quirc_capstone *capstone)
+// Capstone size is the average length of the opposite sides of its corners quad, like quirc capstones :
+// blur rounds the ring corners, so this is less sensitive to blur than the ring bounding box
+// (size limits and target pattern rely on it)
+capstone_geometry extract_capstone_geometry(const capstone_t &capstone)
 {
-    int min_x = INT_MAX;
-    int min_y = INT_MAX;
-    int max_x = 0;
-    int max_y = 0;
-    for (int i = 0; i < 4; i++) {
-        quirc_point corner = capstone->corners[i];
-        min_x = std::min(min_x, corner.x);
-        min_y = std::min(min_y, corner.y);
-        max_x = std::max(max_x, corner.x);
-        max_y = std::max(max_y, corner.y);
-    }
-    return quad<quirc_point>{
-        .top_left = {min_x, min_y},
-        .top_right = {max_x, min_y},
-        .bottom_left = {min_x, max_y},
-        .bottom_right = {max_x, max_y},
-    };
-}
-
-capstone_geometry extract_capstone_geometry(const quirc_capstone *capstone)
-{
-    int min_x = INT_MAX;
-    int min_y = INT_MAX;
-    int max_x = 0;
-    int max_y = 0;
-    for (int i = 0; i < 4; i++) {
-        quirc_point corner = capstone->corners[i];
-        min_x = std::min(min_x, corner.x);
-        min_y = std::min(min_y, corner.y);
-        max_x = std::max(max_x, corner.x);
-        max_y = std::max(max_y, corner.y);
-    }
-    quad<quirc_point> corners = {
-        .top_left = {min_x, min_y},
-        .top_right = {max_x, min_y},
-        .bottom_left = {min_x, max_y},
-        .bottom_right = {max_x, max_y},
-    };
+    const capstone_point_t &top_left = capstone.top_left;
+    const capstone_point_t &top_right = capstone.top_right;
+    const capstone_point_t &bottom_left = capstone.bottom_left;
+    const capstone_point_t &bottom_right = capstone.bottom_right;
+    const rectangle_t &ring = capstone.ring;
     return capstone_geometry{
-        .width = (corners.top_right.x - corners.top_left.x + corners.bottom_right.x - corners.bottom_left.x) / 2,
-        .height = (corners.bottom_left.y - corners.top_left.y + corners.bottom_right.y - corners.top_right.y) / 2,
-        .center = capstone->center,
-        .corners = corners,
+        .width = (top_right.x - top_left.x + bottom_right.x - bottom_left.x) / 2,
+        .height = (bottom_left.y - top_left.y + bottom_right.y - top_right.y) / 2,
+        .center = {capstone.center_x, capstone.center_y},
+        .corners =
+            {
+                .top_left = {ring.left_px, ring.top_px},
+                .top_right = {ring.right_px, ring.top_px},
+                .bottom_left = {ring.left_px, ring.bottom_px},
+                .bottom_right = {ring.right_px, ring.bottom_px},
+            },
     };
 }
 
@@ -169,12 +174,49 @@ bool near_capstones(const capstone_geometry &geo1, const capstone_geometry &geo2
         && std::abs(geo1.center.y - geo2.center.y) < std::min(geo1.height, geo2.height);
 }
 
-bool target_detector_detect(CImg<unsigned char> &image, rectangle_t &target)
+bool has_expected_size(const capstone_geometry &geometry)
 {
-    // assert grayscale image
-    assert(image.depth() == 1);
-    assert(image.spectrum() == 1);
+    return geometry.width >= MIN_CAPSTONE_SIZE && geometry.width <= MAX_CAPSTONE_SIZE
+        && geometry.height >= MIN_CAPSTONE_SIZE && geometry.height <= MAX_CAPSTONE_SIZE;
+}
+
+// Draw all the capstones stored in capstones_found having the expected size (for display purpose only)
+void draw_capstones(CImg<unsigned char> &image, int capstone_count)
+{
+    for (int i = 0; i < capstone_count; i++) {
+        capstone_geometry geometry = extract_capstone_geometry(capstones_found[i]);
+        if (has_expected_size(geometry)) {
+            draw_capstone(image, geometry);
+        }
+    }
+}
 
+// Search capstones in a window around each previous capstone
+// return the number of capstones stored in capstones_found
+int detect_capstones_around_previous(const CImg<unsigned char> &image)
+{
+    int capstone_count = 0;
+    for (int i = 0; i < EXPECTED_CAPSTONE_COUNT; i++) {
+        const quad<point> &corners = previous_capstones[i].corners;
+        rectangle_t window = {
+            .left_px = std::max(corners.top_left.x - TRACKING_MARGIN_PX, 0),
+            .top_px = std::max(corners.top_left.y - TRACKING_MARGIN_PX, 0),
+            .right_px = std::min(corners.bottom_right.x + TRACKING_MARGIN_PX, image.width() - 1),
+            .bottom_px = std::min(corners.bottom_right.y + TRACKING_MARGIN_PX, image.height() - 1),
+        };
+        capstone_count += multi_threshold_detect_capstones(image,
+                                                           window,
+                                                           capstones_found + capstone_count,
+                                                           MAX_FOUND_CAPSTONE_COUNT / EXPECTED_CAPSTONE_COUNT);
+    }
+    return capstone_count;
+}
+
+// Compute target from the capstones stored in capstones_found
+// return true if target has been successfully detected
+// (nothing is drawn here, so a failed tracking detection does not alter the image for the full image detection)
+bool detect_target_from_capstones(int capstone_count, rectangle_t &target)
+{
     int average_x = 0;
     int average_y = 0;
     int average_width = 0;
@@ -184,33 +226,32 @@ bool target_detector_detect(CImg<unsigned char> &image, rectangle_t &target)
     capstone_geometry capstones_geom[MAX_CAPSTONE_COUNT];
 
     // Parse detected capstones to :
-    // - convert quirc_capstone to geomeetry
+    // - convert capstone_t to geometry
     // - compute usefull averages
-    // - draw all detected capstones (for display purpose only)
-    //   (capstones are drawn before checks to see what happen)
+    // Capstones are parsed by increasing threshold to keep the first threshold detecting each of them
     int detected_capstone_count = 0;
-    for (int threshold = MIN_PIXEL_THRESHOLD; threshold <= MAX_PIXEL_THRESHOLD; threshold += PIXEL_THRESHOLD_STEP) {
-        int capstone_count =
-            quirc_detect_capstones(capstone_detector, image.data(), image.width(), image.height(), threshold);
-
+    for (int t = 0; t < PIXEL_THRESHOLD_COUNT; t++) {
         for (int i = 0; i < capstone_count; i++) {
-            const quirc_capstone *capstone = quirc_get_capstone(capstone_detector, i);
-            capstone_geometry geometry = extract_capstone_geometry(capstone);
+            if (capstones_found[i].threshold != PIXEL_THRESHOLDS[t]) {
+                continue;
+            }
+            capstone_geometry geometry = extract_capstone_geometry(capstones_found[i]);
 
             // Ignore capstone if out of size
-            if (geometry.width < MIN_CAPSTONE_SIZE || geometry.width > MAX_CAPSTONE_SIZE
-                || geometry.height < MIN_CAPSTONE_SIZE || geometry.height > MAX_CAPSTONE_SIZE) {
+            if (!has_expected_size(geometry)) {
                 continue;
             }
 
-            draw_capstone(image, geometry);
-
             // Ignore capstone if it has already been detected with a different threshold
+            bool already_detected = false;
             for (int j = 0; j < detected_capstone_count; j++) {
                 if (near_capstones(capstones_geom[j], geometry)) {
-                    continue;
+                    already_detected = true;
                 }
             }
+            if (already_detected) {
+                continue;
+            }
 
             average_x += geometry.center.x;
             average_y += geometry.center.y;
@@ -277,7 +318,52 @@ bool target_detector_detect(CImg<unsigned char> &image, rectangle_t &target)
     }
 
     log_target(target);
-    draw_target(image, target);
+
+    // Remember target and capstones for next detection (tracking mode)
+    if (previous_target_known) {
+        target_drift_px = std::max(std::abs(target.get_center_x_px() - previous_target.get_center_x_px()),
+                                   std::abs(target.get_center_y_px() - previous_target.get_center_y_px()));
+        DEFERRED_LOGD(TAG, "target drift: %i px", target_drift_px);
+    }
+    previous_target_known = true;
+    previous_target = target;
+    previous_capstones[0] = *capstones.top_left;
+    previous_capstones[1] = *capstones.top_right;
+    previous_capstones[2] = *capstones.bottom_left;
+    previous_capstones[3] = *capstones.bottom_right;
 
     return true;
 }
+
+bool target_detector_detect(CImg<unsigned char> &image, rectangle_t &target)
+{
+    // assert grayscale image
+    assert(image.depth() == 1);
+    assert(image.spectrum() == 1);
+
+    metrics_scoped_timer_t timer(metrics_stage_t::CAPSTONE_DETECTION);
+
+    target_drift_px = -1;
+
+    // Tracking mode : camera and target are fixed, so capstones are first searched around previous ones
+    if (previous_target_known) {
+        int capstone_count = detect_capstones_around_previous(image);
+        if (detect_target_from_capstones(capstone_count, target)) {
+            draw_capstones(image, capstone_count);
+            draw_target(image, target);
+            return true;
+        }
+        DEFERRED_LOGD(TAG, "Target not found around previous one, scan full image");
+    }
+
+    // All thresholds are detected in a single image pass
+    int capstone_count = multi_threshold_detect_capstones(image, capstones_found, MAX_FOUND_CAPSTONE_COUNT);
+    bool target_detected = detect_target_from_capstones(capstone_count, target);
+
+    // Capstones are drawn even if detection failed to see what happen
+    draw_capstones(image, capstone_count);
+    if (target_detected) {
+        draw_target(image, target);
+    }
+    return target_detected;
+}
@@ -2,6 +2,7 @@
 // This code is distributed under GNU GPL v3 license
 
 #include "mini_mock.hpp"
+#include "synthetic_target.hpp"
 
 #include "target_detector.hpp"
 
@@ -53,18 +54,62 @@ TEST(when_capstones_are_correct_then_area_is_detected, []() {
     rectangle_t target_area;
     bool target_detected = detect_from_file("correct_capstones.jpg", target_area);
     EXPECT(target_detected);
+    // Capstones centers are (227,73) (294,74) (204,234) (298,232), their average size is 30x30 (see README schema)
+    EXPECT(target_area.left_px == 212);
+    EXPECT(target_area.top_px == 134);
+    EXPECT(target_area.right_px == 309);
+    EXPECT(target_area.bottom_px == 172);
 });
 
 TEST(when_contrast_is_low_then_area_is_detected, []() {
+    target_detector_init();
+    CImg<unsigned char> image = load_image_as_grayscale("correct_capstones.jpg");
+    cimg_for(image, p, unsigned char) { *p = 80 + *p / 2; }
     rectangle_t target_area;
-    bool target_detected = detect_from_file("correct_capstones_low_contrast.jpg", target_area);
-    EXPECT(target_detected);
+    EXPECT(target_detector_detect(image, target_area));
 });
 
 TEST(out_of_size_capstones_are_ignored, []() {
+    target_detector_init();
+    CImg<unsigned char> image = create_synthetic_target_image(0, 0);
+    draw_synthetic_capstone(image, 100, 300, 2);
+    draw_synthetic_capstone(image, 700, 300, 9);
     rectangle_t target_area;
-    bool target_detected = detect_from_file("correct_capstones_and_out_of_size_capstones.jpg", target_area);
-    EXPECT(target_detected);
+    EXPECT(target_detector_detect(image, target_area));
+});
+
+TEST(when_target_moves_then_it_is_tracked_and_drift_is_reported, []() {
+    target_detector_init();
+
+    rectangle_t first_target;
+    CImg<unsigned char> first_image = create_synthetic_target_image(0, 0);
+    EXPECT(target_detector_detect(first_image, first_target));
+    EXPECT(target_detector_get_drift_px() == -1);
+
+    rectangle_t moved_target;
+    CImg<unsigned char> moved_image = create_synthetic_target_image(8, -3);
+    EXPECT(target_detector_detect(moved_image, moved_target));
+    EXPECT(moved_target.left_px == first_target.left_px + 8);
+    EXPECT(moved_target.top_px == first_target.top_px - 3);
+    EXPECT(target_detector_get_drift_px() == 8);
+});
+
+TEST(when_target_is_tracked_then_capstones_far_from_previous_ones_are_not_searched, []() {
+    // An extra capstone in the middle of the target makes the full image detection fail
+    CImg<unsigned char> image_with_extra_capstone = create_synthetic_target_image(0, 0);
+    draw_synthetic_capstone(image_with_extra_capstone, 400, 300);
+    rectangle_t target;
+    target_detector_init();
+    EXPECT(!target_detector_detect(image_with_extra_capstone, target));
+
+    // But it is out of the windows searched around previous capstones
+    target_detector_init();
+    CImg<unsigned char> first_image = create_synthetic_target_image(0, 0);
+    EXPECT(target_detector_detect(first_image, target));
+    image_with_extra_capstone = create_synthetic_target_image(0, 0);
+    draw_synthetic_capstone(image_with_extra_capstone, 400, 300);
+    EXPECT(target_detector_detect(image_with_extra_capstone, target));
+    EXPECT(target_detector_get_drift_px() == 0);
 });
 
 CREATE_MAIN_ENTRY_POINT();
@@ -0,0 +1,144 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+
+// Declare a state machine enum with contiguous values from 0 (so they can index a transition table),
+// followed by COUNT (number of values, not a value), and its 'str' function :
+//   #define MY_STATES(X) X(IDLE) X(RUNNING)
+//   STATE_MACHINE_ENUM(my_state_t, MY_STATES)
+#define STATE_MACHINE_ENUM_VALUE(name) name,
+#define STATE_MACHINE_ENUM_NAME(name) #name,
+#define STATE_MACHINE_ENUM(type, VALUES)                                                                               \
+    enum class type : signed char { VALUES(STATE_MACHINE_ENUM_VALUE) COUNT };                                          \
+    inline const char *str(type value)                                                                                 \
+    {                                                                                                                  \
+        static const char *const NAMES[] = {VALUES(STATE_MACHINE_ENUM_NAME)};                                          \
+        int index = static_cast<int>(value);                                                                           \
+        assert(index >= 0 && index < static_cast<int>(type::COUNT));                                                   \
+        return NAMES[index];                                                                                           \
+    }
+
+// Transition table of a state machine, built at compile time from a list of entries :
+//   { state, transition, handler }
+// An entry can apply to all states (ANY_STATE) or to all transitions (ANY_TRANSITION), but not both.
+// The handler of a (state, transition) pair is the one of its most specific entry :
+// exact pair, then (state, ANY_TRANSITION), then (ANY_STATE, transition).
+// A NULL handler declares the pair as unhandled : nothing is done, it's only counted (see unhandled_counter_t).
+// The table is complete if each pair has exactly one most specific entry, it must be checked at compile time :
+//   static constexpr my_table_t TABLE(ENTRIES);
+//   static_assert(TABLE.is_complete(), "...");
+// Then the handler of a pair is found in O(1) (array of handlers indexed by state and transition).
+template <typename State,
+          typename Transition,
+          typename Handler,
+          int STATE_COUNT = static_cast<int>(State::COUNT),
+          int TRANSITION_COUNT = static_cast<int>(Transition::COUNT)>
+class transition_table_t {
+  public:
+    static constexpr State ANY_STATE = static_cast<State>(-1);
+    static constexpr Transition ANY_TRANSITION = static_cast<Transition>(-1);
+
+    struct entry_t {
+        State state;
+        Transition transition;
+        Handler handler;
+    };
+
+    template <int ENTRY_COUNT> constexpr transition_table_t(const entry_t (&entries)[ENTRY_COUNT])
+    {
+        for (int state = 0; state < STATE_COUNT; state++) {
+            for (int transition = 0; transition < TRANSITION_COUNT; transition++) {
+                int best_index = -1;
+                int best_rank = NO_MATCH;
+                int best_count = 0;
+                for (int i = 0; i < ENTRY_COUNT; i++) {
+                    int rank = get_rank(entries[i], state, transition);
+                    if (rank > best_rank) {
+                        best_index = i;
+                        best_rank = rank;
+                        best_count = 1;
+                    } else if (rank == best_rank && rank != NO_MATCH) {
+                        best_count++;
+                    }
+                }
+                if (best_index < 0 || best_count > 1) {
+                    complete = false;
+                } else {
+                    handlers[state][transition] = entries[best_index].handler;
+                }
+            }
+        }
+        for (int i = 0; i < ENTRY_COUNT; i++) {
+            if (entries[i].state == ANY_STATE && entries[i].transition == ANY_TRANSITION) {
+                complete = false;
+            }
+        }
+    }
+
+    constexpr bool is_complete() const { return complete; }
+
+    // Return NULL if the pair is unhandled
+    Handler get_handler(State state, Transition transition) const
+    {
+        return handlers[get_index(state, STATE_COUNT)][get_index(transition, TRANSITION_COUNT)];
+    }
+
+  private:
+    static const int NO_MATCH = -1;
+    static const int TRANSITION_WIDE_MATCH = 0;
+    static const int STATE_WIDE_MATCH = 1;
+    static const int EXACT_MATCH = 2;
+
+    template <typename T> static constexpr int get_index(T value, int count)
+    {
+        int index = static_cast<int>(value);
+        assert(index >= 0 && index < count);
+        return index;
+    }
+
+    static constexpr int get_rank(const entry_t &entry, int state, int transition)
+    {
+        bool any_state = entry.state == ANY_STATE;
+        bool any_transition = entry.transition == ANY_TRANSITION;
+        if ((!any_state && static_cast<int>(entry.state) != state)
+            || (!any_transition && static_cast<int>(entry.transition) != transition) || (any_state && any_transition)) {
+            return NO_MATCH;
+        }
+        if (any_transition) {
+            return STATE_WIDE_MATCH;
+        }
+        if (any_state) {
+            return TRANSITION_WIDE_MATCH;
+        }
+        return EXACT_MATCH;
+    }
+
+    Handler handlers[STATE_COUNT][TRANSITION_COUNT] = {};
+    bool complete = true;
+};
+
+// Count of the unhandled pairs dispatched by a state machine, for instrumentation
+// (written by the component task, it can be read from any task)
+template <int STATE_COUNT, int TRANSITION_COUNT> class unhandled_counter_t {
+  public:
+    template <typename State, typename Transition> void record(State state, Transition transition)
+    {
+        counts[static_cast<int>(state)][static_cast<int>(transition)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template <typename State, typename Transition> unsigned int get_count(State state, Transition transition) const
+    {
+        return counts[static_cast<int>(state)][static_cast<int>(transition)];
+    }
+
+    unsigned int get_total() const { return total; }
+
+  private:
+    std::atomic<unsigned int> counts[STATE_COUNT][TRANSITION_COUNT] = {};
+    std::atomic<unsigned int> total = 0;
+};
@@ -0,0 +1,94 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "mini_mock.hpp"
+
+#include "transition_table.hpp"
+
+#include <string.h>
+
+#define TEST_STATES(X) X(OFF) X(ON) X(BROKEN)
+STATE_MACHINE_ENUM(test_state_t, TEST_STATES)
+
+#define TEST_TRANSITIONS(X) X(NONE) X(SWITCH) X(HIT)
+STATE_MACHINE_ENUM(test_transition_t, TEST_TRANSITIONS)
+
+typedef test_state_t (*test_handler_t)(test_state_t state);
+typedef transition_table_t<test_state_t, test_transition_t, test_handler_t> test_table_t;
+
+static test_state_t stay(test_state_t state) { return state; }
+static test_state_t switch_on(test_state_t state) { return test_state_t::ON; }
+static test_state_t switch_off(test_state_t state) { return test_state_t::OFF; }
+static test_state_t hit(test_state_t state) { return test_state_t::BROKEN; }
+
+static constexpr auto ANY_STATE = test_table_t::ANY_STATE;
+static constexpr auto ANY_TRANSITION = test_table_t::ANY_TRANSITION;
+
+static constexpr test_table_t::entry_t COMPLETE[] = {
+    {ANY_STATE, test_transition_t::NONE, stay},
+    {ANY_STATE, test_transition_t::HIT, hit},
+    {test_state_t::OFF, test_transition_t::SWITCH, switch_on},
+    {test_state_t::ON, test_transition_t::SWITCH, switch_off},
+    {test_state_t::BROKEN, ANY_TRANSITION, NULL},
+};
+static constexpr test_table_t COMPLETE_TABLE(COMPLETE);
+static_assert(COMPLETE_TABLE.is_complete());
+
+// (BROKEN, SWITCH) pair is missing
+static constexpr test_table_t::entry_t MISSING[] = {
+    {ANY_STATE, test_transition_t::NONE, stay},
+    {ANY_STATE, test_transition_t::HIT, hit},
+    {test_state_t::OFF, test_transition_t::SWITCH, switch_on},
+    {test_state_t::ON, test_transition_t::SWITCH, switch_off},
+};
+static_assert(!test_table_t(MISSING).is_complete());
+
+// (ON, SWITCH) pair has two exact entries
+static constexpr test_table_t::entry_t AMBIGUOUS[] = {
+    {ANY_STATE, test_transition_t::NONE, stay},
+    {ANY_STATE, test_transition_t::HIT, hit},
+    {test_state_t::OFF, test_transition_t::SWITCH, switch_on},
+    {test_state_t::ON, test_transition_t::SWITCH, switch_off},
+    {test_state_t::ON, test_transition_t::SWITCH, stay},
+    {test_state_t::BROKEN, ANY_TRANSITION, NULL},
+};
+static_assert(!test_table_t(AMBIGUOUS).is_complete());
+
+// A catch-all entry would hide the missing pairs
+static constexpr test_table_t::entry_t CATCH_ALL[] = {
+    {ANY_STATE, ANY_TRANSITION, stay},
+};
+static_assert(!test_table_t(CATCH_ALL).is_complete());
+
+TEST(enum_str_is_generated, []() {
+    EXPECT(static_cast<int>(test_state_t::COUNT) == 3);
+    EXPECT(!strcmp(str(test_state_t::OFF), "OFF"));
+    EXPECT(!strcmp(str(test_state_t::BROKEN), "BROKEN"));
+    EXPECT(!strcmp(str(test_transition_t::SWITCH), "SWITCH"));
+});
+
+TEST(most_specific_entry_is_dispatched, []() {
+    // exact pair
+    EXPECT(COMPLETE_TABLE.get_handler(test_state_t::OFF, test_transition_t::SWITCH) == switch_on);
+    EXPECT(COMPLETE_TABLE.get_handler(test_state_t::ON, test_transition_t::SWITCH) == switch_off);
+    // state-wide entry wins over transition-wide entry
+    EXPECT(COMPLETE_TABLE.get_handler(test_state_t::BROKEN, test_transition_t::HIT) == NULL);
+    EXPECT(COMPLETE_TABLE.get_handler(test_state_t::BROKEN, test_transition_t::NONE) == NULL);
+    // transition-wide entry
+    EXPECT(COMPLETE_TABLE.get_handler(test_state_t::ON, test_transition_t::HIT) == hit);
+    EXPECT(COMPLETE_TABLE.get_handler(test_state_t::OFF, test_transition_t::NONE) == stay);
+});
+
+TEST(unhandled_pairs_are_counted, []() {
+    unhandled_counter_t<static_cast<int>(test_state_t::COUNT), static_cast<int>(test_transition_t::COUNT)> counter;
+    EXPECT(counter.get_total() == 0);
+    counter.record(test_state_t::BROKEN, test_transition_t::SWITCH);
+    counter.record(test_state_t::BROKEN, test_transition_t::SWITCH);
+    counter.record(test_state_t::BROKEN, test_transition_t::HIT);
+    EXPECT(counter.get_count(test_state_t::BROKEN, test_transition_t::SWITCH) == 2);
+    EXPECT(counter.get_count(test_state_t::BROKEN, test_transition_t::HIT) == 1);
+    EXPECT(counter.get_count(test_state_t::ON, test_transition_t::HIT) == 0);
+    EXPECT(counter.get_total() == 3);
+});
+
+CREATE_MAIN_ENTRY_POINT();
@@ -16,16 +16,21 @@
 #include "app_httpd.hpp"
 
 #include "esp_http_server.h"
+#include "esp_timer.h"
 #include "img_converters.h"
 #include "sdkconfig.h"
 #include <list>
 
 #include "camera.hpp"
+#include "deferred_log.hpp"
+#include "event_ring.hpp"
 #include "image_conversion.hpp"
-#include "motors.hpp" // to display motor state
+#include "jpeg_cache.hpp"
+#include "metrics.hpp"
+#include "motors.hpp"
+#include "status_snapshot.hpp"
 #include "sun_tracker.hpp"
 #include "supervisor.hpp"
-#include "web_log.hpp"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -51,8 +56,7 @@ static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %
 
 httpd_handle_t stream_httpd = NULL;
 httpd_handle_t camera_httpd = NULL;
-
-static char log_buffer[LOG_BUFFER_SIZE];
+httpd_handle_t events_httpd = NULL;
 
 static size_t jpg_encode_stream(void *arg, size_t index, const void *data, size_t len)
 {
@@ -89,9 +93,8 @@ static esp_err_t parse_get(httpd_req_t *req, char **obuf)
     return ESP_FAIL;
 }
 
-static uint8_t *buf = (uint8_t *)malloc(CAMERA_WIDTH * CAMERA_HEIGHT);
-
-static CImg<unsigned char> img(CAMERA_WIDTH, CAMERA_HEIGHT, 1, 1);
+// Captured image is copied here, so the camera frame buffer is not held during encoding and sending
+static uint8_t *capture_buffer = (uint8_t *)malloc(CAMERA_WIDTH * CAMERA_HEIGHT);
 
 static esp_err_t capture_handler(httpd_req_t *req)
 {
@@ -103,7 +106,8 @@ static esp_err_t capture_handler(httpd_req_t *req)
 
     ESP_LOGI(TAG, "frame created");
 
-    if (!camera_capture(false, img)) {
+    camera_frame_t captured;
+    if (!camera_capture(0, captured)) {
         ESP_LOGE(TAG, "Camera capture failed");
         httpd_resp_send_500(req);
         return ESP_FAIL;
@@ -111,9 +115,8 @@ static esp_err_t capture_handler(httpd_req_t *req)
 
     ESP_LOGI(TAG, "img captured");
 
-    camera_fb_t frame = grayscale_cimg_to_grayscale_frame(img, buf);
-
-    ESP_LOGI(TAG, "img converted");
+    camera_fb_t frame = grayscale_cimg_to_grayscale_frame(captured.image, capture_buffer);
+    captured.release();
 
     //     detect_target(frame);
 
@@ -139,23 +142,12 @@ static esp_err_t capture_handler(httpd_req_t *req)
     return res;
 }
 
-// TODO: move image conversion stuff in custom camera component
 static esp_err_t capture_area_handler(httpd_req_t *req)
 {
-    camera_fb_t *frame = NULL;
     esp_err_t res = ESP_OK;
 
     ESP_LOGI(TAG, "capture_area_handler");
 
-    // Ugly workarround to force the camera to take a new image now
-    // otherwise it returns the frame in the queue, which is one frame late
-    ESP_LOGV(TAG, "esp_camera_fb_get 0");
-    frame = esp_camera_fb_get();
-    esp_camera_fb_return(frame);
-    ESP_LOGV(TAG, "esp_camera_fb_get 1");
-    frame = esp_camera_fb_get();
-    ESP_LOGV(TAG, "esp_camera_fb_get 2");
-
     char *buf = NULL;
     char left_px_str[32];
     char top_px_str[32];
@@ -179,96 +171,97 @@ static esp_err_t capture_area_handler(httpd_req_t *req)
     int bottom_px = atoi(bottom_px_str);
 
     // Check consistency
-    if (left_px >= right_px || left_px < 0 || left_px >= frame->width || right_px < 0 || right_px >= frame->width
-        || top_px >= bottom_px || top_px < 0 || top_px >= frame->height || bottom_px < 0
-        || bottom_px >= frame->height) {
+    if (left_px >= right_px || left_px < 0 || right_px >= CAMERA_WIDTH || top_px >= bottom_px || top_px < 0
+        || bottom_px >= CAMERA_HEIGHT) {
         ESP_LOGE(TAG, "Inconsistent area");
         httpd_resp_send_404(req);
         return ESP_FAIL;
     }
 
-    int area_width = right_px - left_px + 1;
-    int area_height = bottom_px - top_px + 1;
-    uint8_t *area_gray = (uint8_t *)malloc(area_width * area_height);
-
-    ESP_LOGD(TAG, "Convert from RGB565 to gray");
-    for (int y = top_px; y <= bottom_px; y++) {
-        for (int x = left_px; x <= right_px; x++) {
-            // format is deduced from esp-who/components/esp-dl/include/image/dl_image.hpp
-            int source_index = x + y * frame->width;
-            uint16_t rgb565 = ((uint16_t *)frame->buf)[source_index];
-            uint8_t b = (uint8_t)((rgb565 & 0x1F00) >> 5);
-            uint8_t g = (uint8_t)(((rgb565 & 0x7) << 5) | ((rgb565 & 0xE000) >> 11));
-            uint8_t r = (uint8_t)(rgb565 & 0xF8);
-
-            int area_index = x - left_px + (y - top_px) * area_width;
-            uint8_t gray = (0.299 * r) + (0.587 * g) + (0.114 * b);
-            area_gray[area_index] = gray;
-        }
+    // Take an image captured after the request
+    camera_frame_t captured;
+    if (!camera_capture(camera_get_time_us(), captured)) {
+        ESP_LOGE(TAG, "Camera capture failed");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
     }
 
     char ts[32];
-    snprintf(ts, 32, "%lld.%06ld", frame->timestamp.tv_sec, frame->timestamp.tv_usec);
+    snprintf(ts, 32, "%lld.%06lld", captured.timestamp_us / 1000000, captured.timestamp_us % 1000000);
     httpd_resp_set_hdr(req, "X-Timestamp", (const char *)ts);
 
-    // size_t fb_len = 0;
-    if (frame->format == PIXFORMAT_RGB565) {
-        httpd_resp_set_type(req, "application/octet-stream");
-        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-        res = httpd_resp_send(req, (const char *)area_gray, area_width * area_height);
-    } else {
-        ESP_LOGE(TAG, "Unexpected pixel format : cannot serve capture_area_handler");
-    }
-
-    free(area_gray);
-
-    esp_camera_fb_return(frame);
+    // Grayscale area is copied row by row in a contiguous buffer
+    CImg<unsigned char> area = captured.image.get_crop(left_px, top_px, right_px, bottom_px);
+    captured.release();
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    res = httpd_resp_send(req, (const char *)area.data(), area.size());
 
     return res;
 }
 
-static uint8_t *image_buffer = (uint8_t *)malloc(CAMERA_WIDTH * CAMERA_HEIGHT);
-static camera_fb_t image_frame{};
-static SemaphoreHandle_t image_mutex; // mutual exclusion of read/write to full_image_frame and its buffer
-static SemaphoreHandle_t image_ready; // signal by full_image_updated callback when a new image has been updated
-static const int image_mutex_TIMEOUT_MS = 5000;
+static const int IMAGE_TIMEOUT_MS = 5000;
 
-// Note : the caller guarantee that full_image object is not changed until this function returns
-void full_image_updated(CImg<unsigned char> &full_image)
+// Read the optional 'mode' query parameter of image requests ('full' if not given),
+// reply 404 and return false if it's not a known image variant
+static bool parse_image_variant(httpd_req_t *req, jpeg_variant_t &variant)
 {
-    ESP_LOGD(TAG, "full_image_updated: %i x %i", full_image.width(), full_image.height());
-    assert(xSemaphoreTake(image_mutex, pdMS_TO_TICKS(image_mutex_TIMEOUT_MS)));
-    image_frame = grayscale_cimg_to_grayscale_frame(full_image, image_buffer);
-    xSemaphoreGive(image_mutex);
-    xSemaphoreGive(image_ready);
+    variant = jpeg_variant_t::FULL;
+    if (httpd_req_get_url_query_len(req) == 0) {
+        return true;
+    }
+    char *buf = NULL;
+    if (parse_get(req, &buf) != ESP_OK) {
+        return false;
+    }
+    char mode[16];
+    bool valid = httpd_query_key_value(buf, "mode", mode, sizeof(mode)) != ESP_OK || parse_jpeg_variant(mode, variant);
+    free(buf);
+    if (!valid) {
+        httpd_resp_send_404(req);
+    }
+    return valid;
 }
 
-// Reply the last captured image (with debug drawings)
+// Reply the last published image (with debug drawings)
 static esp_err_t image_handler(httpd_req_t *req)
 {
-    esp_err_t res = ESP_OK;
+    ESP_LOGI(TAG, "image_handler");
 
-    ESP_LOGI(TAG, "capture_handler");
+    jpeg_variant_t variant;
+    if (!parse_image_variant(req, variant)) {
+        return ESP_FAIL;
+    }
+
+    // Image is encoded once by the jpeg cache, it's sent without blocking the publisher
+    // The last published image is expected (the cache encodes it for this new client if needed)
+    jpeg_cache_add_client(variant);
+    unsigned int published_version = jpeg_cache_get_published_version();
+    jpeg_image_t *image
+        = jpeg_cache_acquire(variant, published_version > 0 ? published_version - 1 : 0, IMAGE_TIMEOUT_MS);
+    jpeg_cache_remove_client(variant);
+    if (image == NULL) {
+        ESP_LOGE(TAG, "No image published on time");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
 
     httpd_resp_set_type(req, "image/jpeg");
     httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-
-    assert(xSemaphoreTake(image_mutex, pdMS_TO_TICKS(image_mutex_TIMEOUT_MS)));
-    if (image_frame.format == PIXFORMAT_JPEG) {
-        res = httpd_resp_send(req, (const char *)image_frame.buf, image_frame.len);
-    } else {
-        jpg_chunking_t jchunk = {req, 0};
-        res = frame2jpg_cb(&image_frame, 80, jpg_encode_stream, &jchunk) ? ESP_OK : ESP_FAIL;
-        httpd_resp_send_chunk(req, NULL, 0);
-    }
-    xSemaphoreGive(image_mutex);
+    esp_err_t res = httpd_resp_send(req, (const char *)image->buffer, image->len);
+    jpeg_cache_release(image);
 
     return res;
 }
 
 static esp_err_t stream_handler(httpd_req_t *req)
 {
+    jpeg_variant_t variant;
+    if (!parse_image_variant(req, variant)) {
+        return ESP_FAIL;
+    }
+
     esp_err_t res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
     if (res != ESP_OK) {
         return res;
@@ -277,55 +270,38 @@ static esp_err_t stream_handler(httpd_req_t *req)
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     httpd_resp_set_hdr(req, "X-Framerate", "60");
 
+    jpeg_cache_add_client(variant);
+    unsigned int sent_version = 0;
     while (true) {
-        if (!xSemaphoreTake(image_ready, pdMS_TO_TICKS(image_mutex_TIMEOUT_MS))) {
+        // Wait for an image newer than the last sent one
+        jpeg_image_t *image = jpeg_cache_acquire(variant, sent_version, IMAGE_TIMEOUT_MS);
+        if (image == NULL) {
             ESP_LOGE(TAG, "Image not updated on time");
+            jpeg_cache_remove_client(variant);
             return ESP_FAIL;
         }
+        sent_version = image->version;
 
-        size_t _jpg_buf_len = 0;
-        uint8_t *_jpg_buf = NULL;
-        char *part_buf[128];
-
-        assert(xSemaphoreTake(image_mutex, pdMS_TO_TICKS(image_mutex_TIMEOUT_MS)));
-        // Use or cache image_frame data inside mutex-protected bloc, it can be sent outside of this bloc
-        pixformat_t format = image_frame.format;
-
-        if (format == PIXFORMAT_JPEG) {
-            _jpg_buf = image_frame.buf;
-            _jpg_buf_len = image_frame.len;
-        } else if (!frame2jpg(&image_frame, 80, &_jpg_buf, &_jpg_buf_len)) {
-            ESP_LOGE(TAG, "JPEG compression failed");
-            xSemaphoreGive(image_mutex);
-            return ESP_FAIL;
-        }
-        size_t hlen = snprintf((char *)part_buf,
-                               128,
+        char part_buf[128];
+        size_t hlen = snprintf(part_buf,
+                               sizeof(part_buf),
                                _STREAM_PART,
-                               _jpg_buf_len,
-                               image_frame.timestamp.tv_sec,
-                               image_frame.timestamp.tv_usec);
-        xSemaphoreGive(image_mutex);
+                               image->len,
+                               (int)(image->timestamp_us / 1000000),
+                               (int)(image->timestamp_us % 1000000));
 
         res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
-        if (res != ESP_OK) {
-            return res;
+        if (res == ESP_OK) {
+            res = httpd_resp_send_chunk(req, part_buf, hlen);
         }
-
-        res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
-        if (res != ESP_OK) {
-            return res;
+        if (res == ESP_OK) {
+            res = httpd_resp_send_chunk(req, (const char *)image->buffer, image->len);
         }
-
-        res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
+        jpeg_cache_release(image);
         if (res != ESP_OK) {
+            jpeg_cache_remove_client(variant);
             return res;
         }
-
-        if (format != PIXFORMAT_JPEG) {
-            free(_jpg_buf);
-            _jpg_buf = NULL;
-        }
     }
 
     return ESP_OK;
@@ -452,37 +428,209 @@ static esp_err_t supervisor_command_handler(httpd_req_t *req)
     return httpd_resp_send(req, NULL, 0);
 }
 
-static esp_err_t supervisor_status_handler(httpd_req_t *req)
+// An empty comment is sent if no event occurs during this delay, to detect closed connections
+static const int EVENTS_KEEP_ALIVE_MS = 5000;
+
+// Format an event as a Server-Sent Event in 'output' (of size >= 8 * EVENT_DATA_SIZE)
+// return the written length
+static int format_server_sent_event(const event_t &event, char *output)
+{
+    char *p = output;
+    if (event.seq > 0) {
+        p += sprintf(p, "id: %u\n", event.seq);
+    }
+    p += sprintf(p, "event: %s\ndata: ", str(event.type));
+    // (a data line can't contain new line, a multi-line data is sent in multiple data lines)
+    for (const char *c = event.data; *c != '\0'; c++) {
+        if (*c == '\n') {
+            p += sprintf(p, "\ndata: ");
+        } else if (*c != '\r') {
+            *p++ = *c;
+        }
+    }
+    p += sprintf(p, "\n\n");
+    return p - output;
+}
+
+// A client of the events stream
+// Its request is completed by the events sender task, so it doesn't block the events server
+typedef struct {
+    httpd_req_t *req; // (async copy of the request)
+    unsigned int cursor;
+    int64_t last_send_us;
+} events_client_t;
+
+static const int EVENTS_NEW_CLIENT_QUEUE_LENGTH = 4;
+static const int EVENTS_POLL_MS = 20; // the event ring readers are not notified, they check for new events
+static QueueHandle_t events_new_client_queue = NULL;
+
+// Stream the events (logs, state changes, detection results) as they happen, with Server-Sent Events
+// The request is handed over to the events sender task, so several clients can be streamed at the same time
+static esp_err_t events_handler(httpd_req_t *req)
+{
+    events_client_t client = {.req = NULL, .cursor = event_ring_get_last_seq(), .last_send_us = 0};
+
+    // A reconnecting client resumes after its last received event, if it's still in the ring
+    char last_event_id[16];
+    if (httpd_req_get_hdr_value_str(req, "Last-Event-ID", last_event_id, sizeof(last_event_id)) == ESP_OK) {
+        unsigned int last_received_seq = strtoul(last_event_id, NULL, 10);
+        // (the client can be ahead of the ring if the device has restarted)
+        if ((int)(client.cursor - last_received_seq) >= 0) {
+            client.cursor = last_received_seq;
+        }
+    }
+
+    if (httpd_req_async_handler_begin(req, &client.req) != ESP_OK) {
+        ESP_LOGE(TAG, "events_handler : cannot start async request");
+        return httpd_resp_send_500(req);
+    }
+    if (xQueueSend(events_new_client_queue, &client, 0) != pdTRUE) {
+        ESP_LOGE(TAG, "events_handler : too many new clients");
+        httpd_resp_send_500(client.req);
+        httpd_req_async_handler_complete(client.req);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Send the headers and the current status to a new client
+static esp_err_t start_events_client(events_client_t &client, char *sse_buffer)
 {
-    auto supervisor_state = supervisor_get_state();
-    ESP_LOGV(TAG, "supervisor_state = %s", supervisor_state);
-    auto sun_tracker_detection = sun_tracker_get_detection_result();
-    ESP_LOGV(TAG, "sun_tracker detection = %s", sun_tracker_detection);
-    auto sun_tracker_state = sun_tracker_get_state();
-    ESP_LOGV(TAG, "sun_tracker state = %s", sun_tracker_state);
-    auto motors_state = motors_get_state();
-    ESP_LOGV(TAG, "motors state = %s", motors_state);
+    ESP_LOGI(TAG, "events : start after event %u", client.cursor);
+    httpd_resp_set_type(client.req, "text/event-stream");
+    httpd_resp_set_hdr(client.req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(client.req, "Access-Control-Allow-Origin", "*");
+
+    status_snapshot_t snapshot = status_snapshot_get();
+    for (int i = 0; i < STATUS_FIELD_COUNT; i++) {
+        event_t event = {.seq = 0, .type = event_type_t::STATE};
+        snprintf(event.data,
+                 EVENT_DATA_SIZE,
+                 "{\"%s\":\"%s\"}",
+                 str(static_cast<status_field_t>(i)),
+                 snapshot.values[i]);
+        int len = format_server_sent_event(event, sse_buffer);
+        esp_err_t res = httpd_resp_send_chunk(client.req, sse_buffer, len);
+        if (res != ESP_OK) {
+            return res;
+        }
+    }
+    client.last_send_us = esp_timer_get_time();
+    return ESP_OK;
+}
 
+// Send the events pushed since the last call, or a keep-alive comment if nothing has been sent for a while
+static esp_err_t send_new_events(events_client_t &client, char *sse_buffer)
+{
+    int64_t now_us = esp_timer_get_time();
+    event_t event;
+    while (event_ring_read(client.cursor, 0, event)) {
+        int len = format_server_sent_event(event, sse_buffer);
+        esp_err_t res = httpd_resp_send_chunk(client.req, sse_buffer, len);
+        if (res != ESP_OK) {
+            return res;
+        }
+        client.last_send_us = now_us;
+    }
+    if (now_us - client.last_send_us >= (int64_t)EVENTS_KEEP_ALIVE_MS * 1000) {
+        client.last_send_us = now_us;
+        return httpd_resp_send_chunk(client.req, ":\n\n", 3);
+    }
+    return ESP_OK;
+}
+
+// Serve all the events clients, until their connection is closed
+static void events_sender_task(void *)
+{
+    static char sse_buffer[8 * EVENT_DATA_SIZE]; // (only used by this task)
+    std::list<events_client_t> clients;
+    while (true) {
+        // (waiting for a new client is also the event ring poll period)
+        events_client_t new_client;
+        if (xQueueReceive(events_new_client_queue, &new_client, pdMS_TO_TICKS(EVENTS_POLL_MS)) == pdTRUE) {
+            if (start_events_client(new_client, sse_buffer) == ESP_OK) {
+                clients.push_back(new_client);
+            } else {
+                httpd_req_async_handler_complete(new_client.req);
+            }
+        }
+
+        for (auto client = clients.begin(); client != clients.end();) {
+            if (send_new_events(*client, sse_buffer) == ESP_OK) {
+                client++;
+            } else {
+                ESP_LOGI(TAG, "events : stop after event %u", client->cursor);
+                httpd_req_async_handler_complete(client->req);
+                client = clients.erase(client);
+            }
+        }
+    }
+}
+
+// Reply the statistics of each measured stage, in microseconds, and the state machines unhandled transitions
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
     static char json_response[1024];
-    sprintf(json_response,
-            "{\"supervisor-state\":\"%s\", "
-            "\"sun-tracker-detection\":\"%s\", "
-            "\"sun-tracker-state\":\"%s\", "
-            "\"motors-state\":\"%s\"}",
-            supervisor_state,
-            sun_tracker_detection,
-            sun_tracker_state,
-            motors_state);
+
+    char *p = json_response;
+    *p++ = '{';
+    for (int i = 0; i < static_cast<int>(metrics_stage_t::COUNT); i++) {
+        metrics_stage_t stage = static_cast<metrics_stage_t>(i);
+        metrics_summary_t summary = metrics_get_summary(stage);
+        p += sprintf(p,
+                     "%s\"%s\":{\"count\":%i,\"min\":%i,\"avg\":%i,\"max\":%i,\"p95\":%i}",
+                     i > 0 ? "," : "",
+                     str(stage),
+                     summary.count,
+                     summary.min_us,
+                     summary.avg_us,
+                     summary.max_us,
+                     summary.p95_us);
+    }
+    // Transitions received by the state machines in a state where they have nothing to do
+    p += sprintf(p,
+                 ",\"unhandled-transitions\":{\"supervisor\":%u,\"sun-tracker\":%u,\"motors\":%u}",
+                 supervisor_get_unhandled_transition_count(),
+                 sun_tracker_get_unhandled_transition_count(),
+                 motors_get_unhandled_transition_count());
+    *p++ = '}';
+    *p++ = 0;
     httpd_resp_set_type(req, "application/json");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     return httpd_resp_send(req, json_response, strlen(json_response));
 }
 
-static esp_err_t log_handler(httpd_req_t *req)
+// Reply the deferred logs still in the ring (oldest first), they are formatted here
+static esp_err_t diagnostics_handler(httpd_req_t *req)
 {
-    web_log_get_last(log_buffer);
     httpd_resp_set_type(req, "text/plain");
-    return httpd_resp_send(req, log_buffer, strlen(log_buffer));
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    char line[256];
+    unsigned int cursor = 0;
+    deferred_log_record_t record;
+    unsigned int dropped_count;
+    bool first_record = true;
+    while (deferred_log_read(cursor, record, dropped_count)) {
+        int len = 0;
+        // (records dropped before the first one are just older than the ring)
+        if (dropped_count > 0 && !first_record) {
+            len += snprintf(line, sizeof(line), "<%u records dropped while reading>\n", dropped_count);
+        }
+        first_record = false;
+        len += snprintf(line + len,
+                        sizeof(line) - len,
+                        "%c (%lli) %s: ",
+                        record.level,
+                        (long long)(record.time_us / 1000),
+                        record.tag);
+        len += deferred_log_format(record, line + len, sizeof(line) - len - 1);
+        line[len++] = '\n';
+        if (httpd_resp_send_chunk(req, line, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 static esp_err_t index_handler(httpd_req_t *req)
@@ -533,14 +681,15 @@ void register_httpd(const QueueHandle_t frame_i, const QueueHandle_t frame_o, co
     httpd_uri_t supervisor_command_uri = {
         .uri = "/supervisor_command", .method = HTTP_GET, .handler = supervisor_command_handler, .user_ctx = NULL};
 
-    httpd_uri_t supervisor_status_uri = {
-        .uri = "/supervisor_status", .method = HTTP_GET, .handler = supervisor_status_handler, .user_ctx = NULL};
+    httpd_uri_t events_uri = {.uri = "/events", .method = HTTP_GET, .handler = events_handler, .user_ctx = NULL};
+
+    httpd_uri_t metrics_uri = {.uri = "/metrics", .method = HTTP_GET, .handler = metrics_handler, .user_ctx = NULL};
 
-    httpd_uri_t log_uri = {.uri = "/log", .method = HTTP_GET, .handler = log_handler, .user_ctx = NULL};
+    httpd_uri_t diagnostics_uri = {
+        .uri = "/diagnostics", .method = HTTP_GET, .handler = diagnostics_handler, .user_ctx = NULL};
 
-    image_mutex = xSemaphoreCreateMutex();
-    image_ready = xSemaphoreCreateBinary();
-    sun_tracker_register_image_callback(full_image_updated);
+    jpeg_cache_init();
+    sun_tracker_register_image_callback(jpeg_cache_publish);
 
     ESP_LOGI(TAG, "Starting web server on port: '%d'", config.server_port);
     if (httpd_start(&camera_httpd, &config) == ESP_OK) {
@@ -551,8 +700,8 @@ void register_httpd(const QueueHandle_t frame_i, const QueueHandle_t frame_o, co
         httpd_register_uri_handler(camera_httpd, &capture_area_uri);
         httpd_register_uri_handler(camera_httpd, &image_uri);
         httpd_register_uri_handler(camera_httpd, &supervisor_command_uri);
-        httpd_register_uri_handler(camera_httpd, &supervisor_status_uri);
-        httpd_register_uri_handler(camera_httpd, &log_uri);
+        httpd_register_uri_handler(camera_httpd, &metrics_uri);
+        httpd_register_uri_handler(camera_httpd, &diagnostics_uri);
     }
 
     config.server_port += 1;
@@ -561,4 +710,14 @@ void register_httpd(const QueueHandle_t frame_i, const QueueHandle_t frame_o, co
     if (httpd_start(&stream_httpd, &config) == ESP_OK) {
         httpd_register_uri_handler(stream_httpd, &stream_uri);
     }
+
+    // The events streams never end, they have their own server so they don't use the sockets of the others
+    config.server_port += 1;
+    config.ctrl_port += 1;
+    ESP_LOGI(TAG, "Starting events server on port: '%d'", config.server_port);
+    events_new_client_queue = xQueueCreate(EVENTS_NEW_CLIENT_QUEUE_LENGTH, sizeof(events_client_t));
+    xTaskCreate(events_sender_task, "events_sender", 4 * 1024, NULL, 5, NULL);
+    if (httpd_start(&events_httpd, &config) == ESP_OK) {
+        httpd_register_uri_handler(events_httpd, &events_uri);
+    }
 }
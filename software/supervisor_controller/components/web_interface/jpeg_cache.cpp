@@ -0,0 +1,241 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#include "jpeg_cache.hpp"
+
+#include "camera.hpp"
+#include "image_conversion.hpp"
+#include "metrics.hpp"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <algorithm>
+
+static const char *TAG = "jpeg_cache";
+
+static const int JPEG_QUALITY = 80;
+static const int MUTEX_TIMEOUT_MS = 5000;
+
+// Margin kept around the target in TARGET variant
+static const int TARGET_MARGIN_PX = 20;
+
+static const int VARIANT_COUNT = static_cast<int>(jpeg_variant_t::COUNT);
+
+// Clients waiting for a new image check the cache version at least at this period
+// (a new image notification can be missed between the version check and the wait)
+static const int NEW_IMAGE_POLL_MS = 100;
+static const EventBits_t NEW_IMAGE_BIT = BIT0;
+
+// Published images are triple buffered, so the publisher never waits for the encoder :
+// - the publisher owns 'write_index' buffer and fills it
+// - the encoder owns 'read_index' buffer and encodes it
+// - the last complete image is in the third buffer, its index is atomically exchanged
+//   with the publisher one (after filling) or with the encoder one (before encoding)
+static const int INPUT_BUFFER_COUNT = 3;
+static const int NEW_IMAGE_FLAG = 0x10; // set in 'ready_index' when the buffer has not been encoded yet
+static const int INDEX_MASK = 0x0F;
+
+struct input_image_t {
+    uint8_t *buffer;
+    camera_fb_t frame;
+    rectangle_t target_area;
+    int64_t timestamp_us;
+    unsigned int version;
+};
+
+static input_image_t input_images[INPUT_BUFFER_COUNT];
+static int write_index = 0;
+static std::atomic<int> ready_index = 1;
+static int read_index = 2;
+static SemaphoreHandle_t input_ready;
+
+// Reduced images (downscaled or cropped) are built in this buffer by the encoder task, before encoding
+static uint8_t *reduced_buffer = NULL;
+
+// Only the variants having at least one client are encoded
+static std::atomic<int> client_counts[VARIANT_COUNT];
+
+// Incremented at each published image
+static std::atomic<unsigned int> published_version = 0;
+
+// Last encoded image of each variant, the cache holds a reference on them
+static jpeg_image_t *last_images[VARIANT_COUNT];
+static SemaphoreHandle_t cache_mutex;
+static EventGroupHandle_t cache_events;
+
+static int get_variant_index(jpeg_variant_t variant)
+{
+    int index = static_cast<int>(variant);
+    assert(index >= 0 && index < VARIANT_COUNT);
+    return index;
+}
+
+void jpeg_cache_publish(CImg<unsigned char> &full_image, const rectangle_t &target_area)
+{
+    // The image is copied even without client, so a new client immediately gets the last published image
+    unsigned int version = ++published_version;
+    input_image_t &input = input_images[write_index];
+    {
+        metrics_scoped_timer_t timer(metrics_stage_t::CONVERSION);
+        input.frame = grayscale_cimg_to_grayscale_frame(full_image, input.buffer);
+    }
+    input.target_area = target_area;
+    input.timestamp_us = esp_timer_get_time();
+    input.version = version;
+
+    // Give the filled buffer to the encoder, and take the previous ready one (encoded or not) to fill next time
+    write_index = ready_index.exchange(write_index | NEW_IMAGE_FLAG) & INDEX_MASK;
+    xSemaphoreGive(input_ready);
+}
+
+void jpeg_cache_add_client(jpeg_variant_t variant)
+{
+    client_counts[get_variant_index(variant)]++;
+    // Wake up the encoder, the last published image may not have been encoded in this variant yet
+    xSemaphoreGive(input_ready);
+}
+
+void jpeg_cache_remove_client(jpeg_variant_t variant) { client_counts[get_variant_index(variant)]--; }
+
+unsigned int jpeg_cache_get_published_version() { return published_version; }
+
+jpeg_image_t *jpeg_cache_acquire(jpeg_variant_t variant, unsigned int min_version, int timeout_ms)
+{
+    int index = get_variant_index(variant);
+    int64_t timeout_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (true) {
+        assert(xSemaphoreTake(cache_mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)));
+        jpeg_image_t *image = last_images[index];
+        if (image != NULL && image->version > min_version) {
+            image->ref_count++;
+        } else {
+            image = NULL;
+        }
+        xSemaphoreGive(cache_mutex);
+
+        if (image != NULL) {
+            return image;
+        }
+        if (esp_timer_get_time() > timeout_us) {
+            return NULL;
+        }
+        xEventGroupWaitBits(cache_events, NEW_IMAGE_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(NEW_IMAGE_POLL_MS));
+    }
+}
+
+void jpeg_cache_release(jpeg_image_t *image)
+{
+    if (image != NULL && --image->ref_count == 0) {
+        free(image->buffer);
+        delete image;
+    }
+}
+
+// return the frame to encode for the given variant
+// (reduced frames are built in 'reduced_buffer', which is overwritten by the next call)
+static camera_fb_t get_variant_frame(const input_image_t &input, jpeg_variant_t variant)
+{
+    switch (variant) {
+    case jpeg_variant_t::HALF:
+        return grayscale_frame_downscale(&input.frame, 2, reduced_buffer);
+    case jpeg_variant_t::QUARTER:
+        return grayscale_frame_downscale(&input.frame, 4, reduced_buffer);
+    case jpeg_variant_t::TARGET:
+        if (input.target_area.left_px >= 0) {
+            rectangle_t area = {
+                std::max(input.target_area.left_px - TARGET_MARGIN_PX, 0),
+                std::max(input.target_area.top_px - TARGET_MARGIN_PX, 0),
+                std::min(input.target_area.right_px + TARGET_MARGIN_PX, (int)input.frame.width - 1),
+                std::min(input.target_area.bottom_px + TARGET_MARGIN_PX, (int)input.frame.height - 1),
+            };
+            return grayscale_frame_crop(&input.frame, area, reduced_buffer);
+        }
+        return input.frame;
+    default:
+        return input.frame;
+    }
+}
+
+// Encode the given variant and replace the previous one in the cache
+static void encode_variant(const input_image_t &input, jpeg_variant_t variant)
+{
+    camera_fb_t frame = get_variant_frame(input, variant);
+
+    jpeg_image_t *image = new jpeg_image_t{};
+    bool encoded;
+    {
+        metrics_scoped_timer_t timer(metrics_stage_t::JPEG_ENCODING);
+        encoded = frame2jpg(&frame, JPEG_QUALITY, &image->buffer, &image->len);
+    }
+    if (!encoded) {
+        ESP_LOGE(TAG, "JPEG compression failed (%s)", str(variant));
+        delete image;
+        return;
+    }
+    image->timestamp_us = input.timestamp_us;
+    image->version = input.version;
+    image->ref_count = 1; // reference held by the cache
+
+    int index = get_variant_index(variant);
+    assert(xSemaphoreTake(cache_mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)));
+    jpeg_image_t *old_image = last_images[index];
+    last_images[index] = image;
+    xSemaphoreGive(cache_mutex);
+    jpeg_cache_release(old_image);
+}
+
+// return true if the given variant has not been encoded from the given input yet
+// (no lock needed : last_images is only written by the encoder task)
+static bool is_variant_outdated(int index, const input_image_t &input)
+{
+    return last_images[index] == NULL || last_images[index]->version < input.version;
+}
+
+// Encode each published image once per variant having clients, then share it with all these clients
+// The last published image is kept in 'read_index' buffer, so it can be encoded later for a new client
+static void jpeg_encoder_task(void *arg)
+{
+    while (true) {
+        // Woken up by a new published image or by a new client
+        xSemaphoreTake(input_ready, portMAX_DELAY);
+        if (ready_index & NEW_IMAGE_FLAG) {
+            read_index = ready_index.exchange(read_index) & INDEX_MASK;
+        }
+        const input_image_t &input = input_images[read_index];
+        if (input.version == 0) {
+            continue; // nothing published yet
+        }
+
+        for (int i = 0; i < VARIANT_COUNT; i++) {
+            if (client_counts[i] > 0 && is_variant_outdated(i, input)) {
+                encode_variant(input, static_cast<jpeg_variant_t>(i));
+            }
+        }
+
+        // Wake up all waiting clients
+        xEventGroupSetBits(cache_events, NEW_IMAGE_BIT);
+        xEventGroupClearBits(cache_events, NEW_IMAGE_BIT);
+    }
+}
+
+void jpeg_cache_init()
+{
+    for (int i = 0; i < INPUT_BUFFER_COUNT; i++) {
+        input_images[i].buffer = (uint8_t *)malloc(CAMERA_WIDTH * CAMERA_HEIGHT);
+        assert(input_images[i].buffer != NULL);
+    }
+    // (a crop can be as big as the full image)
+    reduced_buffer = (uint8_t *)malloc(CAMERA_WIDTH * CAMERA_HEIGHT);
+    assert(reduced_buffer != NULL);
+    input_ready = xSemaphoreCreateBinary();
+    cache_mutex = xSemaphoreCreateMutex();
+    cache_events = xEventGroupCreate();
+    xTaskCreate(jpeg_encoder_task, TAG, 4 * 1024, NULL, 5, NULL);
+}
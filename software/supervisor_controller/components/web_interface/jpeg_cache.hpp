@@ -0,0 +1,86 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+#pragma once
+
+#include "image.hpp"
+
+#include <assert.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Variants of the published image, each one is encoded once for all its clients
+enum class jpeg_variant_t : char {
+    FULL = 0, // full image
+    HALF,     // full image downscaled by 2
+    QUARTER,  // full image downscaled by 4
+    TARGET,   // crop around the detected target (full image if target is not detected)
+    COUNT,    // (number of variants, not a variant)
+};
+
+// Convenient function for logging and parsing
+inline const char *str(jpeg_variant_t variant)
+{
+    switch (variant) {
+    case jpeg_variant_t::FULL:
+        return "full";
+    case jpeg_variant_t::HALF:
+        return "half";
+    case jpeg_variant_t::QUARTER:
+        return "quarter";
+    case jpeg_variant_t::TARGET:
+        return "target";
+    default:
+        assert(false);
+    }
+}
+
+// return true if 'name' is a variant name (see str), and set 'variant' accordingly
+inline bool parse_jpeg_variant(const char *name, jpeg_variant_t &variant)
+{
+    for (int i = 0; i < static_cast<int>(jpeg_variant_t::COUNT); i++) {
+        if (!strcmp(name, str(static_cast<jpeg_variant_t>(i)))) {
+            variant = static_cast<jpeg_variant_t>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Published image encoded in jpeg, shared by all http clients
+// It's freed when the last user releases it
+struct jpeg_image_t {
+    uint8_t *buffer;
+    size_t len;
+    int64_t timestamp_us; // publish time (esp_timer clock)
+    unsigned int version; // version of the published image (see jpeg_cache_get_published_version)
+    std::atomic<int> ref_count;
+};
+
+// Allocate the publish buffers and create the encoder task
+void jpeg_cache_init();
+
+// Give a new image to encode, the encoder task will encode it once for all clients of each variant
+// This function never blocks : the image is copied in a free buffer (triple buffering).
+// The last published image is kept even if no client is connected, to be encoded for the next client.
+// 'target_area' is used by TARGET variant (-1 coordinates if target is not detected)
+// Note : the caller guarantee that full_image object is not changed until this function returns
+void jpeg_cache_publish(CImg<unsigned char> &full_image, const rectangle_t &target_area);
+
+// Only the variants having clients are encoded
+// A new client gets the last published image without waiting for the next publish
+void jpeg_cache_add_client(jpeg_variant_t variant);
+void jpeg_cache_remove_client(jpeg_variant_t variant);
+
+// return the version of the last published image (incremented at each publish, starting at 1)
+unsigned int jpeg_cache_get_published_version();
+
+// return the last encoded image of the given variant if its version is greater than 'min_version',
+// otherwise wait for a newer image up to 'timeout_ms'
+// return NULL if no image has been encoded on time
+// The returned image must be released with 'jpeg_cache_release' after use
+jpeg_image_t *jpeg_cache_acquire(jpeg_variant_t variant, unsigned int min_version, int timeout_ms);
+
+void jpeg_cache_release(jpeg_image_t *image);
@@ -4,77 +4,45 @@
 #include "web_log.hpp"
 
 #include "esp_log.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
+#include "event_ring.hpp"
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
-static char log_buffer[LOG_BUFFER_SIZE];
-static char *log_buffer_end; // Points to the terminating NULL char
-
-static SemaphoreHandle_t buffer_mutex;
-
-static const int MUTEX_TIMEOUT_MS = 100;
-
+// The level letter of a log line is at this offset in the LOG_ macros format
+// (after the color escape sequence if any)
 #if CONFIG_LOG_COLORS == 1
-static const char *INFO_PREFIX = "\033[0;32mI";
-static const char *WARNING_PREFIX = "\033[0;33mW";
-static const char *ERROR_PREFIX = "\033[0;31mE";
-static const char *FULL_BUFFER_MESSAGE = "\033[0;31m<dropped messages because buffer full>\033[0m\n";
+static const int LEVEL_OFFSET = 7; // strlen("\033[0;32m")
 #else
-static const char *INFO_PREFIX = "I";
-static const char *WARNING_PREFIX = "W";
-static const char *ERROR_PREFIX = "E";
-static const char *FULL_BUFFER_MESSAGE = "<dropped messages because buffer full>\n";
+static const int LEVEL_OFFSET = 0;
 #endif
 
-bool starts_with(const char *str, const char *prefix) { return strncmp(str, prefix, strlen(prefix)) == 0; }
-
-// Must be called within mutex protection
-void web_log_reset()
+// return the level letter of a log format, or 0 if it's not a LOG_ macro format
+static char get_level(const char *format)
 {
-    log_buffer[0] = '\0';
-    log_buffer_end = log_buffer;
-};
+    if (strnlen(format, LEVEL_OFFSET + 1) <= LEVEL_OFFSET || (LEVEL_OFFSET > 0 && format[0] != '\033')) {
+        return 0;
+    }
+    return format[LEVEL_OFFSET];
+}
 
-// Called when a LOG_ macro has been called
+// Called when a LOG_ macro has been called, from any task
+// No lock is taken (except by console output), so logging never waits for web clients
 int web_log_update(const char *format, va_list args)
 {
-    assert(xSemaphoreTake(buffer_mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)));
-
-    // Always print in console (the default log callback is replaced by this one)
-    int n = vprintf(format, args);
-
-    // Cache the log if this is a warning or an error
-    if (starts_with(format, ERROR_PREFIX) || starts_with(format, WARNING_PREFIX) || starts_with(format, INFO_PREFIX)) {
-        int available_len = LOG_BUFFER_SIZE - (log_buffer_end - log_buffer);
-        int writen_len = vsnprintf(log_buffer_end, available_len, format, args);
-
-        // Note: 'available_len' counts the terminating NULL but 'writen_len' does not
-        if (writen_len < available_len) {
-            log_buffer_end += writen_len;
-        } else {
-            web_log_reset();
-            strcpy(log_buffer, FULL_BUFFER_MESSAGE);
-            log_buffer_end += strlen(FULL_BUFFER_MESSAGE);
-        }
+    // Push the info, warning and error lines to web clients, they are formatted directly in the event ring
+    // (so nothing is added to the stack of the calling task)
+    char level = get_level(format);
+    if (level == 'E' || level == 'W' || level == 'I') {
+        va_list ring_args;
+        va_copy(ring_args, args);
+        event_ring_vpush(event_type_t::LOG, format, ring_args);
+        va_end(ring_args);
     }
 
-    xSemaphoreGive(buffer_mutex);
-    return n;
+    // Always print in console (the default log callback is replaced by this one)
+    return vprintf(format, args);
 };
 
-void web_log_init()
-{
-    buffer_mutex = xSemaphoreCreateMutex();
-    web_log_reset();
-    esp_log_set_vprintf(web_log_update);
-}
-
-void web_log_get_last(char *buffer)
-{
-    assert(xSemaphoreTake(buffer_mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)));
-    strcpy(buffer, log_buffer);
-    web_log_reset();
-    xSemaphoreGive(buffer_mutex);
-}
+void web_log_init() { esp_log_set_vprintf(web_log_update); }
@@ -0,0 +1,42 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+// Synthetic images shared by the tests and benchmarks of the vision pipeline
+
+#pragma once
+
+#include "image.hpp"
+
+// Draw a capstone : black ring (7 modules) around a black stone (3 modules)
+// (default module size gives a capstone in the accepted size range)
+inline void draw_synthetic_capstone(CImg<unsigned char> &image, int center_x, int center_y, int module_px = 5)
+{
+    const unsigned char black = 0;
+    const unsigned char white = 255;
+    image.draw_rectangle(center_x - 7 * module_px / 2,
+                         center_y - 7 * module_px / 2,
+                         center_x + 7 * module_px / 2,
+                         center_y + 7 * module_px / 2,
+                         &black);
+    image.draw_rectangle(center_x - 5 * module_px / 2,
+                         center_y - 5 * module_px / 2,
+                         center_x + 5 * module_px / 2,
+                         center_y + 5 * module_px / 2,
+                         &white);
+    image.draw_rectangle(center_x - 3 * module_px / 2,
+                         center_y - 3 * module_px / 2,
+                         center_x + 3 * module_px / 2,
+                         center_y + 3 * module_px / 2,
+                         &black);
+}
+
+// Camera sized image (800x600) with 4 capstones around a target area, moved by the given offset
+inline CImg<unsigned char> create_synthetic_target_image(int offset_x, int offset_y)
+{
+    CImg<unsigned char> image(800, 600, 1, 1, 200);
+    draw_synthetic_capstone(image, 250 + offset_x, 150 + offset_y);
+    draw_synthetic_capstone(image, 550 + offset_x, 150 + offset_y);
+    draw_synthetic_capstone(image, 250 + offset_x, 450 + offset_y);
+    draw_synthetic_capstone(image, 550 + offset_x, 450 + offset_y);
+    return image;
+}
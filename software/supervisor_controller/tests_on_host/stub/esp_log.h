@@ -13,7 +13,13 @@
 #define DEBUG_PREFIX "D"
 #define VERBOSE_PREFIX "\x1B[90mV"
 
+// Benchmarks define ESP_LOG_DISABLED : logs are not printed on target at default log level,
+// so they must not be measured on host
+#ifdef ESP_LOG_DISABLED
+#define PRINT_LOG(prefix, tag, format, ...)
+#else
 #define PRINT_LOG(prefix, tag, format, ...) printf("  %s %s: " format "\033[0m\n", prefix, tag, ##__VA_ARGS__)
+#endif
 
 #define ESP_LOGE(tag, format, ...) PRINT_LOG(ERROR_PREFIX, tag, format, ##__VA_ARGS__)
 #define ESP_LOGW(tag, format, ...) PRINT_LOG(WARNING_PREFIX, tag, format, ##__VA_ARGS__)
@@ -0,0 +1,17 @@
+// Copyright (C) 2024 Rémi Peuchot (https://remipch.github.io/)
+// This code is distributed under GNU GPL v3 license
+
+// For test purpose, define the esp_timer function used by metrics
+
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+
+// Time since an arbitrary point, in microseconds
+inline int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}